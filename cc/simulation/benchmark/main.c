@@ -0,0 +1,1028 @@
+//
+//  main.c
+//  benchmark
+//
+//  Created by Richard Henry on 19/10/2026.
+//
+
+#include "space3.h"
+#include "scene.h"
+#include "snapshot.h"
+#include "body.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_VARIANTS 16
+#define WARMUP_FRAMES 60
+#define SETTLE_FRAMES 6000
+#define GRAVITY 9.8f
+#define MATH_ITEMS 1024
+
+typedef enum { GAS, CLOTH, PILES, ROPE, NUMBER_OF_SCENES } scene_type;
+
+static const char *scene_names[NUMBER_OF_SCENES] = { "gas", "cloth", "piles", "rope" };
+
+static const struct { const char *name; sm_integrator integrator; } integrators[] = {
+    
+    { "euler", SM_EXPLICIT_EULER },
+    { "semi", SM_SEMI_IMPLICIT_EULER },
+    { "verlet", SM_VELOCITY_VERLET },
+    { "rk4", SM_RK4 },
+    { "xpbd", SM_XPBD },
+};
+
+#define NUMBER_OF_INTEGRATORS (sizeof(integrators) / sizeof(integrators[0]))
+
+typedef struct {
+    
+    unsigned        size;
+    unsigned        frames;
+    unsigned        rate;
+    unsigned        threads[MAX_VARIANTS];
+    unsigned        number_of_threads;
+    unsigned        integrators[MAX_VARIANTS];
+    unsigned        number_of_integrators;
+    unsigned        iterations[MAX_VARIANTS];
+    unsigned        number_of_iterations;
+    int             sleeping;
+    int             mixed_precision;
+    int             three_d;
+    int             scenes[NUMBER_OF_SCENES];
+    
+} options;
+
+static double now(void) {
+    
+    struct timespec time;
+    
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    
+    return time.tv_sec + time.tv_nsec * 1e-9;
+}
+
+static float random_float(const float low, const float high) {
+    
+    return low + (high - low) * (rand() / (float)RAND_MAX);
+}
+
+#pragma mark Scenes
+
+static sm_mass *add_mass(sm_space *space, const float x, const float y, const float radius, const unsigned short type, const unsigned short mask) {
+    
+    sm_mass *mass = new_pooled_mass(space->mass_pool, 1.0, radius);
+    
+    add_mass_to_space(space, mass);
+    
+    mass->pos = mass->prev = (vec2) {{ x, y }};
+    mass->radius = radius;
+    mass->e = 0.5;
+    mass->collision_type = type;
+    mass->collision_mask = mask;
+    
+    return mass;
+}
+
+static void add_spring(sm_space *space, const unsigned mass1, const unsigned mass2, const float k, const float f) {
+    
+    const vec2 d = vec2Subtract(space->masses[mass1]->pos, space->masses[mass2]->pos);
+    
+    add_spring_to_space(space, (sm_spring) { mass1, mass2, k, vec2Length(d), f });
+}
+
+static void add_box(sm_space *space, const float width, const float height) {
+    
+    add_plane_to_space(space, new_pooled_plane(space->plane_pool, (vec2) {{ 0, 1 }}, 0));
+    add_plane_to_space(space, new_pooled_plane(space->plane_pool, (vec2) {{ 1, 0 }}, 0));
+    add_plane_to_space(space, new_pooled_plane(space->plane_pool, (vec2) {{ -1, 0 }}, width));
+    
+    if (height > 0) add_plane_to_space(space, new_pooled_plane(space->plane_pool, (vec2) {{ 0, -1 }}, height));
+}
+
+// Roughly size masses in each scene, seeded the same way every run
+static sm_space *new_scene(const scene_type scene, const unsigned size) {
+    
+    sm_space        *space = new_space(size, size * 4, 4);
+    const unsigned  side = (unsigned)ceil(sqrt(size));
+    
+    srand(1);
+    
+    switch (scene) {
+        
+        case GAS: {
+            
+            // Free particles bouncing around a closed box at a tenth of close packing
+            const float width = side * 3.0f;
+            
+            for (unsigned m = 0; m < size; m++) {
+                
+                sm_mass *mass = add_mass(space, random_float(1, width - 1), random_float(1, width - 1), 0.5, 1, 1);
+                
+                mass->e = 1.0;
+                mass->vel = (vec2) {{ random_float(-5, 5), random_float(-5, 5) }};
+            }
+            
+            add_box(space, width, width);
+            break;
+        }
+        
+        case CLOTH: {
+            
+            // A square sheet with structural and shear springs dropped onto the floor
+            for (unsigned y = 0; y < side; y++)
+                for (unsigned x = 0; x < side; x++) add_mass(space, x, side + 10.0f - y, 0.5, 2, 0);
+            
+            for (unsigned y = 0; y < side; y++) {
+                
+                for (unsigned x = 0; x < side; x++) {
+                    
+                    const unsigned m = y * side + x;
+                    
+                    if (x + 1 < side) add_spring(space, m, m + 1, 200, 1);
+                    if (y + 1 < side) add_spring(space, m, m + side, 200, 1);
+                    if (x + 1 < side && y + 1 < side) add_spring(space, m, m + side + 1, 100, 1);
+                    if (x > 0 && y + 1 < side) add_spring(space, m, m + side - 1, 100, 1);
+                }
+            }
+            
+            add_plane_to_space(space, new_pooled_plane(space->plane_pool, (vec2) {{ 0, 1 }}, 0));
+            break;
+        }
+        
+        case PILES: {
+            
+            // Columns of balls stacked on the floor between two walls
+            const unsigned columns = side / 2 ? side / 2 : 1;
+            
+            for (unsigned m = 0; m < size; m++)
+                add_mass(space, 1.0f + (m % columns) * 2.0f + random_float(-0.05, 0.05), 0.5f + (m / columns) * 1.01f, 0.5, 1, 1);
+            
+            add_box(space, columns * 2.0f, 0);
+            break;
+        }
+        
+        case ROPE: {
+            
+            // Lengths of chain falling in a heap on the floor
+            const unsigned length = side;
+            
+            for (unsigned m = 0; m < size; m++) {
+                
+                add_mass(space, (m % length) * 0.9f, 2.0f + (m / length) * 2.0f, 0.4, 1, 1);
+                
+                if (m % length) add_spring(space, m - 1, m, 400, 2);
+            }
+            
+            add_box(space, length * 0.9f, 0);
+            break;
+        }
+        
+        default:
+            break;
+    }
+    
+    return space;
+}
+
+static void apply_gravity(sm_space *space, const scene_type scene) {
+    
+    if (scene == GAS) return;
+    
+    // Set rather than added, as explicit Euler never clears forces
+    for (unsigned m = 0; m < space->number_of_masses; m++) {
+        
+        sm_mass *mass = space->masses[m];
+        
+        mass->frc = (vec2) {{ 0, -GRAVITY * mass->mass }};
+    }
+}
+
+// The same cloth and rope in 3D, with the sheet lying flat and the chains side by side in z
+static sm_space3 *new_scene3(const scene_type scene, const unsigned size) {
+    
+    sm_space3       *space = new_space3(size, size * 4, 5);
+    const unsigned  side = (unsigned)ceil(sqrt(size));
+    
+    if (scene == CLOTH) {
+        
+        for (unsigned z = 0; z < side; z++)
+            for (unsigned x = 0; x < side; x++) add_mass_to_space3(space, (vec3) {{ x, 10, z }}, 1.0, 0.5);
+        
+        for (unsigned z = 0; z < side; z++) {
+            
+            for (unsigned x = 0; x < side; x++) {
+                
+                const unsigned m = z * side + x;
+                
+                if (x + 1 < side) add_spring_to_space3(space, new_spring3(space, m, m + 1, 200, 1));
+                if (z + 1 < side) add_spring_to_space3(space, new_spring3(space, m, m + side, 200, 1));
+                if (x + 1 < side && z + 1 < side) add_spring_to_space3(space, new_spring3(space, m, m + side + 1, 100, 1));
+                if (x > 0 && z + 1 < side) add_spring_to_space3(space, new_spring3(space, m, m + side - 1, 100, 1));
+            }
+        }
+        
+        add_plane_to_space3(space, (vec3) {{ 0, 1, 0 }}, 0);
+        
+    } else if (scene == ROPE) {
+        
+        const unsigned length = side, rows = (unsigned)ceil(sqrt(side));
+        
+        for (unsigned m = 0; m < size; m++) {
+            
+            const unsigned  chain = m / length;
+            const unsigned  mass = add_mass_to_space3(space, (vec3) {{ (m % length) * 0.9f, 2.0f + (chain / rows) * 2.0f, 1.0f + (chain % rows) * 2.0f }}, 1.0, 0.4);
+            
+            space->e[mass] = 0.5;
+            space->collision_type[mass] = space->collision_mask[mass] = 1;
+            
+            if (m % length) add_spring_to_space3(space, new_spring3(space, mass - 1, mass, 400, 2));
+        }
+        
+        add_plane_to_space3(space, (vec3) {{ 0, 1, 0 }}, 0);
+        add_plane_to_space3(space, (vec3) {{ 1, 0, 0 }}, 0);
+        add_plane_to_space3(space, (vec3) {{ -1, 0, 0 }}, length * 0.9f);
+        add_plane_to_space3(space, (vec3) {{ 0, 0, 1 }}, 0);
+        add_plane_to_space3(space, (vec3) {{ 0, 0, -1 }}, rows * 2.0f);
+    }
+    
+    return space;
+}
+
+static void apply_gravity3(sm_space3 *space) {
+    
+    for (unsigned m = 0; m < space->number_of_masses; m++) space->frc_y[m] = -GRAVITY / space->inverse_mass[m];
+}
+
+#pragma mark Benchmarks
+
+static void report_run(const char *scene, const sm_integrator integrator, const unsigned threads, const unsigned masses, const unsigned springs,
+                       const double steps, const double seconds, const double *phases, const double energy, const unsigned awake) {
+    
+    const double other = seconds - phases[SM_PHASE_SPRINGS] - phases[SM_PHASE_COLLISIONS] - phases[SM_PHASE_INTEGRATION] - phases[SM_PHASE_PLANES];
+    
+    printf("%-6s %-7s %3u %8u %8u %10.1f %8.1f ", scene, integrators[integrator].name, threads, masses, springs, steps / seconds, seconds * 1e9 / (steps * masses));
+    
+    if (springs)
+        printf("%9.1f ", phases[SM_PHASE_SPRINGS] * 1e9 / (steps * springs));
+    else
+        printf("%9s ", "-");
+    
+    printf("%6.1f %6.1f %6.1f %6.1f %6.1f %6.3f %6u\n",
+           100 * phases[SM_PHASE_SPRINGS] / seconds, 100 * phases[SM_PHASE_COLLISIONS] / seconds, 100 * phases[SM_PHASE_INTEGRATION] / seconds,
+           100 * phases[SM_PHASE_PLANES] / seconds, 100 * other / seconds, energy / masses, awake);
+    
+    fflush(stdout);
+}
+
+static void run_benchmark(const options *o, const scene_type scene, const sm_integrator integrator, const unsigned threads) {
+    
+    sm_space *space = new_scene(scene, o->size);
+    
+    space->integrator = integrator;
+    space->mixed_precision = o->mixed_precision;
+    
+    // The single pass contact solver keeps settled piles trembling at a few tenths of a unit
+    // per second, so islands sleep below that
+    if (o->sleeping) {
+        
+        space->sleep_velocity = 0.3;
+        space->sleep_steps = 30;
+    }
+    
+    if (threads > 1) set_space_threads(space, threads);
+    
+    // Sleeping runs are timed once the scene has settled
+    const unsigned warmup = o->sleeping ? SETTLE_FRAMES : WARMUP_FRAMES;
+    
+    for (unsigned f = 0; f < warmup && (f < WARMUP_FRAMES || space->number_of_awake_masses); f++) {
+        
+        apply_gravity(space, scene);
+        step_space(space);
+    }
+    
+    space->profile = 1;
+    memset(space->phase_times, 0, sizeof(space->phase_times));
+    
+    // Gravity is part of the frame, as it would be in a game
+    const double start = now();
+    
+    for (unsigned f = 0; f < o->frames; f++) {
+        
+        apply_gravity(space, scene);
+        step_space(space);
+    }
+    
+    report_run(scene_names[scene], integrator, threads, space->number_of_masses, space->number_of_springs,
+               o->frames, now() - start, space->phase_times, space_energy(space), space->number_of_awake_masses);
+    
+    free_space(space);
+}
+
+static void run_benchmark3(const options *o, const scene_type scene, const sm_integrator integrator, const unsigned threads) {
+    
+    sm_space3 *space = new_scene3(scene, o->size);
+    
+    space->integrator = integrator;
+    
+    if (threads > 1) set_space3_threads(space, threads);
+    
+    for (unsigned f = 0; f < WARMUP_FRAMES; f++) {
+        
+        apply_gravity3(space);
+        step_space3(space);
+    }
+    
+    space->profile = 1;
+    memset(space->phase_times, 0, sizeof(space->phase_times));
+    
+    const double start = now();
+    
+    for (unsigned f = 0; f < o->frames; f++) {
+        
+        apply_gravity3(space);
+        step_space3(space);
+    }
+    
+    report_run(scene_names[scene], integrator, threads, space->number_of_masses, space->number_of_springs,
+               o->frames, now() - start, space->phase_times, space3_energy(space), space->number_of_masses);
+    
+    free_space3(space);
+}
+
+// Energy of an undamped chain, free of collisions and gravity, over the frames
+static void run_drift(const options *o) {
+    
+    printf("%-7s %12s %12s %12s %10s\n", "drift", "start", "end", "relative", "ms");
+    
+    for (unsigned i = 0; i < o->number_of_integrators; i++) {
+        
+        const sm_integrator integrator = o->integrators[i];
+        sm_space            *space = new_space(o->size, o->size, 0);
+        
+        srand(1);
+        space->integrator = integrator;
+        space->friction = 0.0;
+        space->timestep = 1.0 / o->rate;
+        space->mixed_precision = o->mixed_precision;
+        
+        for (unsigned m = 0; m < o->size; m++) {
+            
+            sm_mass *mass = add_mass(space, m * 1.0f, 0, 0.25, 0, 0);
+            
+            mass->vel = (vec2) {{ random_float(-1, 1), random_float(-1, 1) }};
+            
+            if (m) add_spring_to_space(space, (sm_spring) { m - 1, m, 400, 1, 0 });
+        }
+        
+        const double energy = space_energy(space), start = now();
+        
+        for (unsigned f = 0; f < o->frames; f++) step_space(space);
+        
+        const double seconds = now() - start, final = space_energy(space);
+        
+        printf("%-7s %12.6g %12.6g %12.3e %10.1f\n", integrators[integrator].name, energy, final, (final - energy) / energy, seconds * 1e3);
+        
+        fflush(stdout);
+        free_space(space);
+    }
+}
+
+// How far the piles overlap and how much they still move after the frames, for the single pass
+// and for sequential impulses at each iteration count
+static void run_contacts(const options *o) {
+    
+    printf("%-7s %6s %10s %10s %10s %10s\n", "solver", "iters", "steps/s", "mean", "max", "E/mass");
+    
+    for (unsigned i = 0; i <= o->number_of_iterations; i++) {
+        
+        sm_space *space = new_scene(PILES, o->size);
+        
+        space->integrator = o->integrators[0];
+        space->mixed_precision = o->mixed_precision;
+        
+        if (i) {
+            
+            space->contact_solver = SM_SEQUENTIAL_IMPULSES;
+            space->contact_iterations = o->iterations[i - 1];
+        }
+        
+        const double start = now();
+        
+        for (unsigned f = 0; f < WARMUP_FRAMES + o->frames; f++) {
+            
+            // Overlaps are those the last step found
+            space->record_contacts = f + 1 == WARMUP_FRAMES + o->frames;
+            
+            apply_gravity(space, PILES);
+            step_space(space);
+        }
+        
+        const double seconds = now() - start;
+        double       total = 0, deepest = 0;
+        
+        for (unsigned c = 0; c < space->number_of_contacts; c++) {
+            
+            total += space->contacts[c].depth;
+            deepest = fmax(deepest, space->contacts[c].depth);
+        }
+        
+        printf("%-7s ", i ? "seq" : "single");
+        
+        if (i)
+            printf("%6u ", space->contact_iterations);
+        else
+            printf("%6s ", "-");
+        
+        printf("%10.1f %10.4f %10.4f %10.3e\n", (WARMUP_FRAMES + o->frames) / seconds,
+               space->number_of_contacts ? total / space->number_of_contacts : 0, deepest, space_energy(space) / space->number_of_masses);
+        
+        fflush(stdout);
+        free_space(space);
+    }
+}
+
+#pragma mark Checks
+
+static int report_check(const char *name, const int passed) {
+    
+    printf("%-40s %s\n", name, passed ? "ok" : "FAILED");
+    fflush(stdout);
+    
+    return passed;
+}
+
+// Steps with gravity until every island is asleep, or gives up
+static int settle_space(sm_space *space, const unsigned max_steps) {
+    
+    for (unsigned f = 0; f < max_steps && space->number_of_awake_masses; f++) {
+        
+        apply_gravity(space, PILES);
+        step_space(space);
+    }
+    
+    return !space->number_of_awake_masses;
+}
+
+// A short chain lying on the floor, which goes to sleep quickly
+static sm_space *new_resting_chain(const sm_integrator integrator) {
+    
+    sm_space *space = new_space(8, 8, 1);
+    
+    space->integrator = integrator;
+    space->sleep_velocity = 0.05;
+    space->sleep_steps = 10;
+    
+    for (unsigned m = 0; m < 4; m++) {
+        
+        add_mass(space, m * 1.0f, 0.5, 0.5, 0, 0)->e = 0;
+        
+        if (m) add_spring(space, m - 1, m, 100, 1);
+    }
+    
+    add_plane_to_space(space, new_pooled_plane(space->plane_pool, (vec2) {{ 0, 1 }}, 0));
+    
+    return space;
+}
+
+static int check_xpbd_sleep(void) {
+    
+    sm_space    *space = new_resting_chain(SM_XPBD);
+    vec2        rest[4];
+    int         passed = settle_space(space, 1000);
+    
+    for (unsigned m = 0; m < 4; m++) rest[m] = space->masses[m]->pos;
+    
+    for (unsigned f = 0; f < 100; f++) {
+        
+        apply_gravity(space, PILES);
+        step_space(space);
+    }
+    
+    for (unsigned m = 0; m < 4; m++) passed &= !memcmp(&rest[m], &space->masses[m]->pos, sizeof(vec2));
+    
+    free_space(space);
+    
+    return report_check("xpbd sleeping island stays put", passed);
+}
+
+// A mass resting on the floor falls asleep during a step_space_dt call while a drifting mass
+// with no force on it stays awake. Neither the resting mass's held force nor its frc may reach
+// the drifting one.
+static int check_held_forces_after_sleep(void) {
+    
+    sm_space    *space = new_space(2, 0, 1);
+    sm_mass     *resting = add_mass(space, 0, 0.5, 0.5, 0, 0), *drifting = add_mass(space, 10, 10, 0.5, 0, 0);
+    int         passed = 1;
+    
+    space->integrator = SM_SEMI_IMPLICIT_EULER;
+    space->friction = 0;
+    space->sleep_velocity = 0.05;
+    space->sleep_steps = 10;
+    resting->e = 0;
+    drifting->vel = (vec2) {{ 1, 0 }};
+    
+    add_plane_to_space(space, new_pooled_plane(space->plane_pool, (vec2) {{ 0, 1 }}, 0));
+    
+    for (unsigned f = 0; f < 100; f++) {
+        
+        resting->frc = (vec2) {{ 0, -GRAVITY }};
+        step_space_dt(space, 4 * space->timestep, 1);
+        
+        passed &= drifting->vel.y == 0 && !resting->frc.x && !resting->frc.y;
+    }
+    
+    passed &= space->number_of_awake_masses == 1;
+    free_space(space);
+    
+    return report_check("held forces follow masses to sleep", passed);
+}
+
+// A binary scene whose spring points past its masses is refused, and a text scene keeps the
+// constraint and sleep parameters
+// Whether a scene brought back every parameter the check sets
+static int same_parameters(const sm_space *loaded, const sm_space *space) {
+    
+    return loaded->mixed_precision == space->mixed_precision && loaded->constraint_solver == space->constraint_solver && loaded->constraint_iterations == space->constraint_iterations &&
+        loaded->contact_solver == space->contact_solver && loaded->contact_iterations == space->contact_iterations &&
+        loaded->sleep_velocity == space->sleep_velocity && loaded->sleep_energy == space->sleep_energy && loaded->sleep_steps == space->sleep_steps;
+}
+
+static int check_scene_files(void) {
+    
+    sm_space    *space = new_resting_chain(SM_XPBD);
+    char        path[64];
+    int         passed;
+    
+    space->constraint_solver = SM_COLORED_GAUSS_SEIDEL;
+    space->constraint_iterations = 7;
+    space->mixed_precision = 1;
+    space->contact_solver = SM_SEQUENTIAL_IMPULSES;
+    space->contact_iterations = 3;
+    space->sleep_energy = 0.25;
+    
+    snprintf(path, sizeof(path), "/tmp/sm_check_%d.scene", (int)getpid());
+    passed = save_scene(space, path);
+    
+    sm_scene *scene = passed ? map_scene(path) : 0;
+    
+    passed &= scene != 0;
+    
+    if (scene) {
+        
+        const unsigned long long    offset = scene->header->blocks[SM_SCENE_SPRING_MASS2];
+        const unsigned              corrupt = 4;
+        FILE                        *file;
+        sm_space                    *mapped = new_space_from_scene(scene);
+        
+        passed &= same_parameters(mapped, space);
+        free_space(mapped);
+        unmap_scene(scene);
+        
+        passed &= (file = fopen(path, "r+b")) && !fseek(file, (long)offset, SEEK_SET) && fwrite(&corrupt, sizeof(corrupt), 1, file) == 1;
+        
+        if (file) fclose(file);
+        
+        passed &= !map_scene(path);
+    }
+    
+    passed &= save_scene_text(space, path);
+    
+    sm_space *loaded = passed ? load_scene_text(path) : 0;
+    
+    passed &= loaded && same_parameters(loaded, space);
+    
+    if (loaded) free_space(loaded);
+    
+    remove(path);
+    free_space(space);
+    
+    return report_check("scene files checked and round tripped", passed);
+}
+
+// Steps a falling rope, rolls back to a saved frame and steps the same frames again, which
+// must land on the same checksum
+static int check_replay(const char *name, sm_space *space) {
+    
+    sm_rollback *rollback = new_rollback(4);
+    unsigned    checksum;
+    
+    for (unsigned f = 0; f < 60; f++) {
+        
+        if (f == 30) save_rollback(rollback, space, f);
+        
+        apply_gravity(space, ROPE);
+        step_space(space);
+    }
+    
+    checksum = space_checksum(space);
+    
+    int passed = rollback_to(rollback, space, 30);
+    
+    for (unsigned f = 30; f < 60; f++) {
+        
+        apply_gravity(space, ROPE);
+        step_space(space);
+    }
+    
+    passed &= space_checksum(space) == checksum;
+    
+    free_rollback(rollback);
+    free_space(space);
+    
+    return report_check(name, passed);
+}
+
+static int check_mixed_precision_replay(void) {
+    
+    sm_space *space = new_scene(ROPE, 400);
+    
+    space->integrator = SM_SEMI_IMPLICIT_EULER;
+    space->mixed_precision = 1;
+    
+    return check_replay("mixed precision replays exactly", space);
+}
+
+// A square body of four masses above the floor, added to the space's own masses
+static sm_body *add_square_body(sm_space *space, const float x, const float y) {
+    
+    sm_body *body = new_body(space);
+    
+    for (unsigned m = 0; m < 4; m++) add_mass_to_body(space, body, add_mass(space, x + (m & 1), y + (m >> 1), 0.5, 1, 1));
+    
+    return body;
+}
+
+// A body dropped on the floor comes to rest on it, and keeps its masses awake
+static int check_body_on_floor(void) {
+    
+    sm_space    *space = new_space(4, 0, 1);
+    int         passed = 1;
+    
+    space->integrator = SM_SEMI_IMPLICIT_EULER;
+    space->sleep_velocity = 0.05;
+    space->sleep_steps = 10;
+    
+    const sm_body *body = add_square_body(space, 0, 2);
+    
+    add_plane_to_space(space, new_pooled_plane(space->plane_pool, (vec2) {{ 0, 1 }}, 0));
+    
+    for (unsigned f = 0; f < 600; f++) {
+        
+        apply_gravity(space, PILES);
+        step_space(space);
+    }
+    
+    for (unsigned m = 0; m < 4; m++) passed &= space->masses[m]->pos.y > 0.25;
+    
+    passed &= body->pos.y > 0.75 && space->number_of_awake_masses == 4;
+    free_space(space);
+    
+    return report_check("bodies rest on planes and stay awake", passed);
+}
+
+// A spinning body falling clear of the rope heap, so only the body's own state is replayed
+static int check_body_replay(void) {
+    
+    sm_space *space = new_scene(ROPE, 400);
+    
+    space->integrator = SM_SEMI_IMPLICIT_EULER;
+    add_square_body(space, 4, 100);
+    space->masses[space->number_of_masses - 1]->vel = (vec2) {{ 2, 0 }};
+    
+    return check_replay("bodies replay exactly", space);
+}
+
+// Sequential impulses warm start from the last step's impulses, for the rope and for a body
+// dropped into it
+static int check_sequential_impulse_replay(void) {
+    
+    sm_space *space = new_scene(ROPE, 400);
+    
+    space->integrator = SM_SEMI_IMPLICIT_EULER;
+    space->contact_solver = SM_SEQUENTIAL_IMPULSES;
+    add_square_body(space, 4, 30);
+    
+    return check_replay("sequential impulses replay exactly", space);
+}
+
+// The error bound vector.h documents for the fast functions in this build
+#if defined(DVECTOR_DOUBLE)
+#define FAST_MATH_BOUND 1e-12
+#elif defined(__SSE__) || defined(_M_X64)
+#define FAST_MATH_BOUND 5e-7
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define FAST_MATH_BOUND 3e-5
+#else
+#define FAST_MATH_BOUND 2e-3
+#endif
+
+typedef struct { double length, normal, batch; } fast_math_errors;
+
+// Largest errors of the fast functions against double sqrt over MATH_ITEMS planar vectors,
+// with zs as the third component for the batch lengths
+static fast_math_errors measure_fast_math(const vec2 *planar, const float *zs) {
+    
+    static float        xs[MATH_ITEMS], ys[MATH_ITEMS], lengths[MATH_ITEMS];
+    fast_math_errors    errors = { 0, 0, 0 };
+    
+    for (unsigned i = 0; i < MATH_ITEMS; i++) {
+        
+        xs[i] = planar[i].x;
+        ys[i] = planar[i].y;
+    }
+    
+    vec3LengthFastBatch(xs, ys, zs, lengths, MATH_ITEMS);
+    
+    for (unsigned i = 0; i < MATH_ITEMS; i++) {
+        
+        const double    length = sqrt((double)planar[i].x * planar[i].x + (double)planar[i].y * planar[i].y);
+        const double    length3 = sqrt((double)xs[i] * xs[i] + (double)ys[i] * ys[i] + (double)zs[i] * zs[i]);
+        const vec2      normal = vec2NormalizeFast(planar[i]);
+        
+        errors.length = fmax(errors.length, fabs(vec2LengthFast(planar[i]) - length) / length);
+        errors.normal = fmax(errors.normal, fmax(fabs(normal.x - planar[i].x / length), fabs(normal.y - planar[i].y / length)));
+        errors.batch = fmax(errors.batch, fabs(lengths[i] - length3) / length3);
+    }
+    
+    return errors;
+}
+
+static int check_fast_math(void) {
+    
+    static vec2     planar[MATH_ITEMS];
+    static float    zs[MATH_ITEMS];
+    
+    srand(1);
+    
+    // Lengths over many octaves, so every mantissa of the estimate's input is reached
+    for (unsigned i = 0; i < MATH_ITEMS; i++) {
+        
+        const float scale = ldexpf(1, (int)(i % 40) - 20);
+        
+        planar[i] = VEC2(random_float(-1, 1) * scale, random_float(-1, 1) * scale);
+        zs[i] = random_float(-1, 1) * scale;
+    }
+    
+    const fast_math_errors errors = measure_fast_math(planar, zs);
+    
+    return report_check("fast lengths and normals within bound", errors.length <= FAST_MATH_BOUND && errors.normal <= FAST_MATH_BOUND && errors.batch <= FAST_MATH_BOUND);
+}
+
+// Each check prints its result, and the number that failed is the exit status
+static int run_checks(void) {
+    
+    int failed = 0;
+    
+    failed += !check_xpbd_sleep();
+    failed += !check_held_forces_after_sleep();
+    failed += !check_scene_files();
+    failed += !check_mixed_precision_replay();
+    failed += !check_body_on_floor();
+    failed += !check_body_replay();
+    failed += !check_sequential_impulse_replay();
+    failed += !check_fast_math();
+    
+    return failed;
+}
+
+#pragma mark Vector math
+
+// Each operation is timed over MATH_ITEMS inputs per frame, pairing each input with a different
+// neighbour every frame so no result can be reused
+#define TIME_MATH(name, statement) { \
+    const double start = now(); \
+    for (unsigned f = 0; f < o->frames; f++) \
+        for (unsigned i = 0; i < MATH_ITEMS; i++) { \
+            const unsigned j = (i + f + 1) & (MATH_ITEMS - 1); \
+            statement; \
+        } \
+    printf("%-22s %8.2f\n", name, (now() - start) * 1e9 / ((double)o->frames * MATH_ITEMS)); \
+}
+
+// The same for batch functions, one call over all MATH_ITEMS inputs per frame
+#define TIME_BATCH(name, statement) { \
+    const double start = now(); \
+    for (unsigned f = 0; f < o->frames; f++) statement; \
+    printf("%-22s %8.2f\n", name, (now() - start) * 1e9 / ((double)o->frames * MATH_ITEMS)); \
+}
+
+// Per call cost of the vector.h functions DVECTOR_SIMD and DVECTOR_FAST_MATH replace, to compare
+// builds with and without them, and the largest errors of the fast functions against double sqrt
+static void run_math(const options *o) {
+    
+    static mat4 matrices[MATH_ITEMS], matrix_results[MATH_ITEMS];
+    static quat quats[MATH_ITEMS], quat_results[MATH_ITEMS];
+    static vec4 vectors[MATH_ITEMS], vector_results[MATH_ITEMS];
+    static vec2 planar[MATH_ITEMS], planar_results[MATH_ITEMS];
+    static float xs[MATH_ITEMS], ys[MATH_ITEMS], zs[MATH_ITEMS], lengths[MATH_ITEMS];
+    
+    srand(1);
+    
+    for (unsigned i = 0; i < MATH_ITEMS; i++) {
+        
+        for (int c = 0; c < 4; c++) {
+            
+            for (int r = 0; r < 4; r++) matrices[i].m[c][r] = random_float(-1, 1) + (c == r ? 4 : 0);
+            vectors[i].v[c] = random_float(-1, 1);
+        }
+        
+        quats[i] = quatNormalize(QUAT(random_float(-1, 1), random_float(-1, 1), random_float(-1, 1), random_float(-1, 1)));
+        planar[i] = VEC2(random_float(-10, 10), random_float(-10, 10));
+        xs[i] = planar[i].x;
+        ys[i] = planar[i].y;
+        zs[i] = random_float(-10, 10);
+    }
+    
+#ifdef DVSIMD
+    const char *math = "sse";
+#else
+    const char *math = "scalar";
+#endif
+#ifdef DVECTOR_INLINE
+    const char *linkage = "inline";
+#else
+    const char *linkage = "extern";
+#endif
+#ifdef DVECTOR_FAST_MATH
+    const char *roots = "fast";
+#else
+    const char *roots = "precise";
+#endif
+    
+    printf("vector.h %s, %s, %s\n%-22s %8s\n", math, linkage, roots, "operation", "ns/op");
+    
+    TIME_MATH("mat4MultiplyMatrix", matrix_results[i] = mat4MultiplyMatrix(matrices[i], matrices[j]));
+    TIME_MATH("mat4Inverse", matrix_results[i] = mat4Inverse(matrices[j]));
+    TIME_MATH("mat4MultiplyVector", vector_results[i] = mat4MultiplyVector(matrices[i], vectors[j]));
+    TIME_MATH("quatMultiply", quat_results[i] = quatMultiply(quats[i], quats[j]));
+    TIME_MATH("quatSlerp", quat_results[i] = quatSlerp(quats[i], quats[j], 0.25f));
+    TIME_MATH("vec2Length", lengths[i] = vec2Length(planar[j]));
+    TIME_MATH("vec2LengthFast", lengths[i] = vec2LengthFast(planar[j]));
+    TIME_MATH("vec2Normalize", planar_results[i] = vec2Normalize(planar[j]));
+    TIME_MATH("vec2NormalizeFast", planar_results[i] = vec2NormalizeFast(planar[j]));
+    TIME_BATCH("vec3LengthBatch", vec3LengthBatch(xs, ys, zs, lengths, MATH_ITEMS));
+    TIME_BATCH("vec3LengthFastBatch", vec3LengthFastBatch(xs, ys, zs, lengths, MATH_ITEMS));
+    TIME_BATCH("vec2NormalizeBatch", vec2NormalizeBatch(xs, ys, MATH_ITEMS));
+    TIME_BATCH("vec2NormalizeFastBatch", vec2NormalizeFastBatch(xs, ys, MATH_ITEMS));
+    
+    double checksum = 0;
+    
+    for (unsigned i = 0; i < MATH_ITEMS; i++)
+        checksum += matrix_results[i].m[1][2] + vector_results[i].x + quat_results[i].w + planar_results[i].y + lengths[i];
+    
+    printf("checksum %g\n", checksum);
+    
+    fast_math_errors errors = measure_fast_math(planar, zs);
+    
+    printf("fast errors: length %.2e relative, normal %.2e absolute, batch length %.2e relative, bound %.0e\n", errors.length, errors.normal, errors.batch, FAST_MATH_BOUND);
+}
+
+#pragma mark Options
+
+static unsigned parse_list(const char *list, unsigned *values, const int integrator_names) {
+    
+    unsigned    count = 0;
+    char        copy[256];
+    
+    strncpy(copy, list, sizeof(copy) - 1);
+    copy[sizeof(copy) - 1] = 0;
+    
+    for (char *item = strtok(copy, ","); item && count < MAX_VARIANTS; item = strtok(0, ",")) {
+        
+        if (!integrator_names) {
+            
+            const int value = atoi(item);
+            
+            if (value > 0) values[count++] = value;
+            continue;
+        }
+        
+        for (unsigned i = 0; i < NUMBER_OF_INTEGRATORS; i++)
+            if (!strcmp(item, integrators[i].name)) values[count++] = integrators[i].integrator;
+    }
+    
+    return count;
+}
+
+static void usage(const char *name) {
+    
+    fprintf(stderr,
+            "usage: %s [-n masses] [-f frames] [-t threads,...] [-i integrator,...] [-s] [-p] [-3] [-d] [-r rate] [-c iterations,...] [-m] [-v] [scene ...]\n"
+            "  scenes       gas cloth piles rope, all of them by default\n"
+            "  -n masses    roughly how many masses each scene has, 10000 by default\n"
+            "  -f frames    frames timed after %d warm up frames, 300 by default\n"
+            "  -t threads   thread counts to compare, 1 by default\n"
+            "  -i names     integrators to compare from euler semi verlet rk4 xpbd, semi by default.\n"
+            "               euler keeps the space's per frame factors, which the stiffer scenes outrun\n"
+            "  -s           let resting islands sleep, warming up until everything sleeps or for\n"
+            "               %d frames, whichever comes first\n"
+            "  -p           mixed precision, float state updated and spring forces summed in double\n"
+            "  -3           cloth and rope in a 3D space, with the semi and verlet integrators\n"
+            "  -d           measure energy drift of the integrators on a free chain instead\n"
+            "  -r rate      steps per second for -d, 60 by default. Rounding outgrows the integrators'\n"
+            "               own error at higher rates\n"
+            "  -c iters     compare the single pass contact solver with sequential impulses at these\n"
+            "               iteration counts on the piles instead, by the mean and largest overlap and\n"
+            "               the energy left at the end, with the first integrator\n"
+            "  -m           time vector.h matrix, quaternion, length and normalize functions instead,\n"
+            "               frames x %d calls each\n"
+            "  -v           run the consistency checks instead, exiting with the number that failed\n"
+            "Each run reports steps per second, ns per mass for the whole step, ns per spring for the\n"
+            "spring phase alone, the percentage of the step in each phase, and the final energy per mass.\n",
+            name, WARMUP_FRAMES, SETTLE_FRAMES, MATH_ITEMS);
+}
+
+int main(int argc, char * const argv[]) {
+    
+    options o = { 10000, 300, 60, { 1 }, 1, { SM_SEMI_IMPLICIT_EULER }, 1, { 0 }, 0, 0, 0, 0, { 0 } };
+    int     drift = 0, math = 0, checks = 0, option;
+    
+    while ((option = getopt(argc, argv, "n:f:t:i:sp3dr:c:mvh")) != -1) {
+        
+        switch (option) {
+            
+            case 'n': o.size = atoi(optarg); break;
+            case 'f': o.frames = atoi(optarg); break;
+            case 't': o.number_of_threads = parse_list(optarg, o.threads, 0); break;
+            case 'i': o.number_of_integrators = parse_list(optarg, o.integrators, 1); break;
+            case 's': o.sleeping = 1; break;
+            case 'p': o.mixed_precision = 1; break;
+            case '3': o.three_d = 1; break;
+            case 'd': drift = 1; break;
+            case 'r': o.rate = atoi(optarg); break;
+            case 'c': o.number_of_iterations = parse_list(optarg, o.iterations, 0); break;
+            case 'm': math = 1; break;
+            case 'v': checks = 1; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    
+    if (!o.size || !o.frames || !o.rate || !o.number_of_threads || !o.number_of_integrators) {
+        
+        usage(argv[0]);
+        return 1;
+    }
+    
+    if (checks) return run_checks();
+    
+    if (drift) {
+        
+        run_drift(&o);
+        return 0;
+    }
+    
+    if (math) {
+        
+        run_math(&o);
+        return 0;
+    }
+    
+    if (o.number_of_iterations) {
+        
+        run_contacts(&o);
+        return 0;
+    }
+    
+    int any = 0;
+    
+    for (int a = optind; a < argc; a++) {
+        
+        int found = 0;
+        
+        for (unsigned s = 0; s < NUMBER_OF_SCENES; s++)
+            if (!strcmp(argv[a], scene_names[s])) o.scenes[s] = found = any = 1;
+        
+        if (!found) {
+            
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    
+    printf("%-6s %-7s %3s %8s %8s %10s %8s %9s %6s %6s %6s %6s %6s %6s %6s\n",
+           "scene", "integr", "thr", "masses", "springs", "steps/s", "ns/mass", "ns/spring", "spr%", "col%", "int%", "pln%", "oth%", "E/mass", "awake");
+    
+    for (unsigned s = 0; s < NUMBER_OF_SCENES; s++) {
+        
+        if (any && !o.scenes[s]) continue;
+        
+        for (unsigned i = 0; i < o.number_of_integrators; i++) {
+            
+            const sm_integrator integrator = o.integrators[i];
+            
+            if (!o.three_d) {
+                
+                for (unsigned t = 0; t < o.number_of_threads; t++) run_benchmark(&o, s, integrator, o.threads[t]);
+                
+            } else if ((s == CLOTH || s == ROPE) && (integrator == SM_SEMI_IMPLICIT_EULER || integrator == SM_VELOCITY_VERLET)) {
+                
+                for (unsigned t = 0; t < o.number_of_threads; t++) run_benchmark3(&o, s, integrator, o.threads[t]);
+            }
+        }
+    }
+    
+    return 0;
+}
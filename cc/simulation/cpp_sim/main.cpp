@@ -8,15 +8,42 @@
 extern "C" {
 #include "space.h"
 }
+#include "vector.hpp"
 #include <iostream>
 
-int main(int argc, const char * argv[]) {
+constexpr dv::vec2 gravity(0, -9.8f);
 
-    sm_space *space = new_space(0, 0, 0);
+int main(int argc, const char * argv[]) {
+    
+    sm_space *space = new_space(1, 0, 0);
     
     std::cout << "Hello, C++ World " << space << std::endl;
     
-    step_space(space);
+    // Clears forces after each timestep, so gravity is added afresh every step
+    space->integrator = SM_SEMI_IMPLICIT_EULER;
+    
+    sm_mass *ball = new_pooled_mass(space->mass_pool, 1, 0.5f);
+    
+    add_mass_to_space(space, ball);
+    ball->pos = dv::vec2(0, 10);
+    
+    for (int step = 0; step < 60; step++) {
+        
+        for (unsigned i = 0; i < space->number_of_masses; i++) {
+            
+            sm_mass *mass = space->masses[i];
+            
+            mass->frc = dv::vec(mass->frc) + gravity * mass->mass;
+        }
+        
+        step_space(space);
+    }
+    
+    const dv::vec2 pos = ball->pos;
+    
+    std::cout << "Ball at " << pos.x << ", " << pos.y << " after one second" << std::endl;
+    
+    free_space(space);
     
     return 0;
 }
@@ -7,8 +7,139 @@
 //
 
 #include "body.h"
+#include "contact.h"
+#include "internal.h"
+
+#pragma mark Bodies
 
 sm_body *new_body(sm_space *space) {
     
-    return 0;
+    space->bodies = grow_array(space->bodies, &space->body_capacity, space->number_of_bodies + 1, sizeof(sm_body));
+    
+    sm_body *body = &space->bodies[space->number_of_bodies];
+    
+    memset(body, 0, sizeof(sm_body));
+    
+    body->rotation = MAT2_IDEN;
+    body->friction = 0.5;
+    body->index = space->number_of_bodies++;
+    
+    return body;
+}
+
+void add_mass_to_body(sm_space *space, sm_body *body, sm_mass *mass) {
+    
+    assert(mass->index < space->number_of_masses && space->masses[mass->index] == mass);
+    assert(!mass->body);
+    
+    space->body_members = grow_array(space->body_members, &space->body_member_capacity, space->number_of_body_members + 1, sizeof(sm_body_member));
+    space->body_members[space->number_of_body_members++] = (sm_body_member) { mass, body->index, { 0, 0 } };
+    
+    mass->body = body->index + 1;
+    space->bodies_dirty = 1;
+}
+
+// Each body's state from its masses as they are now. Masses count as points, so a body
+// of one mass does not turn.
+static void shape_bodies(sm_space *space) {
+    
+    for (sm_body *body = space->bodies; body < space->bodies + space->number_of_bodies; body++) {
+        
+        body->mass = body->inertia = body->angular_velocity = 0;
+        body->pos = body->vel = (vec2) { 0, 0 };
+    }
+    
+    for (const sm_body_member *member = space->body_members; member < space->body_members + space->number_of_body_members; member++) {
+        
+        sm_body         *body = &space->bodies[member->body];
+        const sm_mass   *mass = member->mass;
+        
+        body->mass += mass->mass;
+        body->pos = vec2Add(body->pos, vec2Multiply(mass->pos, mass->mass));
+        body->vel = vec2Add(body->vel, vec2Multiply(mass->vel, mass->mass));
+    }
+    
+    for (sm_body *body = space->bodies; body < space->bodies + space->number_of_bodies; body++) {
+        
+        body->inverse_mass = body->mass > 0 ? 1.0 / body->mass : 0;
+        body->pos = vec2Multiply(body->pos, body->inverse_mass);
+        body->vel = vec2Multiply(body->vel, body->inverse_mass);
+    }
+    
+    // Offsets in the body's frame, with the angular momentum about the centre for the spin
+    for (sm_body_member *member = space->body_members; member < space->body_members + space->number_of_body_members; member++) {
+        
+        sm_body         *body = &space->bodies[member->body];
+        const sm_mass   *mass = member->mass;
+        const vec2      r = vec2Subtract(mass->pos, body->pos);
+        
+        member->offset = mat2MultiplyVector(mat2Transpose(body->rotation), r);
+        body->inertia += mass->mass * vec2DotProduct(r, r);
+        body->angular_velocity += mass->mass * vec2Cross(r, vec2Subtract(mass->vel, body->vel));
+    }
+    
+    for (sm_body *body = space->bodies; body < space->bodies + space->number_of_bodies; body++) {
+        
+        body->inverse_inertia = body->inertia > 0 ? 1.0 / body->inertia : 0;
+        body->angular_velocity *= body->inverse_inertia;
+    }
+    
+    space->bodies_dirty = 0;
+}
+
+void begin_bodies(sm_space *space) {
+    
+    if (space->bodies_dirty) shape_bodies(space);
+}
+
+#pragma mark Step
+
+void step_bodies(sm_space *space, const float h) {
+    
+    // Forces on the masses, spring forces included, act on their bodies
+    for (sm_body *body = space->bodies; body < space->bodies + space->number_of_bodies; body++) {
+        
+        body->frc = (vec2) { 0, 0 };
+        body->torque = 0;
+    }
+    
+    for (const sm_body_member *member = space->body_members; member < space->body_members + space->number_of_body_members; member++) {
+        
+        sm_body     *body = &space->bodies[member->body];
+        const vec2  r = mat2MultiplyVector(body->rotation, member->offset);
+        
+        body->frc = vec2Add(body->frc, member->mass->frc);
+        body->torque += vec2Cross(r, member->mass->frc);
+    }
+    
+    // Semi implicit Euler with the space's friction, like the masses
+    for (sm_body *body = space->bodies; body < space->bodies + space->number_of_bodies; body++) {
+        
+        body->vel = vec2Add(body->vel, vec2Multiply(vec2Subtract(vec2Multiply(body->frc, body->inverse_mass), vec2Multiply(body->vel, space->friction)), h));
+        body->angular_velocity += (body->torque * body->inverse_inertia - body->angular_velocity * space->friction) * h;
+    }
+    
+    add_plane_constraints(space, 1);
+    solve_contact_constraints(space, h, 1);
+    
+    for (sm_body *body = space->bodies; body < space->bodies + space->number_of_bodies; body++) {
+        
+        body->pos = vec2Add(body->pos, vec2Multiply(body->vel, h));
+        body->angle += body->angular_velocity * h;
+        
+        const float c = cosf(body->angle), s = sinf(body->angle);
+        
+        body->rotation = MAT2(c, s, -s, c);
+    }
+    
+    // Carry the masses along, whatever their own integration did to them
+    for (const sm_body_member *member = space->body_members; member < space->body_members + space->number_of_body_members; member++) {
+        
+        const sm_body   *body = &space->bodies[member->body];
+        const vec2      r = mat2MultiplyVector(body->rotation, member->offset);
+        sm_mass         *mass = member->mass;
+        
+        mass->pos = vec2Add(body->pos, r);
+        mass->vel = vec2Add(body->vel, spin_velocity(body->angular_velocity, r));
+    }
 }
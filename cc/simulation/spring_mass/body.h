@@ -11,10 +11,52 @@
 
 #include "space.h"
 
-typedef struct {
+// A rigid body made of masses already in the space. Its masses keep their place in the broad
+// phase and their springs, and are carried along rigidly each step. Contacts of a body's masses
+// with other masses and planes are contact constraints, solved after the masses move whatever
+// the space's contact solver. Bodies move with the semi implicit Euler, Verlet and RK4
+// integrators. Stepping them with explicit Euler asserts, as does XPBD, whose springs move
+// positions rather than adding the forces a body gathers. Bodies do not sleep, and keep awake
+// the islands of the masses touching them or joined to them by springs.
+struct sm_body {
     
-} sm_body;
+    // Dynamic properties, at the centre of mass
+    vec2            pos;
+    vec2            vel;
+    float           angle;
+    float           angular_velocity;
+    mat2            rotation;
+    
+    // Physical properties, the mass and inertia found from its masses
+    float           mass;
+    float           inertia;
+    float           friction;
+    
+    // Computational properties
+    float           inverse_mass;
+    float           inverse_inertia;
+    vec2            frc;
+    float           torque;
+    unsigned        index;
+    
+};
 
+// A mass of a body, at offset from the centre of mass in the body's frame
+struct sm_body_member {
+    
+    sm_mass         *mass;
+    unsigned        body;
+    vec2            offset;
+    
+};
+
+// Body pointers are only good until the next body is added. Adding a mass to a body makes
+// the body's position, velocity and spin those of its masses together at the next step.
 sm_body *new_body(sm_space *space);
+void add_mass_to_body(sm_space *space, sm_body *body, sm_mass *mass);
+
+// Called by the space's step, before and after the masses move
+void begin_bodies(sm_space *space);
+void step_bodies(sm_space *space, const float h);
 
 #endif
@@ -0,0 +1,364 @@
+//
+//  contact.c
+//  spring_mass
+//
+//  Created by Richard Henry on 19/10/2026.
+//  Copyright 2026 Dogstar Diversions. http://www.dogstar.mobi
+//
+
+#include "contact.h"
+#include "body.h"
+#include "internal.h"
+
+// Overlap left for contacts to keep, and the fraction of the rest corrected each step
+#define CONTACT_SLOP 0.01f
+#define CONTACT_BAUMGARTE 0.2f
+
+// Slower approaches than this do not bounce, so resting contacts settle
+#define CONTACT_RESTITUTION_SPEED 1.0f
+
+#define PLANE_KEY_BIT (1ull << 31)
+
+#define IMPULSE_SORT_RUN 32
+
+#pragma mark Constraints
+
+static inline uint64_t contact_key(const sm_space *space, const sm_mass *mass1, const sm_mass *mass2) {
+    
+    // Slots rather than indices, which removals and sorting shuffle
+    const uint64_t slot1 = slot_handle(space->mass_slots, mass1->index).slot, slot2 = slot_handle(space->mass_slots, mass2->index).slot;
+    
+    return slot1 < slot2 ? slot1 << 32 | slot2 : slot2 << 32 | slot1;
+}
+
+static sm_contact_constraint *push_constraint(sm_space *space) {
+    
+    space->contact_constraints = grow_array(space->contact_constraints, &space->contact_constraint_capacity,
+                                            space->number_of_contact_constraints + 1, sizeof(sm_contact_constraint));
+    
+    sm_contact_constraint *contact = &space->contact_constraints[space->number_of_contact_constraints++];
+    
+    memset(contact, 0, sizeof(sm_contact_constraint));
+    
+    return contact;
+}
+
+// Sets one side of a contact touching at point, giving its friction
+static float set_side(const sm_space *space, sm_mass *mass, const vec2 point, unsigned *body_index, sm_mass **free_mass, vec2 *r) {
+    
+    if (!mass->body) {
+        
+        // Free masses slide past each other, as they do without the solver
+        *body_index = SM_NO_INDEX;
+        *free_mass = mass;
+        return 0;
+    }
+    
+    const sm_body *body = &space->bodies[mass->body - 1];
+    
+    *body_index = body->index;
+    *r = vec2Subtract(point, body->pos);
+    
+    return body->friction;
+}
+
+void add_contact_constraint(sm_space *space, sm_mass *mass1, sm_mass *mass2) {
+    
+    // A body goes first if there is one
+    if (!mass1->body) {
+        
+        sm_mass *swap = mass1;
+        
+        mass1 = mass2;
+        mass2 = swap;
+    }
+    
+    // Masses of one body never touch
+    if (mass1->body && mass1->body == mass2->body) return;
+    
+    const vec2  d = vec2Subtract(mass2->pos, mass1->pos);
+    const float distance = vec2Length(d);
+    
+    if (!distance) return;
+    
+    sm_contact_constraint *contact = push_constraint(space);
+    
+    contact->normal = vec2Multiply(d, 1.0 / distance);
+    contact->depth = mass1->radius + mass2->radius - distance;
+    
+    // Halfway through the overlap
+    const vec2  point = vec2Add(mass1->pos, vec2Multiply(contact->normal, mass1->radius - 0.5 * contact->depth));
+    const float friction1 = set_side(space, mass1, point, &contact->body1, &contact->mass1, &contact->r1);
+    const float friction2 = set_side(space, mass2, point, &contact->body2, &contact->mass2, &contact->r2);
+    
+    contact->friction = friction1 > friction2 ? friction1 : friction2;
+    contact->restitution = mass1->e > mass2->e ? mass1->e : mass2->e;
+    contact->key = contact_key(space, mass1, mass2);
+}
+
+static void add_plane_constraint(sm_space *space, const sm_body *body, sm_mass *mass, const vec2 r, const vec2 pos, const unsigned plane_index) {
+    
+    const sm_plane  *plane = space->planes[plane_index];
+    const float     distance = plane->d + vec2DotProduct(pos, plane->normal);
+    
+    if (!(distance < mass->radius)) return;
+    
+    sm_contact_constraint *contact = push_constraint(space);
+    
+    // From the mass into the plane, touching at the deepest point
+    contact->normal = vec2Multiply(plane->normal, -1);
+    contact->depth = mass->radius - distance;
+    contact->body2 = SM_NO_INDEX;
+    contact->restitution = mass->e;
+    contact->key = (uint64_t)slot_handle(space->mass_slots, mass->index).slot << 32 | PLANE_KEY_BIT | slot_handle(space->plane_slots, plane_index).slot;
+    
+    if (body) {
+        
+        contact->body1 = body->index;
+        contact->r1 = vec2Subtract(r, vec2Multiply(plane->normal, mass->radius));
+        contact->friction = body->friction;
+        
+    } else {
+        
+        contact->body1 = SM_NO_INDEX;
+        contact->mass1 = mass;
+    }
+}
+
+void add_plane_constraints(sm_space *space, const int bodies) {
+    
+    if (bodies) {
+        
+        for (const sm_body_member *member = space->body_members; member < space->body_members + space->number_of_body_members; member++) {
+            
+            const sm_body   *body = &space->bodies[member->body];
+            const vec2      r = mat2MultiplyVector(body->rotation, member->offset);
+            
+            for (unsigned j = 0; j < space->number_of_planes; j++) add_plane_constraint(space, body, member->mass, r, vec2Add(body->pos, r), j);
+        }
+        
+        return;
+    }
+    
+    for (unsigned m = 0; m < space->number_of_awake_masses; m++) {
+        
+        sm_mass *mass = space->masses[m];
+        
+        if (mass->body) continue;
+        
+        for (unsigned j = 0; j < space->number_of_planes; j++) add_plane_constraint(space, 0, mass, mass->pos, mass->pos, j);
+    }
+}
+
+#pragma mark Solver
+
+static inline vec2 side_velocity(const sm_space *space, const unsigned body_index, const sm_mass *mass, const vec2 r) {
+    
+    if (body_index != SM_NO_INDEX) {
+        
+        const sm_body *body = &space->bodies[body_index];
+        
+        return vec2Add(body->vel, spin_velocity(body->angular_velocity, r));
+    }
+    
+    return mass ? mass->vel : (vec2) { 0, 0 };
+}
+
+static inline void push_side(sm_space *space, const unsigned body_index, sm_mass *mass, const vec2 r, const vec2 impulse) {
+    
+    if (body_index != SM_NO_INDEX) {
+        
+        sm_body *body = &space->bodies[body_index];
+        
+        body->vel = vec2Add(body->vel, vec2Multiply(impulse, body->inverse_mass));
+        body->angular_velocity += body->inverse_inertia * vec2Cross(r, impulse);
+        
+    } else if (mass) {
+        
+        mass->vel = vec2Add(mass->vel, vec2Multiply(impulse, 1.0 / mass->mass));
+    }
+}
+
+static inline float side_inverse_mass(const sm_space *space, const unsigned body_index, const sm_mass *mass, const vec2 r, const vec2 direction) {
+    
+    if (body_index != SM_NO_INDEX) {
+        
+        const sm_body   *body = &space->bodies[body_index];
+        const float     rn = vec2Cross(r, direction);
+        
+        return body->inverse_mass + body->inverse_inertia * rn * rn;
+    }
+    
+    return mass ? 1.0 / mass->mass : 0;
+}
+
+// Velocity of the second side at the contact relative to the first
+static inline vec2 relative_velocity(const sm_space *space, const sm_contact_constraint *contact) {
+    
+    return vec2Subtract(side_velocity(space, contact->body2, contact->mass2, contact->r2), side_velocity(space, contact->body1, contact->mass1, contact->r1));
+}
+
+// Pushes the sides apart by impulse, taking it from the first and giving it to the second
+static inline void apply_impulse(sm_space *space, const sm_contact_constraint *contact, const vec2 impulse) {
+    
+    push_side(space, contact->body1, contact->mass1, contact->r1, vec2Multiply(impulse, -1));
+    push_side(space, contact->body2, contact->mass2, contact->r2, impulse);
+}
+
+// Inverse of the effective mass along a direction
+static inline float inverse_effective_mass(const sm_space *space, const sm_contact_constraint *contact, const vec2 direction) {
+    
+    return side_inverse_mass(space, contact->body1, contact->mass1, contact->r1, direction) +
+           side_inverse_mass(space, contact->body2, contact->mass2, contact->r2, direction);
+}
+
+// The constraints one call works through, those between free masses or those with a body
+static inline int in_group(const sm_contact_constraint *contact, const int bodies) {
+    
+    return (contact->body1 != SM_NO_INDEX) == bodies;
+}
+
+static int impulse_compare(const void *e1, const void *e2) {
+    
+    const uint64_t key1 = ((const sm_contact_impulse *)e1)->key, key2 = ((const sm_contact_impulse *)e2)->key;
+    
+    return (key1 > key2) - (key1 < key2);
+}
+
+static void prepare_constraints(sm_space *space, const float h, const int bodies) {
+    
+    sm_contact_constraint *end = space->contact_constraints + space->number_of_contact_constraints;
+    
+    for (sm_contact_constraint *contact = space->contact_constraints; contact < end; contact++) {
+        
+        if (!in_group(contact, bodies)) continue;
+        
+        const vec2  tangent = { -contact->normal.y, contact->normal.x };
+        const float k_normal = inverse_effective_mass(space, contact, contact->normal), k_tangent = inverse_effective_mass(space, contact, tangent);
+        const float approach = vec2DotProduct(relative_velocity(space, contact), contact->normal);
+        
+        contact->normal_mass = k_normal > 0 ? 1.0 / k_normal : 0;
+        contact->tangent_mass = k_tangent > 0 ? 1.0 / k_tangent : 0;
+        
+        // Push out most of the overlap, or bounce if that is faster. Explicit Euler has no
+        // step length, so its overlaps are only kept from growing.
+        contact->bias = contact->depth > CONTACT_SLOP && h > 0 ? CONTACT_BAUMGARTE / h * (contact->depth - CONTACT_SLOP) : 0;
+        
+        if (approach < -CONTACT_RESTITUTION_SPEED && -contact->restitution * approach > contact->bias) contact->bias = -contact->restitution * approach;
+    }
+    
+    // Warm start from where the same pair left off, once every approach has been measured
+    for (sm_contact_constraint *contact = space->contact_constraints; contact < end; contact++) {
+        
+        if (!in_group(contact, bodies)) continue;
+        
+        const sm_contact_impulse key = { contact->key, 0, 0 };
+        const sm_contact_impulse *last = space->number_of_contact_impulses ?
+            bsearch(&key, space->contact_impulses, space->number_of_contact_impulses, sizeof(sm_contact_impulse), impulse_compare) : 0;
+        
+        if (last) {
+            
+            const vec2 tangent = { -contact->normal.y, contact->normal.x };
+            
+            contact->normal_impulse = last->normal;
+            contact->tangent_impulse = last->tangent;
+            
+            apply_impulse(space, contact, vec2Add(vec2Multiply(contact->normal, last->normal), vec2Multiply(tangent, last->tangent)));
+        }
+    }
+}
+
+static void solve_constraints(sm_space *space, const int bodies) {
+    
+    sm_contact_constraint *end = space->contact_constraints + space->number_of_contact_constraints;
+    
+    for (sm_contact_constraint *contact = space->contact_constraints; contact < end; contact++) {
+        
+        if (!in_group(contact, bodies)) continue;
+        
+        const vec2 tangent = { -contact->normal.y, contact->normal.x };
+        
+        // Friction first, limited by the normal impulse so far
+        if (contact->friction > 0) {
+            
+            const float limit = contact->friction * contact->normal_impulse;
+            float       tangent_impulse = contact->tangent_impulse - contact->tangent_mass * vec2DotProduct(relative_velocity(space, contact), tangent);
+            
+            tangent_impulse = tangent_impulse < -limit ? -limit : tangent_impulse > limit ? limit : tangent_impulse;
+            apply_impulse(space, contact, vec2Multiply(tangent, tangent_impulse - contact->tangent_impulse));
+            contact->tangent_impulse = tangent_impulse;
+        }
+        
+        // Contacts only push, so the total normal impulse stays positive
+        float normal_impulse = contact->normal_impulse + contact->normal_mass * (contact->bias - vec2DotProduct(relative_velocity(space, contact), contact->normal));
+        
+        if (normal_impulse < 0) normal_impulse = 0;
+        
+        apply_impulse(space, contact, vec2Multiply(contact->normal, normal_impulse - contact->normal_impulse));
+        contact->normal_impulse = normal_impulse;
+    }
+}
+
+void solve_contact_constraints(sm_space *space, const float h, const int bodies) {
+    
+    prepare_constraints(space, h, bodies);
+    
+    for (unsigned i = 0; i < space->contact_iterations; i++) solve_constraints(space, bodies);
+}
+
+// Sorts by key like sort_sweep_order, insertion sorting short runs and merging them through
+// scratch, which needs room for as many impulses
+static void sort_contact_impulses(sm_contact_impulse *impulses, sm_contact_impulse *scratch, const unsigned n) {
+    
+    for (unsigned lo = 0; lo < n; lo += IMPULSE_SORT_RUN) {
+        
+        const unsigned hi = lo + IMPULSE_SORT_RUN < n ? lo + IMPULSE_SORT_RUN : n;
+        
+        for (unsigned i = lo + 1; i < hi; i++) {
+            
+            const sm_contact_impulse    impulse = impulses[i];
+            unsigned                    j = i;
+            
+            for (; j > lo && impulses[j - 1].key > impulse.key; j--) impulses[j] = impulses[j - 1];
+            
+            impulses[j] = impulse;
+        }
+    }
+    
+    for (unsigned width = IMPULSE_SORT_RUN; width < n; width *= 2) {
+        
+        for (unsigned lo = 0; lo + width < n; lo += width * 2) {
+            
+            const unsigned mid = lo + width, hi = mid + width < n ? mid + width : n;
+            
+            if (!(impulses[mid - 1].key > impulses[mid].key)) continue;
+            
+            unsigned l = 0, r = mid, o = lo;
+            
+            memcpy(scratch, &impulses[lo], width * sizeof(sm_contact_impulse));
+            
+            while (l < width && r < hi)
+                impulses[o++] = impulses[r].key < scratch[l].key ? impulses[r++] : scratch[l++];
+            
+            while (l < width) impulses[o++] = scratch[l++];
+        }
+    }
+}
+
+void keep_contact_impulses(sm_space *space) {
+    
+    const unsigned n = space->number_of_contact_constraints;
+    
+    space->contact_impulses = grow_array(space->contact_impulses, &space->contact_impulse_capacity, n, sizeof(sm_contact_impulse));
+    space->contact_impulse_scratch = grow_array(space->contact_impulse_scratch, &space->contact_impulse_scratch_capacity, n, sizeof(sm_contact_impulse));
+    
+    for (unsigned c = 0; c < n; c++) {
+        
+        const sm_contact_constraint *contact = &space->contact_constraints[c];
+        
+        space->contact_impulses[c] = (sm_contact_impulse) { contact->key, contact->normal_impulse, contact->tangent_impulse };
+    }
+    
+    sort_contact_impulses(space->contact_impulses, space->contact_impulse_scratch, n);
+    space->number_of_contact_impulses = n;
+}
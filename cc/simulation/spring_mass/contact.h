@@ -0,0 +1,54 @@
+//
+//  contact.h
+//  spring_mass
+//
+//  Created by Richard Henry on 19/10/2026.
+//  Copyright 2026 Dogstar Diversions. http://www.dogstar.mobi
+//
+
+#ifndef SM_CONTACT_H
+#define SM_CONTACT_H
+
+#include "space.h"
+#include <stdint.h>
+
+// A contact solved by sequential impulses. The first side is a body or a free mass, the second
+// a body, a free mass, or a plane when it has neither. Bodies go first, so a contact with no
+// first body is between two free masses.
+struct sm_contact_constraint {
+    
+    unsigned        body1, body2;
+    sm_mass         *mass1, *mass2;
+    vec2            normal;
+    vec2            r1, r2;
+    float           depth;
+    float           friction;
+    float           restitution;
+    float           normal_mass, tangent_mass;
+    float           bias;
+    float           normal_impulse, tangent_impulse;
+    uint64_t        key;
+    
+};
+
+// Impulses a contact ended the last step with, by key
+struct sm_contact_impulse {
+    
+    uint64_t        key;
+    float           normal, tangent;
+    
+};
+
+static inline float vec2Cross(const vec2 a, const vec2 b) { return a.x * b.y - a.y * b.x; }
+
+// w x r for a spin w about the z axis
+static inline vec2 spin_velocity(const float w, const vec2 r) { return (vec2) { -w * r.y, w * r.x }; }
+
+// Called by the space's step. Constraints are gathered through the step and solved in two
+// groups, those of free masses and those of bodies, then kept for warm starting.
+void add_contact_constraint(sm_space *space, sm_mass *mass1, sm_mass *mass2);
+void add_plane_constraints(sm_space *space, const int bodies);
+void solve_contact_constraints(sm_space *space, const float h, const int bodies);
+void keep_contact_impulses(sm_space *space);
+
+#endif
@@ -0,0 +1,88 @@
+//
+//  internal.h
+//  spring_mass
+//
+//  Created by Richard Henry on 19/10/2026.
+//  Copyright 2026 Dogstar Diversions. http://www.dogstar.mobi
+//
+
+#ifndef SM_INTERNAL_H
+#define SM_INTERNAL_H
+
+#include "space.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+// Helpers shared by sm_space, sm_space3 and the modules around them, not part of the interface
+
+#define SM_CAPACITY_CHUNK 64
+
+#pragma mark Capacity
+
+static inline void *resize_array(void *array, const unsigned count, const size_t size) {
+    
+    void *resized = realloc(array, count * size);
+    assert(resized || !count);
+    
+    return resized;
+}
+
+// Resizes an array from count to capacity items, keeping any new part zeroed
+static inline void *resize_array_zeroed(void *array, const unsigned count, const unsigned capacity, const size_t size) {
+    
+    char *resized = resize_array(array, capacity, size);
+    
+    if (capacity > count) memset(resized + count * size, 0, (capacity - count) * size);
+    
+    return resized;
+}
+
+static inline unsigned grown_capacity(const unsigned capacity, const unsigned needed) {
+    
+    // Grow in whole chunks, doubling so that adding one at a time stays amortised O(1)
+    unsigned grown = capacity > SM_CAPACITY_CHUNK ? capacity : SM_CAPACITY_CHUNK;
+    
+    while (grown < needed) grown *= 2;
+    
+    return grown;
+}
+
+// Makes room for needed items, growing the capacity as above
+static inline void *grow_array(void *array, unsigned *capacity, const unsigned needed, const size_t size) {
+    
+    if (needed <= *capacity) return array;
+    
+    *capacity = grown_capacity(*capacity, needed);
+    
+    return resize_array(array, *capacity, size);
+}
+
+#pragma mark Profiling
+
+// Seconds on a monotonic clock, only read while profiling
+static inline double phase_clock(const int profile) {
+    
+    if (!profile) return 0.0;
+    
+    struct timespec now;
+    
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// Charges the time since start to a phase, returning the start of the next
+static inline double end_phase(double *phase_times, const int profile, const sm_phase phase, const double start) {
+    
+    if (!profile) return 0.0;
+    
+    const double now = phase_clock(profile);
+    
+    phase_times[phase] += now - start;
+    
+    return now;
+}
+
+#endif
@@ -20,3 +20,25 @@ sm_mass *new_mass(const float m, const float r) {
     
     return mass;
 }
+
+void free_mass(sm_mass * const mass) {
+
+    free(mass);
+}
+
+sm_mass *new_pooled_mass(sm_pool *pool, const float m, const float r) {
+
+    assert(pool->object_size >= sizeof(sm_mass));
+
+    sm_mass *mass = take_from_pool(pool);
+    
+    mass->mass = m;
+    mass->radius = r;
+    
+    return mass;
+}
+
+void free_pooled_mass(sm_pool *pool, sm_mass * const mass) {
+
+    return_to_pool(pool, mass);
+}
@@ -10,6 +10,7 @@
 #define SM_MASS_H
 
 #include "vector.h"
+#include "pool.h"
 
 typedef struct {
     
@@ -18,6 +19,11 @@ typedef struct {
     vec2            vel;
     vec2            acc;
     vec2            frc;
+    vec2            prev;
+    
+    // Rounding carried to the next step by a mixed precision space
+    vec2            pos_error;
+    vec2            vel_error;
     
     // Physical properties
     float           e;
@@ -27,11 +33,21 @@ typedef struct {
     // Computational properties
     unsigned short  collision_type;
     unsigned short  collision_mask;
+    unsigned        index;
+    unsigned        number_of_springs;
+    
+    // One more than the index of the body the mass is part of, zero for a free mass
+    unsigned        body;
     
     void            *user_data;
     
 } sm_mass;
 
 sm_mass *new_mass(const float m, const float r);
+void free_mass(sm_mass * const mass);
+
+// From a pool made for masses, such as the one each space owns
+sm_mass *new_pooled_mass(sm_pool *pool, const float m, const float r);
+void free_pooled_mass(sm_pool *pool, sm_mass * const mass);
 
 #endif
@@ -14,9 +14,33 @@ sm_plane *new_plane(const vec2 n, const float d) {
 
     sm_plane *plane = calloc(1, sizeof(sm_plane));
     assert(plane);
+    assert(plane_normal_is_unit(n));
     
     plane->normal = n;
     plane->d = d;
     
     return plane;
 }
+
+void free_plane(sm_plane * const plane) {
+
+    free(plane);
+}
+
+sm_plane *new_pooled_plane(sm_pool *pool, const vec2 n, const float d) {
+
+    assert(pool->object_size >= sizeof(sm_plane));
+    assert(plane_normal_is_unit(n));
+
+    sm_plane *plane = take_from_pool(pool);
+    
+    plane->normal = n;
+    plane->d = d;
+    
+    return plane;
+}
+
+void free_pooled_plane(sm_pool *pool, sm_plane * const plane) {
+
+    return_to_pool(pool, plane);
+}
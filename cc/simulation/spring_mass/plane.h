@@ -10,14 +10,27 @@
 #define SM_PLANE_H
 
 #include "vector.h"
+#include "pool.h"
 
 typedef struct {
     
     vec2            normal;
     float           d;
     
+    // Computational properties
+    unsigned        index;
+    
 } sm_plane;
 
+// Normals are unit length, which the plane pass's block cull relies on. A mass touches the
+// plane when d + pos.n < radius.
+static inline int plane_normal_is_unit(const vec2 n) { return fabsf(n.x * n.x + n.y * n.y - 1.0f) < 1e-4f; }
+
 sm_plane *new_plane(const vec2 n, const float d);
+void free_plane(sm_plane * const plane);
+
+// From a pool made for planes, such as the one each space owns
+sm_plane *new_pooled_plane(sm_pool *pool, const vec2 n, const float d);
+void free_pooled_plane(sm_pool *pool, sm_plane * const plane);
 
 #endif
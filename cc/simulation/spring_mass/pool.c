@@ -0,0 +1,112 @@
+//
+//  pool.c
+//  spring_mass
+//
+//  Created by Richard Henry on 19/10/2026.
+//  Copyright 2026 Dogstar Diversions. http://www.dogstar.mobi
+//
+
+#include "pool.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define POOL_ALIGNMENT 16
+
+static void add_chunk(sm_pool *pool);
+
+#pragma mark Pool management
+
+sm_pool *new_pool(const size_t object_size, const unsigned objects_per_chunk) {
+    
+    assert(object_size && objects_per_chunk);
+    
+    sm_pool *pool = calloc(1, sizeof(sm_pool));
+    assert(pool);
+    
+    // Room for the free list link, and aligned for vector loads
+    pool->object_size = object_size < sizeof(void *) ? sizeof(void *) : object_size;
+    pool->object_size = (pool->object_size + POOL_ALIGNMENT - 1) & ~(size_t)(POOL_ALIGNMENT - 1);
+    pool->objects_per_chunk = objects_per_chunk;
+    
+    return pool;
+}
+
+void free_pool(sm_pool * const pool) {
+    
+    for (unsigned c = 0; c < pool->number_of_chunks; c++) free(pool->chunks[c]);
+    
+    free(pool->chunks);
+    free(pool);
+}
+
+static void add_chunk(sm_pool *pool) {
+    
+    if (pool->number_of_chunks == pool->chunk_capacity) {
+        
+        pool->chunk_capacity = pool->chunk_capacity ? pool->chunk_capacity * 2 : 8;
+        pool->chunks = realloc(pool->chunks, pool->chunk_capacity * sizeof(char *));
+        assert(pool->chunks);
+    }
+    
+    pool->chunks[pool->number_of_chunks] = malloc(pool->object_size * pool->objects_per_chunk);
+    assert(pool->chunks[pool->number_of_chunks]);
+    
+    pool->number_of_chunks++;
+}
+
+void reserve_pool(sm_pool *pool, const unsigned number_of_objects) {
+    
+    while ((unsigned long long)pool->number_of_chunks * pool->objects_per_chunk < number_of_objects) add_chunk(pool);
+}
+
+void reset_pool(sm_pool *pool) {
+    
+    pool->chunk = 0;
+    pool->used = 0;
+    pool->free_list = 0;
+    pool->number_of_objects = 0;
+}
+
+size_t pool_bytes(const sm_pool *pool) {
+    
+    return sizeof(sm_pool) + pool->chunk_capacity * sizeof(char *) + pool->number_of_chunks * pool->object_size * pool->objects_per_chunk;
+}
+
+#pragma mark Objects
+
+void *take_from_pool(sm_pool *pool) {
+    
+    void *object = pool->free_list;
+    
+    if (object) {
+        
+        // Reuse the most recently freed object, it is likely still in cache
+        memcpy(&pool->free_list, object, sizeof(void *));
+        
+    } else {
+        
+        if (pool->chunk < pool->number_of_chunks && pool->used == pool->objects_per_chunk) {
+            
+            pool->chunk++;
+            pool->used = 0;
+        }
+        
+        if (pool->chunk == pool->number_of_chunks) add_chunk(pool);
+        
+        object = pool->chunks[pool->chunk] + pool->used++ * pool->object_size;
+    }
+    
+    pool->number_of_objects++;
+    
+    return memset(object, 0, pool->object_size);
+}
+
+void return_to_pool(sm_pool *pool, void *object) {
+    
+    assert(pool->number_of_objects > 0);
+    
+    memcpy(object, &pool->free_list, sizeof(void *));
+    pool->free_list = object;
+    pool->number_of_objects--;
+}
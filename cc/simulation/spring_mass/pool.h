@@ -0,0 +1,47 @@
+//
+//  pool.h
+//  spring_mass
+//
+//  Created by Richard Henry on 19/10/2026.
+//  Copyright 2026 Dogstar Diversions. http://www.dogstar.mobi
+//
+
+#ifndef SM_POOL_H
+#define SM_POOL_H
+
+#include <stddef.h>
+
+// Fixed size objects handed out back to back from large chunks. Freed objects
+// are reused before fresh ones, and chunks are only returned by free_pool.
+typedef struct {
+    
+    size_t          object_size;
+    unsigned        objects_per_chunk;
+    
+    char            **chunks;
+    unsigned        number_of_chunks;
+    unsigned        chunk_capacity;
+    
+    // Next fresh object is at chunks[chunk] + used * object_size
+    unsigned        chunk;
+    unsigned        used;
+    
+    void            *free_list;
+    unsigned        number_of_objects;
+    
+} sm_pool;
+
+sm_pool *new_pool(const size_t object_size, const unsigned objects_per_chunk);
+void free_pool(sm_pool * const pool);
+
+// Objects come back zeroed
+void *take_from_pool(sm_pool *pool);
+void return_to_pool(sm_pool *pool, void *object);
+
+// Forget every object at once, keeping the chunks for the next scene
+void reset_pool(sm_pool *pool);
+void reserve_pool(sm_pool *pool, const unsigned number_of_objects);
+
+size_t pool_bytes(const sm_pool *pool);
+
+#endif
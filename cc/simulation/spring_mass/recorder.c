@@ -0,0 +1,485 @@
+//
+//  recorder.c
+//  spring_mass
+//
+//  Created by Richard Henry on 19/10/2026.
+//  Copyright 2026 Dogstar Diversions. http://www.dogstar.mobi
+//
+
+#include "recorder.h"
+#include "internal.h"
+#include <math.h>
+#include <limits.h>
+
+typedef struct {
+    
+    unsigned            magic;
+    unsigned            version;
+    float               position_scale, velocity_scale;
+    unsigned            keyframe_interval;
+    
+} recording_header;
+
+enum { KEYFRAME, DELTA_FRAME };
+
+typedef struct {
+    
+    unsigned            frame;
+    unsigned            type;
+    unsigned            number_of_slots;
+    unsigned            bytes;
+    
+} frame_header;
+
+// Written after the keyframe index, so a reader finds the index from the end of the file
+typedef struct {
+    
+    unsigned long long  index_offset;
+    unsigned            number_of_keyframes;
+    unsigned            number_of_frames;
+    unsigned            magic;
+    unsigned            padding;
+    
+} recording_trailer;
+
+// Positions x and y then velocities x and y, each a whole array over the slots
+#define QUANTITIES 4
+
+// A zigzag varint of a 32 bit difference takes at most five bytes
+#define MAX_VARINT_BYTES 5
+
+static void *writer_main(void *arg);
+
+static inline int quantize(const float value, const float inverse_scale) {
+    
+    const float scaled = value * inverse_scale;
+    
+    // Rounds half away from zero. Out of range values saturate, NaN reads back as zero.
+    if (scaled >= (float)INT_MAX) return INT_MAX;
+    if (scaled <= (float)INT_MIN) return INT_MIN;
+    if (scaled != scaled) return 0;
+    
+    return (int)(scaled + copysignf(0.5f, scaled));
+}
+
+#pragma mark Encoding
+
+static inline unsigned char *put_varint(unsigned char *cursor, const int value, const int previous) {
+    
+    // Wrapping differences decode exactly whatever the two values are
+    const unsigned difference = (unsigned)value - (unsigned)previous;
+    unsigned zigzag = (difference << 1) ^ (0u - (difference >> 31));
+    
+    while (zigzag >= 0x80) {
+        
+        *cursor++ = (unsigned char)(zigzag | 0x80);
+        zigzag >>= 7;
+    }
+    
+    *cursor++ = (unsigned char)zigzag;
+    
+    return cursor;
+}
+
+static inline const unsigned char *get_varint(const unsigned char *cursor, const unsigned char *end, int *value) {
+    
+    unsigned zigzag = 0;
+    
+    for (unsigned shift = 0; cursor < end && shift < 35; shift += 7) {
+        
+        const unsigned char byte = *cursor++;
+        
+        zigzag |= (unsigned)(byte & 0x7f) << shift;
+        
+        if (!(byte & 0x80)) {
+            
+            *value = (int)((unsigned)*value + ((zigzag >> 1) ^ (0u - (zigzag & 1))));
+            return cursor;
+        }
+    }
+    
+    return 0;
+}
+
+static void reserve_buffer(sm_record_buffer *buffer, const size_t size) {
+    
+    if (size <= buffer->capacity) return;
+    
+    size_t capacity = buffer->capacity ? buffer->capacity : SM_RECORDER_FLUSH_BYTES;
+    
+    while (capacity < size) capacity *= 2;
+    
+    buffer->data = realloc(buffer->data, capacity);
+    assert(buffer->data);
+    
+    buffer->capacity = capacity;
+}
+
+#pragma mark Recorder management
+
+sm_recorder *new_recorder(const char *path, const float position_scale, const float velocity_scale, const unsigned keyframe_interval) {
+    
+    assert(position_scale > 0.0 && velocity_scale > 0.0 && keyframe_interval > 0);
+    
+    FILE *file = fopen(path, "wb");
+    
+    if (!file) return 0;
+    
+    const recording_header header = { SM_RECORDING_MAGIC, SM_RECORDING_VERSION, position_scale, velocity_scale, keyframe_interval };
+    
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        
+        fclose(file);
+        return 0;
+    }
+    
+    sm_recorder *recorder = calloc(1, sizeof(sm_recorder));
+    assert(recorder);
+    
+    recorder->file = file;
+    recorder->position_scale = position_scale;
+    recorder->velocity_scale = velocity_scale;
+    recorder->keyframe_interval = keyframe_interval;
+    recorder->offset = sizeof(header);
+    
+    pthread_mutex_init(&recorder->lock, 0);
+    pthread_cond_init(&recorder->work_ready, 0);
+    pthread_cond_init(&recorder->work_done, 0);
+    
+    int error = pthread_create(&recorder->thread, 0, writer_main, recorder);
+    assert(!error);
+    (void)error;
+    
+    return recorder;
+}
+
+void free_recorder(sm_recorder * const recorder) {
+    
+    // Let the writer finish the buffer it has, then hand it the last one and stop it
+    pthread_mutex_lock(&recorder->lock);
+    
+    while (recorder->pending) pthread_cond_wait(&recorder->work_done, &recorder->lock);
+    
+    recorder->front ^= 1;
+    recorder->pending = 1;
+    recorder->quit = 1;
+    pthread_cond_signal(&recorder->work_ready);
+    pthread_mutex_unlock(&recorder->lock);
+    
+    pthread_join(recorder->thread, 0);
+    
+    const recording_trailer trailer = { recorder->offset, recorder->number_of_keyframes, recorder->frames_written, SM_RECORDING_MAGIC, 0 };
+    
+    if (fwrite(recorder->keyframes, sizeof(sm_keyframe), recorder->number_of_keyframes, recorder->file) != recorder->number_of_keyframes ||
+        fwrite(&trailer, sizeof(trailer), 1, recorder->file) != 1) recorder->failed = 1;
+    
+    if (fclose(recorder->file)) recorder->failed = 1;
+    
+    pthread_cond_destroy(&recorder->work_done);
+    pthread_cond_destroy(&recorder->work_ready);
+    pthread_mutex_destroy(&recorder->lock);
+    
+    free(recorder->buffers[0].data);
+    free(recorder->buffers[1].data);
+    free(recorder->encoded.data);
+    free(recorder->keyframes);
+    free(recorder->quantized);
+    free(recorder);
+}
+
+#pragma mark Recording
+
+void record_space(sm_recorder *recorder, const sm_space * const space) {
+    
+    const sm_slots  *slots = space->mass_slots;
+    const unsigned  n = slots->number_of_slots;
+    
+    // Only this thread changes which buffer is in front
+    sm_record_buffer *buffer = &recorder->buffers[recorder->front];
+    
+    reserve_buffer(buffer, buffer->size + sizeof(unsigned) + (size_t)QUANTITIES * n * sizeof(float));
+    
+    // The slot count, then the raw values a quantity at a time, left for the writer to encode
+    unsigned char   *start = buffer->data + buffer->size;
+    float           *values = (float *)(start + sizeof(unsigned));
+    
+    memcpy(start, &n, sizeof(unsigned));
+    
+    for (unsigned s = 0; s < n; s++) {
+        
+        const unsigned index = slots->entries[s];
+        
+        // A dead slot's entry is a free list link, which its owner check rejects
+        if (index < space->number_of_masses && slots->owners[index] == s) {
+            
+            const sm_mass *mass = space->masses[index];
+            
+            values[s] = mass->pos.x;
+            values[n + s] = mass->pos.y;
+            values[2 * n + s] = mass->vel.x;
+            values[3 * n + s] = mass->vel.y;
+            
+        } else values[s] = values[n + s] = values[2 * n + s] = values[3 * n + s] = 0.0;
+    }
+    
+    buffer->size += sizeof(unsigned) + (size_t)QUANTITIES * n * sizeof(float);
+    recorder->number_of_frames++;
+    
+    // Hand the buffer over only if the writer is free, never wait for it
+    if (buffer->size >= SM_RECORDER_FLUSH_BYTES) {
+        
+        pthread_mutex_lock(&recorder->lock);
+        
+        if (!recorder->pending) {
+            
+            recorder->front ^= 1;
+            recorder->pending = 1;
+            pthread_cond_signal(&recorder->work_ready);
+        }
+        
+        pthread_mutex_unlock(&recorder->lock);
+    }
+}
+
+// Encodes one raw frame onto the end of the encoded buffer, returning the raw bytes used
+static size_t encode_frame(sm_recorder *recorder, const unsigned char *raw) {
+    
+    unsigned n;
+    
+    memcpy(&n, raw, sizeof(unsigned));
+    
+    const float *values = (const float *)(raw + sizeof(unsigned));
+    const float inverse_position = 1.0f / recorder->position_scale, inverse_velocity = 1.0f / recorder->velocity_scale;
+    const size_t count = (size_t)QUANTITIES * n;
+    
+    // A change in slot count starts a keyframe, as there is nothing to take differences from
+    const int key = recorder->frames_written % recorder->keyframe_interval == 0 || n != recorder->number_of_slots;
+    
+    recorder->quantized = grow_array(recorder->quantized, &recorder->slot_capacity, n * QUANTITIES * 2, sizeof(int));
+    
+    int *previous = recorder->quantized, *current = key ? previous : previous + count;
+    
+    for (size_t i = 0; i < count; i++) current[i] = quantize(values[i], i < 2 * (size_t)n ? inverse_position : inverse_velocity);
+    
+    sm_record_buffer *encoded = &recorder->encoded;
+    
+    reserve_buffer(encoded, encoded->size + sizeof(frame_header) + count * MAX_VARINT_BYTES);
+    
+    frame_header    header = { recorder->frames_written, key ? KEYFRAME : DELTA_FRAME, n, 0 };
+    unsigned char   *cursor = encoded->data + encoded->size + sizeof(frame_header);
+    
+    if (key) {
+        
+        memcpy(cursor, current, count * sizeof(int));
+        cursor += count * sizeof(int);
+        
+        recorder->keyframes = grow_array(recorder->keyframes, &recorder->keyframe_capacity, recorder->number_of_keyframes + 1, sizeof(sm_keyframe));
+        recorder->keyframes[recorder->number_of_keyframes++] = (sm_keyframe) { recorder->offset, recorder->frames_written, n };
+        recorder->number_of_slots = n;
+        
+    } else {
+        
+        for (size_t i = 0; i < count; i++) cursor = put_varint(cursor, current[i], previous[i]);
+        
+        memcpy(previous, current, count * sizeof(int));
+    }
+    
+    header.bytes = (unsigned)(cursor - (encoded->data + encoded->size + sizeof(frame_header)));
+    memcpy(encoded->data + encoded->size, &header, sizeof(header));
+    
+    encoded->size += sizeof(frame_header) + header.bytes;
+    recorder->offset += sizeof(frame_header) + header.bytes;
+    recorder->frames_written++;
+    
+    return sizeof(unsigned) + count * sizeof(float);
+}
+
+static void *writer_main(void *arg) {
+    
+    sm_recorder *recorder = arg;
+    
+    pthread_mutex_lock(&recorder->lock);
+    
+    for (;;) {
+        
+        while (!recorder->pending && !recorder->quit) pthread_cond_wait(&recorder->work_ready, &recorder->lock);
+        
+        if (!recorder->pending) break;
+        
+        // The stepping thread leaves this buffer alone until pending is cleared
+        sm_record_buffer *buffer = &recorder->buffers[recorder->front ^ 1];
+        
+        pthread_mutex_unlock(&recorder->lock);
+        
+        for (size_t used = 0; used < buffer->size; ) used += encode_frame(recorder, buffer->data + used);
+        
+        const size_t size = recorder->encoded.size;
+        
+        if (size && fwrite(recorder->encoded.data, 1, size, recorder->file) != size) recorder->failed = 1;
+        
+        recorder->encoded.size = 0;
+        buffer->size = 0;
+        
+        pthread_mutex_lock(&recorder->lock);
+        recorder->pending = 0;
+        pthread_cond_signal(&recorder->work_done);
+        
+        if (recorder->quit) break;
+    }
+    
+    pthread_mutex_unlock(&recorder->lock);
+    
+    return 0;
+}
+
+#pragma mark Playback
+
+sm_recording *open_recording(const char *path) {
+    
+    FILE *file = fopen(path, "rb");
+    
+    if (!file) return 0;
+    
+    recording_header    header;
+    recording_trailer   trailer;
+    sm_recording        *recording = 0;
+    long                size = -1;
+    
+    if (fread(&header, sizeof(header), 1, file) == 1 && header.magic == SM_RECORDING_MAGIC && header.version == SM_RECORDING_VERSION &&
+        !fseek(file, 0, SEEK_END) && (size = ftell(file)) >= (long)(sizeof(header) + sizeof(trailer)) &&
+        !fseek(file, size - (long)sizeof(trailer), SEEK_SET) && fread(&trailer, sizeof(trailer), 1, file) == 1 &&
+        trailer.magic == SM_RECORDING_MAGIC && trailer.index_offset + (unsigned long long)trailer.number_of_keyframes * sizeof(sm_keyframe) + sizeof(trailer) == (unsigned long long)size) {
+        
+        recording = calloc(1, sizeof(sm_recording));
+        assert(recording);
+        
+        recording->file = file;
+        recording->position_scale = header.position_scale;
+        recording->velocity_scale = header.velocity_scale;
+        recording->number_of_frames = trailer.number_of_frames;
+        recording->number_of_keyframes = trailer.number_of_keyframes;
+        recording->frame = SM_NO_INDEX;
+        
+        recording->keyframes = malloc((trailer.number_of_keyframes ? trailer.number_of_keyframes : 1) * sizeof(sm_keyframe));
+        assert(recording->keyframes);
+        
+        if (fseek(file, (long)trailer.index_offset, SEEK_SET) ||
+            fread(recording->keyframes, sizeof(sm_keyframe), trailer.number_of_keyframes, file) != trailer.number_of_keyframes) {
+            
+            close_recording(recording);
+            return 0;
+        }
+    }
+    
+    if (!recording) fclose(file);
+    
+    return recording;
+}
+
+void close_recording(sm_recording * const recording) {
+    
+    fclose(recording->file);
+    
+    free(recording->payload);
+    free(recording->velocities);
+    free(recording->positions);
+    free(recording->quantized);
+    free(recording->keyframes);
+    free(recording);
+}
+
+// Reads the frame at the file position, which must follow the current frame unless it is a keyframe
+static int read_frame(sm_recording *recording) {
+    
+    frame_header header;
+    
+    if (fread(&header, sizeof(header), 1, recording->file) != 1) return 0;
+    // Differences only make sense on top of the frame before
+    if (header.type != KEYFRAME && (header.type != DELTA_FRAME || header.frame != recording->frame + 1 || header.number_of_slots != recording->number_of_slots)) return 0;
+    
+    const unsigned n = header.number_of_slots;
+    
+    if (header.bytes > recording->payload_capacity) {
+        
+        recording->payload = realloc(recording->payload, header.bytes);
+        assert(recording->payload);
+        
+        recording->payload_capacity = header.bytes;
+    }
+    
+    if (fread(recording->payload, 1, header.bytes, recording->file) != header.bytes) return 0;
+    
+    if (n > recording->slot_capacity) {
+        
+        recording->quantized = realloc(recording->quantized, (size_t)n * QUANTITIES * sizeof(int));
+        recording->positions = realloc(recording->positions, n * sizeof(vec2));
+        recording->velocities = realloc(recording->velocities, n * sizeof(vec2));
+        assert(recording->quantized && recording->positions && recording->velocities);
+        
+        recording->slot_capacity = n;
+    }
+    
+    int *quantized = recording->quantized;
+    
+    if (header.type == KEYFRAME) {
+        
+        if (header.bytes != (size_t)QUANTITIES * n * sizeof(int)) return 0;
+        
+        memcpy(quantized, recording->payload, header.bytes);
+        
+    } else {
+        
+        const unsigned char *cursor = recording->payload, *end = recording->payload + header.bytes;
+        
+        for (unsigned i = 0; i < n * QUANTITIES && cursor; i++) cursor = get_varint(cursor, end, &quantized[i]);
+        
+        if (!cursor) return 0;
+    }
+    
+    for (unsigned s = 0; s < n; s++) {
+        
+        recording->positions[s] = (vec2) {{ quantized[s] * recording->position_scale, quantized[n + s] * recording->position_scale }};
+        recording->velocities[s] = (vec2) {{ quantized[2 * n + s] * recording->velocity_scale, quantized[3 * n + s] * recording->velocity_scale }};
+    }
+    
+    recording->number_of_slots = n;
+    recording->frame = header.frame;
+    
+    return 1;
+}
+
+int seek_recording(sm_recording *recording, const unsigned frame) {
+    
+    if (frame >= recording->number_of_frames || !recording->number_of_keyframes) return 0;
+    
+    // Last keyframe at or before the frame
+    unsigned low = 0, high = recording->number_of_keyframes;
+    
+    while (high - low > 1) {
+        
+        const unsigned middle = (low + high) / 2;
+        
+        if (recording->keyframes[middle].frame <= frame) low = middle; else high = middle;
+    }
+    
+    const sm_keyframe *keyframe = &recording->keyframes[low];
+    
+    // Carry on from the current frame when the keyframe is no nearer
+    if (recording->frame == SM_NO_INDEX || recording->frame > frame || recording->frame < keyframe->frame) {
+        
+        if (fseek(recording->file, (long)keyframe->offset, SEEK_SET)) return 0;
+        
+        recording->frame = SM_NO_INDEX;
+    }
+    
+    while (recording->frame != frame) {
+        
+        if (!read_frame(recording)) {
+            
+            recording->frame = SM_NO_INDEX;
+            return 0;
+        }
+    }
+    
+    return 1;
+}
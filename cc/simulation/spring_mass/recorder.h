@@ -0,0 +1,123 @@
+//
+//  recorder.h
+//  spring_mass
+//
+//  Created by Richard Henry on 19/10/2026.
+//  Copyright 2026 Dogstar Diversions. http://www.dogstar.mobi
+//
+
+#ifndef SM_RECORDER_H
+#define SM_RECORDER_H
+
+#include "space.h"
+#include <stdio.h>
+#include <pthread.h>
+
+// Recordings hold one frame per step, each position and velocity rounded to a multiple of
+// its scale. Keyframes store the rounded values whole, the frames between them store the
+// difference from the frame before as zigzag varints. An index of keyframes at the end of
+// the file lets a reader start decoding near any frame.
+//
+// Frames hold one entry per mass slot rather than per mass index, so a mass keeps its place
+// however the space reorders its masses. Slots with no mass read as zero.
+#define SM_RECORDING_MAGIC 0x43524d53u
+#define SM_RECORDING_VERSION 1
+
+// Bytes gathered before the writer thread is handed a buffer
+#define SM_RECORDER_FLUSH_BYTES (1 << 20)
+
+typedef struct {
+    
+    unsigned char       *data;
+    size_t              size;
+    size_t              capacity;
+    
+} sm_record_buffer;
+
+typedef struct {
+    
+    unsigned long long  offset;
+    unsigned            frame;
+    unsigned            number_of_slots;
+    
+} sm_keyframe;
+
+struct sm_recorder {
+    
+    FILE                *file;
+    float               position_scale, velocity_scale;
+    unsigned            keyframe_interval;
+    unsigned            number_of_frames;
+    
+    // The stepping thread copies each frame into the front buffer while the writer thread
+    // encodes and writes the other. If the writer is still busy the front buffer grows rather
+    // than waiting on the disk.
+    sm_record_buffer    buffers[2];
+    unsigned            front;
+    int                 pending;
+    int                 quit;
+    
+    pthread_t           thread;
+    pthread_mutex_t     lock;
+    pthread_cond_t      work_ready;
+    pthread_cond_t      work_done;
+    
+    // Writer thread state. The rounded values of the last frame are kept four to a slot,
+    // with room for the frame being differenced after them.
+    sm_record_buffer    encoded;
+    unsigned long long  offset;
+    unsigned            frames_written;
+    int                 *quantized;
+    unsigned            number_of_slots;
+    unsigned            slot_capacity;
+    
+    sm_keyframe         *keyframes;
+    unsigned            number_of_keyframes;
+    unsigned            keyframe_capacity;
+    int                 failed;
+    
+};
+
+// Null if the file cannot be created. Positions are kept to within half of position_scale,
+// velocities to within half of velocity_scale.
+sm_recorder *new_recorder(const char *path, const float position_scale, const float velocity_scale, const unsigned keyframe_interval);
+
+// Writes whatever is left and the keyframe index, then closes the file
+void free_recorder(sm_recorder * const recorder);
+
+// Adds the space's current state as the next frame. A space with a recorder set records
+// itself after each step_space call and each fixed timestep of step_space_dt.
+void record_space(sm_recorder *recorder, const sm_space * const space);
+
+// A recording opened for reading, holding the decoded state of the current frame
+typedef struct {
+    
+    FILE                *file;
+    float               position_scale, velocity_scale;
+    
+    unsigned            number_of_frames;
+    sm_keyframe         *keyframes;
+    unsigned            number_of_keyframes;
+    
+    // SM_NO_INDEX before the first frame is read
+    unsigned            frame;
+    unsigned            number_of_slots;
+    unsigned            slot_capacity;
+    int                 *quantized;
+    vec2                *positions;
+    vec2                *velocities;
+    
+    unsigned char       *payload;
+    size_t              payload_capacity;
+    
+} sm_recording;
+
+// Null if the file is missing, unfinished or not a recording of this version
+sm_recording *open_recording(const char *path);
+void close_recording(sm_recording * const recording);
+
+// Decodes a frame into positions and velocities, continuing from the current frame when that is
+// closer than the nearest keyframe. Returns zero if the frame is not in the recording.
+int seek_recording(sm_recording *recording, const unsigned frame);
+
+#endif
@@ -0,0 +1,385 @@
+//
+//  scene.c
+//  spring_mass
+//
+//  Created by Richard Henry on 19/10/2026.
+//  Copyright 2026 Dogstar Diversions. http://www.dogstar.mobi
+//
+
+#include "scene.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SCENE_ALIGNMENT 16
+
+static const size_t block_sizes[SM_SCENE_BLOCKS] = {
+    
+    sizeof(vec2), sizeof(vec2), sizeof(float), sizeof(float), sizeof(float), sizeof(unsigned short), sizeof(unsigned short),
+    sizeof(unsigned), sizeof(unsigned), sizeof(float), sizeof(float), sizeof(float),
+    sizeof(vec2), sizeof(float)
+};
+
+static unsigned block_count(const sm_scene_header *header, const unsigned block) {
+    
+    if (block < SM_SCENE_SPRING_MASS1) return header->number_of_masses;
+    if (block < SM_SCENE_PLANE_NORMALS) return header->number_of_springs;
+    
+    return header->number_of_planes;
+}
+
+#pragma mark Binary scenes
+
+sm_scene *map_scene(const char *path) {
+    
+    const int fd = open(path, O_RDONLY);
+    
+    if (fd < 0) return 0;
+    
+    struct stat status;
+    void        *mapping = MAP_FAILED;
+    
+    if (!fstat(fd, &status) && status.st_size >= (off_t)sizeof(sm_scene_header))
+        mapping = mmap(0, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    
+    close(fd);
+    
+    if (mapping == MAP_FAILED) return 0;
+    
+    const sm_scene_header   *header = mapping;
+    const size_t            size = status.st_size;
+    int                     valid = header->magic == SM_SCENE_MAGIC && header->version == SM_SCENE_VERSION;
+    
+    // Check every block lies inside the file and holds its count
+    for (unsigned b = 0; valid && b < SM_SCENE_BLOCKS; b++) {
+        
+        const unsigned long long offset = header->blocks[b];
+        
+        valid = offset % SCENE_ALIGNMENT == 0 && offset <= size && (size - offset) / block_sizes[b] >= block_count(header, b);
+    }
+    
+    valid = valid && header->integrator <= SM_XPBD && header->mixed_precision <= 1 && header->constraint_solver <= SM_COLORED_GAUSS_SEIDEL &&
+        header->contact_solver <= SM_SEQUENTIAL_IMPULSES;
+    
+    // Springs are the only indices, and must join two different masses of the scene. Plane
+    // normals must be unit length.
+    if (valid) {
+        
+        const unsigned char *base = mapping;
+        const unsigned      *mass1 = (const unsigned *)(base + header->blocks[SM_SCENE_SPRING_MASS1]);
+        const unsigned      *mass2 = (const unsigned *)(base + header->blocks[SM_SCENE_SPRING_MASS2]);
+        const vec2          *normals = (const vec2 *)(base + header->blocks[SM_SCENE_PLANE_NORMALS]);
+        
+        for (unsigned s = 0; valid && s < header->number_of_springs; s++)
+            valid = mass1[s] < header->number_of_masses && mass2[s] < header->number_of_masses && mass1[s] != mass2[s];
+        
+        for (unsigned p = 0; valid && p < header->number_of_planes; p++) valid = plane_normal_is_unit(normals[p]);
+    }
+    
+    if (!valid) {
+        
+        munmap(mapping, size);
+        return 0;
+    }
+    
+    sm_scene            *scene = calloc(1, sizeof(sm_scene));
+    const unsigned char *base = mapping;
+    assert(scene);
+    
+    scene->header = header;
+    scene->mapping = mapping;
+    scene->size = size;
+    
+    scene->positions = (const vec2 *)(base + header->blocks[SM_SCENE_POSITIONS]);
+    scene->velocities = (const vec2 *)(base + header->blocks[SM_SCENE_VELOCITIES]);
+    scene->masses = (const float *)(base + header->blocks[SM_SCENE_MASSES]);
+    scene->radii = (const float *)(base + header->blocks[SM_SCENE_RADII]);
+    scene->elasticities = (const float *)(base + header->blocks[SM_SCENE_ELASTICITIES]);
+    scene->collision_types = (const unsigned short *)(base + header->blocks[SM_SCENE_COLLISION_TYPES]);
+    scene->collision_masks = (const unsigned short *)(base + header->blocks[SM_SCENE_COLLISION_MASKS]);
+    scene->spring_mass1 = (const unsigned *)(base + header->blocks[SM_SCENE_SPRING_MASS1]);
+    scene->spring_mass2 = (const unsigned *)(base + header->blocks[SM_SCENE_SPRING_MASS2]);
+    scene->spring_k = (const float *)(base + header->blocks[SM_SCENE_SPRING_K]);
+    scene->spring_l = (const float *)(base + header->blocks[SM_SCENE_SPRING_L]);
+    scene->spring_f = (const float *)(base + header->blocks[SM_SCENE_SPRING_F]);
+    scene->plane_normals = (const vec2 *)(base + header->blocks[SM_SCENE_PLANE_NORMALS]);
+    scene->plane_d = (const float *)(base + header->blocks[SM_SCENE_PLANE_D]);
+    
+    return scene;
+}
+
+void unmap_scene(sm_scene * const scene) {
+    
+    munmap(scene->mapping, scene->size);
+    free(scene);
+}
+
+static void read_parameters(sm_space *space, const sm_scene_header *header) {
+    
+    space->friction = header->friction;
+    space->v_factor = header->v_factor;
+    space->a_factor = header->a_factor;
+    space->separation_force = header->separation_force;
+    space->timestep = header->timestep;
+    space->integrator = header->integrator;
+    space->mixed_precision = header->mixed_precision;
+    space->constraint_solver = header->constraint_solver;
+    space->constraint_iterations = header->constraint_iterations;
+    space->contact_solver = header->contact_solver;
+    space->contact_iterations = header->contact_iterations;
+    space->sleep_velocity = header->sleep_velocity;
+    space->sleep_energy = header->sleep_energy;
+    space->sleep_steps = header->sleep_steps;
+}
+
+sm_space *new_space_from_scene(const sm_scene * const scene) {
+    
+    const sm_scene_header *header = scene->header;
+    
+    sm_space *space = new_space(header->number_of_masses, header->number_of_springs, header->number_of_planes);
+    
+    read_parameters(space, header);
+    reserve_pool(space->mass_pool, header->number_of_masses);
+    
+    for (unsigned m = 0; m < header->number_of_masses; m++) {
+        
+        sm_mass *mass = new_pooled_mass(space->mass_pool, scene->masses[m], scene->radii[m]);
+        
+        add_mass_to_space(space, mass);
+        
+        mass->pos = mass->prev = scene->positions[m];
+        mass->vel = scene->velocities[m];
+        mass->mass = scene->masses[m];
+        mass->radius = scene->radii[m];
+        mass->e = scene->elasticities[m];
+        mass->collision_type = scene->collision_types[m];
+        mass->collision_mask = scene->collision_masks[m];
+    }
+    
+    for (unsigned s = 0; s < header->number_of_springs; s++) {
+        
+        const sm_spring spring = { scene->spring_mass1[s], scene->spring_mass2[s], scene->spring_k[s], scene->spring_l[s], scene->spring_f[s] };
+        
+        add_spring_to_space(space, spring);
+    }
+    
+    for (unsigned p = 0; p < header->number_of_planes; p++)
+        add_plane_to_space(space, new_pooled_plane(space->plane_pool, scene->plane_normals[p], scene->plane_d[p]));
+    
+    return space;
+}
+
+static int write_block(FILE *file, const void *data, const size_t size) {
+    
+    static const unsigned char padding[SCENE_ALIGNMENT] = { 0 };
+    
+    const size_t pad = (SCENE_ALIGNMENT - size % SCENE_ALIGNMENT) % SCENE_ALIGNMENT;
+    
+    return fwrite(data, 1, size, file) == size && fwrite(padding, 1, pad, file) == pad;
+}
+
+static inline size_t aligned_size(const size_t size) { return (size + SCENE_ALIGNMENT - 1) / SCENE_ALIGNMENT * SCENE_ALIGNMENT; }
+
+int save_scene(const sm_space * const space, const char *path) {
+    
+    const unsigned n = space->number_of_masses, number_of_springs = space->number_of_springs, number_of_planes = space->number_of_planes;
+    
+    sm_scene_header header = {
+        
+        SM_SCENE_MAGIC, SM_SCENE_VERSION, n, number_of_springs, number_of_planes,
+        space->friction, space->v_factor, space->a_factor, space->separation_force, space->timestep,
+        space->integrator, space->mixed_precision != 0, space->constraint_solver, space->constraint_iterations, space->contact_solver, space->contact_iterations,
+        space->sleep_velocity, space->sleep_energy, space->sleep_steps
+    };
+    
+    unsigned long long offset = aligned_size(sizeof(header));
+    
+    for (unsigned b = 0; b < SM_SCENE_BLOCKS; b++) {
+        
+        header.blocks[b] = offset;
+        offset += aligned_size(block_count(&header, b) * block_sizes[b]);
+    }
+    
+    // Gather each field into one buffer big enough for the largest block
+    size_t largest = 0;
+    
+    for (unsigned b = 0; b < SM_SCENE_BLOCKS; b++)
+        if (block_count(&header, b) * block_sizes[b] > largest) largest = block_count(&header, b) * block_sizes[b];
+    
+    FILE            *file = fopen(path, "wb");
+    unsigned char   *buffer = malloc(largest ? largest : 1);
+    int             ok = file && buffer && write_block(file, &header, sizeof(header));
+    
+    for (unsigned b = 0; ok && b < SM_SCENE_BLOCKS; b++) {
+        
+        const unsigned count = block_count(&header, b);
+        
+        for (unsigned i = 0; i < count; i++) {
+            
+            const sm_mass   *mass = b < SM_SCENE_SPRING_MASS1 ? space->masses[i] : 0;
+            const sm_spring *spring = b >= SM_SCENE_SPRING_MASS1 && b < SM_SCENE_PLANE_NORMALS ? &space->springs[i] : 0;
+            const sm_plane  *plane = b >= SM_SCENE_PLANE_NORMALS ? space->planes[i] : 0;
+            
+            switch (b) {
+                    
+                case SM_SCENE_POSITIONS:        ((vec2 *)buffer)[i] = mass->pos; break;
+                case SM_SCENE_VELOCITIES:       ((vec2 *)buffer)[i] = mass->vel; break;
+                case SM_SCENE_MASSES:           ((float *)buffer)[i] = mass->mass; break;
+                case SM_SCENE_RADII:            ((float *)buffer)[i] = mass->radius; break;
+                case SM_SCENE_ELASTICITIES:     ((float *)buffer)[i] = mass->e; break;
+                case SM_SCENE_COLLISION_TYPES:  ((unsigned short *)buffer)[i] = mass->collision_type; break;
+                case SM_SCENE_COLLISION_MASKS:  ((unsigned short *)buffer)[i] = mass->collision_mask; break;
+                case SM_SCENE_SPRING_MASS1:     ((unsigned *)buffer)[i] = spring->mass1; break;
+                case SM_SCENE_SPRING_MASS2:     ((unsigned *)buffer)[i] = spring->mass2; break;
+                case SM_SCENE_SPRING_K:         ((float *)buffer)[i] = spring->k; break;
+                case SM_SCENE_SPRING_L:         ((float *)buffer)[i] = spring->l; break;
+                case SM_SCENE_SPRING_F:         ((float *)buffer)[i] = spring->f; break;
+                case SM_SCENE_PLANE_NORMALS:    ((vec2 *)buffer)[i] = plane->normal; break;
+                case SM_SCENE_PLANE_D:          ((float *)buffer)[i] = plane->d; break;
+            }
+        }
+        
+        ok = write_block(file, buffer, count * block_sizes[b]);
+    }
+    
+    free(buffer);
+    
+    if (file && fclose(file)) ok = 0;
+    
+    return ok;
+}
+
+#pragma mark Text scenes
+
+sm_space *load_scene_text(const char *path) {
+    
+    FILE *file = fopen(path, "r");
+    
+    if (!file) return 0;
+    
+    sm_space    *space = new_space(0, 0, 0);
+    char        line[512];
+    int         ok = 1;
+    
+    while (ok && fgets(line, sizeof(line), file)) {
+        
+        char        keyword[16];
+        int         used = 0;
+        
+        if (sscanf(line, " %15s%n", keyword, &used) != 1 || keyword[0] == '#') continue;
+        
+        const char *rest = line + used;
+        
+        if (!strcmp(keyword, "space")) {
+            
+            unsigned integrator, mixed_precision;
+            
+            ok = sscanf(rest, "%f %f %f %f %f %u %u", &space->friction, &space->v_factor, &space->a_factor, &space->separation_force, &space->timestep, &integrator, &mixed_precision) == 7 &&
+                integrator <= SM_XPBD && mixed_precision <= 1;
+            space->integrator = integrator;
+            space->mixed_precision = mixed_precision;
+            
+        } else if (!strcmp(keyword, "constraints")) {
+            
+            unsigned solver, contact_solver;
+            
+            ok = sscanf(rest, "%u %u %u %u", &solver, &space->constraint_iterations, &contact_solver, &space->contact_iterations) == 4 &&
+                solver <= SM_COLORED_GAUSS_SEIDEL && contact_solver <= SM_SEQUENTIAL_IMPULSES;
+            space->constraint_solver = solver;
+            space->contact_solver = contact_solver;
+            
+        } else if (!strcmp(keyword, "sleep")) {
+            
+            ok = sscanf(rest, "%f %f %u", &space->sleep_velocity, &space->sleep_energy, &space->sleep_steps) == 3;
+            
+        } else if (!strcmp(keyword, "mass")) {
+            
+            vec2            pos, vel;
+            float           m, r, e;
+            unsigned short  type, mask;
+            
+            ok = sscanf(rest, "%f %f %f %f %f %f %f %hu %hu", &pos.x, &pos.y, &vel.x, &vel.y, &m, &r, &e, &type, &mask) == 9;
+            
+            if (ok) {
+                
+                sm_mass *mass = new_pooled_mass(space->mass_pool, m, r);
+                
+                add_mass_to_space(space, mass);
+                
+                mass->pos = mass->prev = pos;
+                mass->vel = vel;
+                mass->mass = m;
+                mass->radius = r;
+                mass->e = e;
+                mass->collision_type = type;
+                mass->collision_mask = mask;
+            }
+            
+        } else if (!strcmp(keyword, "spring")) {
+            
+            sm_spring spring;
+            
+            ok = sscanf(rest, "%u %u %f %f %f", &spring.mass1, &spring.mass2, &spring.k, &spring.l, &spring.f) == 5 &&
+                spring.mass1 < space->number_of_masses && spring.mass2 < space->number_of_masses && spring.mass1 != spring.mass2;
+            
+            if (ok) add_spring_to_space(space, spring);
+            
+        } else if (!strcmp(keyword, "plane")) {
+            
+            vec2    normal;
+            float   d;
+            
+            ok = sscanf(rest, "%f %f %f", &normal.x, &normal.y, &d) == 3 && plane_normal_is_unit(normal);
+            
+            if (ok) add_plane_to_space(space, new_pooled_plane(space->plane_pool, normal, d));
+            
+        } else ok = 0;
+    }
+    
+    fclose(file);
+    
+    if (!ok) {
+        
+        free_space(space);
+        return 0;
+    }
+    
+    return space;
+}
+
+int save_scene_text(const sm_space * const space, const char *path) {
+    
+    FILE *file = fopen(path, "w");
+    
+    if (!file) return 0;
+    
+    // Nine significant digits bring every float back exactly
+    fprintf(file, "# spring_mass scene %d\n", SM_SCENE_VERSION);
+    fprintf(file, "space %.9g %.9g %.9g %.9g %.9g %u %u\n", space->friction, space->v_factor, space->a_factor, space->separation_force, space->timestep, (unsigned)space->integrator, space->mixed_precision != 0);
+    fprintf(file, "constraints %u %u %u %u\n", (unsigned)space->constraint_solver, space->constraint_iterations, (unsigned)space->contact_solver, space->contact_iterations);
+    fprintf(file, "sleep %.9g %.9g %u\n", space->sleep_velocity, space->sleep_energy, space->sleep_steps);
+    
+    for (unsigned m = 0; m < space->number_of_masses; m++) {
+        
+        const sm_mass *mass = space->masses[m];
+        
+        fprintf(file, "mass %.9g %.9g %.9g %.9g %.9g %.9g %.9g %hu %hu\n", mass->pos.x, mass->pos.y, mass->vel.x, mass->vel.y, mass->mass, mass->radius, mass->e, mass->collision_type, mass->collision_mask);
+    }
+    
+    for (unsigned s = 0; s < space->number_of_springs; s++) {
+        
+        const sm_spring *spring = &space->springs[s];
+        
+        fprintf(file, "spring %u %u %.9g %.9g %.9g\n", spring->mass1, spring->mass2, spring->k, spring->l, spring->f);
+    }
+    
+    for (unsigned p = 0; p < space->number_of_planes; p++)
+        fprintf(file, "plane %.9g %.9g %.9g\n", space->planes[p]->normal.x, space->planes[p]->normal.y, space->planes[p]->d);
+    
+    return fclose(file) == 0;
+}
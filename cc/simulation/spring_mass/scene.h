@@ -0,0 +1,112 @@
+//
+//  scene.h
+//  spring_mass
+//
+//  Created by Richard Henry on 19/10/2026.
+//  Copyright 2026 Dogstar Diversions. http://www.dogstar.mobi
+//
+
+#ifndef SM_SCENE_H
+#define SM_SCENE_H
+
+#include "space.h"
+
+// Binary scenes are a header followed by one 16 byte aligned block per field, in native
+// byte order. The magic reads backwards when the byte order does not match.
+#define SM_SCENE_MAGIC 0x43534d53u
+#define SM_SCENE_VERSION 2
+
+enum {
+    
+    SM_SCENE_POSITIONS,
+    SM_SCENE_VELOCITIES,
+    SM_SCENE_MASSES,
+    SM_SCENE_RADII,
+    SM_SCENE_ELASTICITIES,
+    SM_SCENE_COLLISION_TYPES,
+    SM_SCENE_COLLISION_MASKS,
+    SM_SCENE_SPRING_MASS1,
+    SM_SCENE_SPRING_MASS2,
+    SM_SCENE_SPRING_K,
+    SM_SCENE_SPRING_L,
+    SM_SCENE_SPRING_F,
+    SM_SCENE_PLANE_NORMALS,
+    SM_SCENE_PLANE_D,
+    SM_SCENE_BLOCKS
+};
+
+typedef struct {
+    
+    unsigned            magic;
+    unsigned            version;
+    
+    unsigned            number_of_masses;
+    unsigned            number_of_springs;
+    unsigned            number_of_planes;
+    
+    // Space parameters
+    float               friction;
+    float               v_factor, a_factor;
+    float               separation_force;
+    float               timestep;
+    unsigned            integrator;
+    unsigned            mixed_precision;
+    unsigned            constraint_solver;
+    unsigned            constraint_iterations;
+    unsigned            contact_solver;
+    unsigned            contact_iterations;
+    float               sleep_velocity;
+    float               sleep_energy;
+    unsigned            sleep_steps;
+    
+    // Byte offset of each block from the start of the file
+    unsigned long long  blocks[SM_SCENE_BLOCKS];
+    
+} sm_scene_header;
+
+// A mapped scene file, its arrays pointing straight into the mapping
+typedef struct {
+    
+    const sm_scene_header   *header;
+    
+    const vec2              *positions;
+    const vec2              *velocities;
+    const float             *masses;
+    const float             *radii;
+    const float             *elasticities;
+    const unsigned short    *collision_types;
+    const unsigned short    *collision_masks;
+    
+    const unsigned          *spring_mass1, *spring_mass2;
+    const float             *spring_k, *spring_l, *spring_f;
+    
+    const vec2              *plane_normals;
+    const float             *plane_d;
+    
+    void                    *mapping;
+    size_t                  size;
+    
+} sm_scene;
+
+// Null if the file cannot be mapped, is not a scene of this version, or does not hold together
+sm_scene *map_scene(const char *path);
+void unmap_scene(sm_scene * const scene);
+
+// A space holding the scene, its masses and planes taken from the space's pools
+sm_space *new_space_from_scene(const sm_scene * const scene);
+
+// Zero if the file could not be written
+int save_scene(const sm_space * const space, const char *path);
+
+// Text scenes hold one record per line, for editing and diffing:
+//   space friction v_factor a_factor separation_force timestep integrator mixed_precision
+//   constraints constraint_solver constraint_iterations contact_solver contact_iterations
+//   sleep sleep_velocity sleep_energy sleep_steps
+//   mass x y vx vy mass radius e collision_type collision_mask
+//   spring mass1 mass2 k l f
+//   plane nx ny d
+// Blank lines and lines starting with # are ignored.
+sm_space *load_scene_text(const char *path);
+int save_scene_text(const sm_space * const space, const char *path);
+
+#endif
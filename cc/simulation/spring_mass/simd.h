@@ -0,0 +1,91 @@
+//
+//  simd.h
+//  spring_mass
+//
+//  Created by Richard Henry on 19/10/2026.
+//  Copyright 2026 Dogstar Diversions. http://www.dogstar.mobi
+//
+
+#ifndef SM_SIMD_H
+#define SM_SIMD_H
+
+// Four lane float vectors for the batched kernels, using SSE or NEON where
+// available and plain arrays otherwise. Every operation rounds exactly as
+// the scalar float equivalent, so batched and scalar tails agree.
+
+#define SM_LANES 4
+
+#if defined(__SSE__) || defined(_M_X64)
+
+#include <xmmintrin.h>
+
+typedef __m128 sm_f4;
+
+static inline sm_f4 f4_set1(const float a) { return _mm_set1_ps(a); }
+static inline sm_f4 f4_set(const float a, const float b, const float c, const float d) { return _mm_setr_ps(a, b, c, d); }
+static inline sm_f4 f4_load(const float *p) { return _mm_loadu_ps(p); }
+static inline void f4_store(float *p, const sm_f4 a) { _mm_storeu_ps(p, a); }
+static inline sm_f4 f4_add(const sm_f4 a, const sm_f4 b) { return _mm_add_ps(a, b); }
+static inline sm_f4 f4_sub(const sm_f4 a, const sm_f4 b) { return _mm_sub_ps(a, b); }
+static inline sm_f4 f4_mul(const sm_f4 a, const sm_f4 b) { return _mm_mul_ps(a, b); }
+static inline sm_f4 f4_div(const sm_f4 a, const sm_f4 b) { return _mm_div_ps(a, b); }
+static inline sm_f4 f4_sqrt(const sm_f4 a) { return _mm_sqrt_ps(a); }
+static inline sm_f4 f4_min(const sm_f4 a, const sm_f4 b) { return _mm_min_ps(a, b); }
+static inline sm_f4 f4_max(const sm_f4 a, const sm_f4 b) { return _mm_max_ps(a, b); }
+
+// Lanes of b where a is non zero, zero elsewhere
+static inline sm_f4 f4_where_nonzero(const sm_f4 a, const sm_f4 b) { return _mm_and_ps(_mm_cmpneq_ps(a, _mm_setzero_ps()), b); }
+
+// Bit n set where lane n of a is less than lane n of b
+static inline int f4_less_mask(const sm_f4 a, const sm_f4 b) { return _mm_movemask_ps(_mm_cmplt_ps(a, b)); }
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+
+#include <arm_neon.h>
+
+typedef float32x4_t sm_f4;
+
+static inline sm_f4 f4_set1(const float a) { return vdupq_n_f32(a); }
+static inline sm_f4 f4_set(const float a, const float b, const float c, const float d) { const float v[4] = { a, b, c, d }; return vld1q_f32(v); }
+static inline sm_f4 f4_load(const float *p) { return vld1q_f32(p); }
+static inline void f4_store(float *p, const sm_f4 a) { vst1q_f32(p, a); }
+static inline sm_f4 f4_add(const sm_f4 a, const sm_f4 b) { return vaddq_f32(a, b); }
+static inline sm_f4 f4_sub(const sm_f4 a, const sm_f4 b) { return vsubq_f32(a, b); }
+static inline sm_f4 f4_mul(const sm_f4 a, const sm_f4 b) { return vmulq_f32(a, b); }
+static inline sm_f4 f4_div(const sm_f4 a, const sm_f4 b) { return vdivq_f32(a, b); }
+static inline sm_f4 f4_sqrt(const sm_f4 a) { return vsqrtq_f32(a); }
+static inline sm_f4 f4_min(const sm_f4 a, const sm_f4 b) { return vminq_f32(a, b); }
+static inline sm_f4 f4_max(const sm_f4 a, const sm_f4 b) { return vmaxq_f32(a, b); }
+
+static inline sm_f4 f4_where_nonzero(const sm_f4 a, const sm_f4 b) {
+    return vreinterpretq_f32_u32(vbicq_u32(vreinterpretq_u32_f32(b), vceqq_f32(a, vdupq_n_f32(0))));
+}
+
+static inline int f4_less_mask(const sm_f4 a, const sm_f4 b) {
+    const uint32x4_t bits = { 1, 2, 4, 8 };
+    return (int)vaddvq_u32(vandq_u32(vcltq_f32(a, b), bits));
+}
+
+#else
+
+#include <math.h>
+
+typedef struct { float v[4]; } sm_f4;
+
+static inline sm_f4 f4_set1(const float a) { return (sm_f4) {{ a, a, a, a }}; }
+static inline sm_f4 f4_set(const float a, const float b, const float c, const float d) { return (sm_f4) {{ a, b, c, d }}; }
+static inline sm_f4 f4_load(const float *p) { return (sm_f4) {{ p[0], p[1], p[2], p[3] }}; }
+static inline void f4_store(float *p, const sm_f4 a) { for (int i = 0; i < 4; i++) p[i] = a.v[i]; }
+static inline sm_f4 f4_add(sm_f4 a, const sm_f4 b) { for (int i = 0; i < 4; i++) a.v[i] += b.v[i]; return a; }
+static inline sm_f4 f4_sub(sm_f4 a, const sm_f4 b) { for (int i = 0; i < 4; i++) a.v[i] -= b.v[i]; return a; }
+static inline sm_f4 f4_mul(sm_f4 a, const sm_f4 b) { for (int i = 0; i < 4; i++) a.v[i] *= b.v[i]; return a; }
+static inline sm_f4 f4_div(sm_f4 a, const sm_f4 b) { for (int i = 0; i < 4; i++) a.v[i] /= b.v[i]; return a; }
+static inline sm_f4 f4_sqrt(sm_f4 a) { for (int i = 0; i < 4; i++) a.v[i] = sqrtf(a.v[i]); return a; }
+static inline sm_f4 f4_min(sm_f4 a, const sm_f4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i]; return a; }
+static inline sm_f4 f4_max(sm_f4 a, const sm_f4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]; return a; }
+static inline sm_f4 f4_where_nonzero(const sm_f4 a, sm_f4 b) { for (int i = 0; i < 4; i++) if (a.v[i] == 0) b.v[i] = 0; return b; }
+static inline int f4_less_mask(const sm_f4 a, const sm_f4 b) { int m = 0; for (int i = 0; i < 4; i++) m |= (a.v[i] < b.v[i]) << i; return m; }
+
+#endif
+
+#endif
@@ -0,0 +1,128 @@
+//
+//  slots.c
+//  spring_mass
+//
+//  Created by Richard Henry on 19/10/2026.
+//  Copyright 2026 Dogstar Diversions. http://www.dogstar.mobi
+//
+
+#include "slots.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+sm_slots *new_slots(const unsigned capacity) {
+
+    sm_slots *slots = calloc(1, sizeof(sm_slots));
+    assert(slots);
+
+    slots->free_slot = SM_NO_INDEX;
+
+    reserve_slots(slots, capacity);
+
+    return slots;
+}
+
+void reserve_slots(sm_slots *slots, const unsigned capacity) {
+
+    if (capacity <= slots->capacity) return;
+
+    // Handles hold slot numbers rather than pointers, so moving the tables is fine
+    slots->entries = realloc(slots->entries, capacity * sizeof(unsigned));
+    slots->generations = realloc(slots->generations, capacity * sizeof(unsigned));
+    slots->owners = realloc(slots->owners, capacity * sizeof(unsigned));
+    assert(slots->entries && slots->generations && slots->owners);
+
+    slots->capacity = capacity;
+}
+
+void free_slots(sm_slots * const slots) {
+    
+    free(slots->owners);
+    free(slots->generations);
+    free(slots->entries);
+    
+    free(slots);
+}
+
+void reset_slots(sm_slots *slots) {
+
+    // Bump every generation so handles from before the reset go stale
+    for (unsigned slot = 0; slot < slots->number_of_slots; slot++)
+        if (!++slots->generations[slot]) slots->generations[slot] = 1;
+
+    // Chain the used slots into the free list in order
+    for (unsigned slot = 0; slot < slots->number_of_slots; slot++)
+        slots->entries[slot] = slot + 1 < slots->number_of_slots ? slot + 1 : SM_NO_INDEX;
+
+    slots->free_slot = slots->number_of_slots ? 0 : SM_NO_INDEX;
+}
+
+sm_handle take_slot(sm_slots *slots, const unsigned index) {
+    
+    unsigned slot = slots->free_slot;
+    
+    // Reuse a released slot before touching a new one
+    if (slot != SM_NO_INDEX) slots->free_slot = slots->entries[slot];
+    else {
+        
+        assert(slots->number_of_slots < slots->capacity);
+        
+        slot = slots->number_of_slots++;
+        slots->generations[slot] = 1;
+    }
+    
+    slots->entries[slot] = index;
+    slots->owners[index] = slot;
+    
+    return (sm_handle) { slot, slots->generations[slot] };
+}
+
+void release_slot(sm_slots *slots, const unsigned index) {
+    
+    const unsigned slot = slots->owners[index];
+    
+    // Zero is never handed out, so skip it when the generation wraps
+    if (!++slots->generations[slot]) slots->generations[slot] = 1;
+    
+    slots->entries[slot] = slots->free_slot;
+    slots->free_slot = slot;
+}
+
+void move_slot(sm_slots *slots, const unsigned from, const unsigned to) {
+    
+    const unsigned slot = slots->owners[from];
+    
+    slots->entries[slot] = to;
+    slots->owners[to] = slot;
+}
+
+void remap_slots(sm_slots *slots, const unsigned *remap, const unsigned count) {
+    
+    unsigned *owners = malloc(count * sizeof(unsigned));
+    assert(owners || !count);
+    
+    memcpy(owners, slots->owners, count * sizeof(unsigned));
+    
+    for (unsigned i = 0; i < count; i++) {
+        
+        slots->entries[owners[i]] = remap[i];
+        slots->owners[remap[i]] = owners[i];
+    }
+    
+    free(owners);
+}
+
+unsigned slot_index(const sm_slots *slots, const sm_handle handle) {
+    
+    if (handle.slot >= slots->number_of_slots || slots->generations[handle.slot] != handle.generation) return SM_NO_INDEX;
+    
+    return slots->entries[handle.slot];
+}
+
+sm_handle slot_handle(const sm_slots *slots, const unsigned index) {
+    
+    const unsigned slot = slots->owners[index];
+    
+    return (sm_handle) { slot, slots->generations[slot] };
+}
@@ -0,0 +1,55 @@
+//
+//  slots.h
+//  spring_mass
+//
+//  Created by Richard Henry on 19/10/2026.
+//  Copyright 2026 Dogstar Diversions. http://www.dogstar.mobi
+//
+
+#ifndef SM_SLOTS_H
+#define SM_SLOTS_H
+
+#define SM_NO_INDEX (~0u)
+
+// A handle stays valid until its object is removed, however the dense arrays get shuffled
+typedef struct {
+    
+    unsigned        slot;
+    unsigned        generation;
+    
+} sm_handle;
+
+#define SM_NULL_HANDLE ((sm_handle) { SM_NO_INDEX, 0 })
+
+// Maps handles to indices in a dense array that is kept packed by swap removal
+typedef struct {
+    
+    unsigned        *entries;       // Dense index of a live slot, next free slot of a dead one
+    unsigned        *generations;   // Bumped whenever a slot is released
+    unsigned        *owners;        // Slot of each dense index
+    
+    unsigned        capacity;
+    unsigned        number_of_slots;
+    unsigned        free_slot;
+    
+} sm_slots;
+
+sm_slots *new_slots(const unsigned capacity);
+void free_slots(sm_slots * const slots);
+void reserve_slots(sm_slots *slots, const unsigned capacity);
+void reset_slots(sm_slots *slots);
+
+sm_handle take_slot(sm_slots *slots, const unsigned index);
+void release_slot(sm_slots *slots, const unsigned index);
+
+// The dense item at from has been moved to to
+void move_slot(sm_slots *slots, const unsigned from, const unsigned to);
+
+// Dense items have been reordered so that old index i is now at remap[i]
+void remap_slots(sm_slots *slots, const unsigned *remap, const unsigned count);
+
+// Dense index of a handle, or SM_NO_INDEX if its object has gone
+unsigned slot_index(const sm_slots *slots, const sm_handle handle);
+sm_handle slot_handle(const sm_slots *slots, const unsigned index);
+
+#endif
@@ -0,0 +1,367 @@
+//
+//  snapshot.c
+//  spring_mass
+//
+//  Created by Richard Henry on 19/10/2026.
+//  Copyright 2026 Dogstar Diversions. http://www.dogstar.mobi
+//
+
+#include "snapshot.h"
+#include "body.h"
+#include "contact.h"
+#include "internal.h"
+
+typedef struct {
+    
+    unsigned    number_of_masses;
+    unsigned    number_of_springs;
+    unsigned    number_of_planes;
+    unsigned    number_of_awake_masses;
+    unsigned    number_of_awake_springs;
+    unsigned    number_of_bodies;
+    unsigned    number_of_body_members;
+    int         bodies_dirty;
+    unsigned    number_of_contact_impulses;
+    int         masses_dirty;
+    int         islands;
+    int         mixed_precision;
+    float       accumulator;
+    float       interpolation;
+    
+} snapshot_header;
+
+// The per mass state follows the header as whole arrays, one after another. The rounding
+// error carried by mixed precision comes last and is only kept with it on.
+enum { STATE_POS, STATE_VEL, STATE_ACC, STATE_FRC, STATE_PREV, STATE_POS_ERROR, STATE_VEL_ERROR, NUMBER_OF_STATES };
+
+static inline unsigned number_of_states(const int mixed_precision) { return mixed_precision ? NUMBER_OF_STATES : STATE_POS_ERROR; }
+
+static size_t snapshot_size(const sm_space *space) {
+    
+    const size_t masses = space->number_of_masses, springs = space->number_of_springs;
+    
+    // Island state only matters with sleeping on
+    const size_t per_mass = sizeof(vec2) * number_of_states(space->mixed_precision) + sizeof(unsigned) * (space->sleep_velocity > 0.0 ? 4 : 2);
+    
+    // Bodies whole, and their members by mass slot
+    const size_t bodies = space->number_of_bodies * sizeof(sm_body) + space->number_of_body_members * (sizeof(unsigned) * 2 + sizeof(vec2));
+    
+    // The impulses contacts warm start from, keyed by mass slot
+    const size_t impulses = space->number_of_contact_impulses * sizeof(sm_contact_impulse);
+    
+    return sizeof(snapshot_header) + masses * per_mass + springs * (sizeof(sm_spring) + sizeof(unsigned)) + bodies + impulses;
+}
+
+// FNV-1a over the 32 bit words of each position and velocity
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME 16777619u
+
+static inline unsigned hash_mass(unsigned hash, const sm_mass *mass) {
+    
+    unsigned words[4];
+    
+    memcpy(&words[0], &mass->pos, sizeof(vec2));
+    memcpy(&words[2], &mass->vel, sizeof(vec2));
+    
+    for (unsigned w = 0; w < 4; w++) hash = (hash ^ words[w]) * FNV_PRIME;
+    
+    return hash;
+}
+
+static inline void put(unsigned char **cursor, const void *from, const size_t size) {
+    
+    memcpy(*cursor, from, size);
+    *cursor += size;
+}
+
+static inline void get(const unsigned char **cursor, void *to, const size_t size) {
+    
+    memcpy(to, *cursor, size);
+    *cursor += size;
+}
+
+#pragma mark Snapshots
+
+sm_snapshot *new_snapshot(void) {
+    
+    sm_snapshot *snapshot = calloc(1, sizeof(sm_snapshot));
+    assert(snapshot);
+    
+    return snapshot;
+}
+
+void free_snapshot(sm_snapshot * const snapshot) {
+    
+    free(snapshot->data);
+    free(snapshot);
+}
+
+void save_snapshot(const sm_space * const space, sm_snapshot *snapshot, const unsigned frame) {
+    
+    const unsigned  n = space->number_of_masses;
+    const size_t    size = snapshot_size(space);
+    
+    if (size > snapshot->capacity) {
+        
+        snapshot->data = realloc(snapshot->data, size);
+        snapshot->capacity = size;
+        assert(snapshot->data);
+    }
+    
+    const snapshot_header header = {
+        
+        n, space->number_of_springs, space->number_of_planes,
+        space->number_of_awake_masses, space->number_of_awake_springs,
+        space->number_of_bodies, space->number_of_body_members, space->bodies_dirty, space->number_of_contact_impulses,
+        space->masses_dirty, space->sleep_velocity > 0.0, space->mixed_precision != 0, space->accumulator, space->interpolation
+    };
+    
+    unsigned char *cursor = snapshot->data;
+    
+    put(&cursor, &header, sizeof(header));
+    
+    // Mass state by field, hashed on the way through
+    vec2        *state = (vec2 *)cursor;
+    unsigned    hash = FNV_OFFSET;
+    
+    for (unsigned m = 0; m < n; m++) {
+        
+        const sm_mass *mass = space->masses[m];
+        
+        state[STATE_POS * n + m] = mass->pos;
+        state[STATE_VEL * n + m] = mass->vel;
+        state[STATE_ACC * n + m] = mass->acc;
+        state[STATE_FRC * n + m] = mass->frc;
+        state[STATE_PREV * n + m] = mass->prev;
+        
+        if (header.mixed_precision) {
+            
+            state[STATE_POS_ERROR * n + m] = mass->pos_error;
+            state[STATE_VEL_ERROR * n + m] = mass->vel_error;
+        }
+        
+        hash = hash_mass(hash, mass);
+    }
+    
+    cursor += sizeof(vec2) * number_of_states(header.mixed_precision) * n;
+    
+    // The order of the dense arrays, which sleeping and sorting change
+    put(&cursor, space->mass_slots->owners, n * sizeof(unsigned));
+    
+    // The broad phase order carries between steps unless it is about to be rebuilt
+    unsigned *order = (unsigned *)cursor;
+    
+    for (unsigned m = 0; m < n; m++) order[m] = space->masses_dirty ? m : space->collision_order[m];
+    
+    cursor += n * sizeof(unsigned);
+    
+    if (header.islands) {
+        
+        put(&cursor, space->rest_steps, n * sizeof(unsigned));
+        put(&cursor, space->island_parents, n * sizeof(unsigned));
+    }
+    
+    put(&cursor, space->springs, space->number_of_springs * sizeof(sm_spring));
+    put(&cursor, space->spring_slots->owners, space->number_of_springs * sizeof(unsigned));
+    put(&cursor, space->bodies, space->number_of_bodies * sizeof(sm_body));
+    
+    for (const sm_body_member *member = space->body_members; member < space->body_members + space->number_of_body_members; member++) {
+        
+        const unsigned slot = space->mass_slots->owners[member->mass->index];
+        
+        put(&cursor, &slot, sizeof(unsigned));
+        put(&cursor, &member->body, sizeof(unsigned));
+        put(&cursor, &member->offset, sizeof(vec2));
+    }
+    
+    put(&cursor, space->contact_impulses, space->number_of_contact_impulses * sizeof(sm_contact_impulse));
+    
+    assert(cursor == snapshot->data + size);
+    
+    snapshot->size = size;
+    snapshot->frame = frame;
+    snapshot->checksum = hash;
+}
+
+void restore_snapshot(sm_space * const space, const sm_snapshot *snapshot) {
+    
+    const unsigned char *cursor = snapshot->data;
+    snapshot_header     header;
+    
+    get(&cursor, &header, sizeof(header));
+    
+    const unsigned n = header.number_of_masses;
+    
+    assert(n == space->number_of_masses && header.number_of_springs == space->number_of_springs && header.number_of_planes == space->number_of_planes);
+    assert(header.mixed_precision == (space->mixed_precision != 0));
+    assert(header.number_of_bodies == space->number_of_bodies && header.number_of_body_members <= space->body_member_capacity);
+    
+    // Find each mass by its slot before putting them back in their saved order
+    sm_mass         **by_slot = space->mass_scratch;
+    const sm_slots  *slots = space->mass_slots;
+    
+    assert(slots->number_of_slots <= (unsigned)(space->masses_end - space->masses));
+    
+    for (unsigned m = 0; m < n; m++) by_slot[slots->owners[m]] = space->masses[m];
+    
+    const vec2 *state = (const vec2 *)cursor;
+    
+    cursor += sizeof(vec2) * number_of_states(header.mixed_precision) * n;
+    
+    const unsigned *owners = (const unsigned *)cursor;
+    
+    for (unsigned m = 0; m < n; m++) {
+        
+        sm_mass *mass = by_slot[owners[m]];
+        
+        space->masses[m] = mass;
+        space->mass_slots->owners[m] = owners[m];
+        space->mass_slots->entries[owners[m]] = m;
+        
+        mass->index = m;
+        mass->pos = state[STATE_POS * n + m];
+        mass->vel = state[STATE_VEL * n + m];
+        mass->acc = state[STATE_ACC * n + m];
+        mass->frc = state[STATE_FRC * n + m];
+        mass->prev = state[STATE_PREV * n + m];
+        
+        if (header.mixed_precision) {
+            
+            mass->pos_error = state[STATE_POS_ERROR * n + m];
+            mass->vel_error = state[STATE_VEL_ERROR * n + m];
+        }
+    }
+    
+    cursor += n * sizeof(unsigned);
+    
+    get(&cursor, space->collision_order, n * sizeof(unsigned));
+    
+    if (header.islands) {
+        
+        get(&cursor, space->rest_steps, n * sizeof(unsigned));
+        get(&cursor, space->island_parents, n * sizeof(unsigned));
+    }
+    
+    get(&cursor, space->springs, header.number_of_springs * sizeof(sm_spring));
+    
+    const unsigned *spring_owners = (const unsigned *)cursor;
+    
+    for (unsigned s = 0; s < header.number_of_springs; s++) {
+        
+        space->spring_slots->owners[s] = spring_owners[s];
+        space->spring_slots->entries[spring_owners[s]] = s;
+    }
+    
+    cursor += header.number_of_springs * sizeof(unsigned);
+    
+    get(&cursor, space->bodies, header.number_of_bodies * sizeof(sm_body));
+    
+    // Masses added to bodies since are free again
+    for (unsigned m = 0; m < n; m++) space->masses[m]->body = 0;
+    
+    for (unsigned b = 0; b < header.number_of_body_members; b++) {
+        
+        sm_body_member  *member = &space->body_members[b];
+        unsigned        slot;
+        
+        get(&cursor, &slot, sizeof(unsigned));
+        get(&cursor, &member->body, sizeof(unsigned));
+        get(&cursor, &member->offset, sizeof(vec2));
+        
+        member->mass = by_slot[slot];
+        member->mass->body = member->body + 1;
+    }
+    
+    space->contact_impulses = grow_array(space->contact_impulses, &space->contact_impulse_capacity, header.number_of_contact_impulses, sizeof(sm_contact_impulse));
+    get(&cursor, space->contact_impulses, header.number_of_contact_impulses * sizeof(sm_contact_impulse));
+    
+    space->number_of_awake_masses = header.number_of_awake_masses;
+    space->number_of_awake_springs = header.number_of_awake_springs;
+    space->number_of_body_members = header.number_of_body_members;
+    space->bodies_dirty = header.bodies_dirty;
+    space->number_of_contact_impulses = header.number_of_contact_impulses;
+    space->masses_dirty = header.masses_dirty;
+    space->accumulator = header.accumulator;
+    space->interpolation = header.interpolation;
+    space->wake_requested = 0;
+    
+    // Springs may have moved, so anything built from them is rebuilt on the next step
+    space->springs_dirty = 1;
+}
+
+unsigned space_checksum(const sm_space * const space) {
+    
+    unsigned hash = FNV_OFFSET;
+    
+    for (unsigned m = 0; m < space->number_of_masses; m++) hash = hash_mass(hash, space->masses[m]);
+    
+    return hash;
+}
+
+#pragma mark Rollback
+
+sm_rollback *new_rollback(const unsigned number_of_snapshots) {
+    
+    assert(number_of_snapshots > 0);
+    
+    sm_rollback *rollback = calloc(1, sizeof(sm_rollback));
+    assert(rollback);
+    
+    rollback->snapshots = calloc(number_of_snapshots, sizeof(sm_snapshot));
+    rollback->capacity = number_of_snapshots;
+    assert(rollback->snapshots);
+    
+    return rollback;
+}
+
+void free_rollback(sm_rollback * const rollback) {
+    
+    for (unsigned i = 0; i < rollback->capacity; i++) free(rollback->snapshots[i].data);
+    
+    free(rollback->snapshots);
+    free(rollback);
+}
+
+const sm_snapshot *save_rollback(sm_rollback *rollback, const sm_space * const space, const unsigned frame) {
+    
+    rollback->newest = rollback->number_of_snapshots ? (rollback->newest + 1) % rollback->capacity : 0;
+    
+    if (rollback->number_of_snapshots < rollback->capacity) rollback->number_of_snapshots++;
+    
+    sm_snapshot *snapshot = &rollback->snapshots[rollback->newest];
+    
+    save_snapshot(space, snapshot, frame);
+    
+    return snapshot;
+}
+
+const sm_snapshot *rollback_snapshot(const sm_rollback *rollback, const unsigned frame) {
+    
+    // Newest first, since rollbacks are usually short
+    for (unsigned i = 0; i < rollback->number_of_snapshots; i++) {
+        
+        const sm_snapshot *snapshot = &rollback->snapshots[(rollback->newest + rollback->capacity - i) % rollback->capacity];
+        
+        if (snapshot->frame == frame) return snapshot;
+    }
+    
+    return 0;
+}
+
+int rollback_to(sm_rollback *rollback, sm_space * const space, const unsigned frame) {
+    
+    const sm_snapshot *snapshot = rollback_snapshot(rollback, frame);
+    
+    if (!snapshot) return 0;
+    
+    restore_snapshot(space, snapshot);
+    
+    // Later frames are about to be stepped again, so forget them
+    while (&rollback->snapshots[rollback->newest] != snapshot) {
+        
+        rollback->newest = (rollback->newest + rollback->capacity - 1) % rollback->capacity;
+        rollback->number_of_snapshots--;
+    }
+    
+    return 1;
+}
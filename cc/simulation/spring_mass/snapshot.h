@@ -0,0 +1,59 @@
+//
+//  snapshot.h
+//  spring_mass
+//
+//  Created by Richard Henry on 19/10/2026.
+//  Copyright 2026 Dogstar Diversions. http://www.dogstar.mobi
+//
+
+#ifndef SM_SNAPSHOT_H
+#define SM_SNAPSHOT_H
+
+#include "space.h"
+
+// Everything stepping changes in a space, packed into one buffer. A snapshot can only be
+// restored into the space it came from while the same masses, springs, planes and bodies are
+// in it, and mixed_precision is as it was.
+typedef struct {
+    
+    unsigned char   *data;
+    size_t          size;
+    size_t          capacity;
+    
+    unsigned        frame;
+    unsigned        checksum;
+    
+} sm_snapshot;
+
+// The last few snapshots for rolling back, oldest overwritten first
+typedef struct {
+    
+    sm_snapshot     *snapshots;
+    unsigned        number_of_snapshots;
+    unsigned        capacity;
+    unsigned        newest;
+    
+} sm_rollback;
+
+sm_snapshot *new_snapshot(void);
+void free_snapshot(sm_snapshot * const snapshot);
+
+void save_snapshot(const sm_space * const space, sm_snapshot *snapshot, const unsigned frame);
+void restore_snapshot(sm_space * const space, const sm_snapshot *snapshot);
+
+// Hash of the positions and velocities, the same on every machine that steps the same way
+unsigned space_checksum(const sm_space * const space);
+
+sm_rollback *new_rollback(const unsigned number_of_snapshots);
+void free_rollback(sm_rollback * const rollback);
+
+// Saves the space as the given frame, reusing the oldest snapshot's memory
+const sm_snapshot *save_rollback(sm_rollback *rollback, const sm_space * const space, const unsigned frame);
+
+// The snapshot for a frame if it is still held, or null
+const sm_snapshot *rollback_snapshot(const sm_rollback *rollback, const unsigned frame);
+
+// Restores a held frame, returning zero if it has already been overwritten
+int rollback_to(sm_rollback *rollback, sm_space * const space, const unsigned frame);
+
+#endif
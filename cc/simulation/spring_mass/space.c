@@ -7,18 +7,57 @@
 //
 
 #include "space.h"
-#include <stdlib.h>
-#include <assert.h>
+#include "simd.h"
+#include "recorder.h"
+#include "body.h"
+#include "contact.h"
+#include "sweep.h"
+
+#define PLANE_BLOCK_SIZE 64
+#define SM_POOL_CHUNK 1024
+
+// Factors applied by integrate_masses, for one frame or for a timestep h. The other
+// integrators only use h, and RK4 the stage it is on.
+typedef struct {
+    
+    sm_space    *space;
+    float       v_factor, a_factor, dv_factor;
+    float       h;
+    unsigned    stage;
+    
+} integration;
 
 static void calculate_spring_forces(sm_space *space);
 static void resolve_object_to_object_collisions(sm_space *space);
-static void resolve_object_to_plane_collisions(sm_space *space);
+static void record_contact(sm_space *space, const sm_mass *mass_i, const sm_mass *mass_j, const vec2 normal, const float distance, const float impulse);
+static void integrate_masses(void *context, const unsigned begin, const unsigned end);
+static void integrate_semi_implicit(void *context, const unsigned begin, const unsigned end);
+static void verlet_drift(void *context, const unsigned begin, const unsigned end);
+static void verlet_kick(void *context, const unsigned begin, const unsigned end);
+static void integrate_semi_implicit_wide(void *context, const unsigned begin, const unsigned end);
+static void verlet_drift_wide(void *context, const unsigned begin, const unsigned end);
+static void verlet_kick_wide(void *context, const unsigned begin, const unsigned end);
+static void rk4_begin(void *context, const unsigned begin, const unsigned end);
+static void rk4_stage(void *context, const unsigned begin, const unsigned end);
+static void solve_spring_constraints(sm_space *space, const float h);
+static void begin_islands(sm_space *space);
+static void update_islands(sm_space *space);
+static void settle_islands(sm_space *space, int changed);
+static void resolve_object_to_plane_collisions(void *context, const unsigned begin, const unsigned end);
+
+// RK4 keeps the starting state, the held forces and the weighted sums of the stage derivatives
+static inline vec2 *rk4_array(const sm_space *space, const unsigned which) {
+    
+    return &space->integration_scratch[(size_t)which * (space->masses_end - space->masses)];
+}
+
+enum { RK4_POS, RK4_VEL, RK4_FRC, RK4_SUM_POS, RK4_SUM_VEL };
 
 #pragma mark Space management
 
 sm_space *new_space(const unsigned max_masses, const unsigned max_springs, const unsigned max_planes) {
 
-    sm_space *space = malloc(sizeof(sm_space));
+    sm_space *space = calloc(1, sizeof(sm_space));
     assert(space);
 
     space->friction = 0.04;
@@ -26,26 +65,85 @@ sm_space *new_space(const unsigned max_masses, const unsigned max_springs, const
     space->a_factor = 0.0004;
     space->separation_force = 1.0;
 
-    space->masses = calloc(max_masses, sizeof(sm_mass *));
-    space->springs = calloc(max_springs, sizeof(sm_spring *));
-    space->planes = calloc(max_planes, sizeof(sm_plane *));
-    assert(space->masses && space->springs && space->planes);
-
-    space->masses_end = &space->masses[max_masses];
-    space->springs_end = &space->springs[max_springs];
-    space->planes_end = &space->planes[max_planes];
+    space->timestep = 1.0 / 60.0;
+    space->interpolation = 1.0;
+    space->max_steps = 8;
+    space->integrator = SM_EXPLICIT_EULER;
+    space->constraint_solver = SM_GAUSS_SEIDEL;
+    space->constraint_iterations = 4;
+    space->sleep_steps = 60;
+    space->contact_solver = SM_SINGLE_PASS_IMPULSES;
+    space->contact_iterations = 8;
+    
+    space->mass_slots = new_slots(0);
+    space->spring_slots = new_slots(0);
+    space->plane_slots = new_slots(0);
 
-    space->number_of_masses = 0;
-    space->number_of_springs = 0;
-    space->number_of_planes = 0;
+    space->mass_pool = new_pool(sizeof(sm_mass), SM_POOL_CHUNK);
+    space->plane_pool = new_pool(sizeof(sm_plane), SM_POOL_CHUNK);
 
     space->mass_collision_callback = 0;
 
+    space->workers = 0;
+
+    space->springs_dirty = 1;
+    space->masses_dirty = 1;
+
+    // The maximums are only a starting point, the space grows as needed
+    reserve_space(space, max_masses, max_springs, max_planes);
+
     return space;
 }
 
 void free_space(sm_space * const space) {
 
+    if (space->workers) free_workers(space->workers);
+
+    for (unsigned c = 0; c < space->number_of_collision_chunks; c++)
+        free(space->collision_chunks[c].pairs);
+
+    free(space->collision_chunks);
+    free(space->collision_keys);
+    free(space->collision_scratch);
+    free(space->collision_order);
+    free(space->mass_scratch);
+    free(space->mass_remap);
+    free(space->island_scratch);
+    free(space->vector_scratch);
+    free(space->spring_remap);
+    free(space->spring_scratch);
+    free(space->spring_incidence_offsets);
+    free(space->spring_incidence);
+    free(space->wide_spring_forces);
+    free(space->spring_forces);
+    free(space->contacts);
+    free(space->contact_impulses);
+    free(space->contact_impulse_scratch);
+    free(space->contact_constraints);
+    free(space->body_members);
+    free(space->bodies);
+    free(space->island_asleep);
+    free(space->island_rest);
+    free(space->island_parents);
+    free(space->rest_steps);
+    free(space->spring_colors);
+    free(space->spring_color_order);
+    free(space->spring_lambdas);
+    free(space->mass_weights);
+    free(space->integration_scratch);
+    free(space->mass_external_forces);
+    free(space->wide_mass_forces);
+    free(space->mass_forces);
+    free(space->mass_velocities);
+    free(space->mass_positions);
+
+    free_pool(space->plane_pool);
+    free_pool(space->mass_pool);
+
+    free_slots(space->plane_slots);
+    free_slots(space->spring_slots);
+    free_slots(space->mass_slots);
+
     free(space->masses);
     free(space->springs);
     free(space->planes);
@@ -53,322 +151,1939 @@ void free_space(sm_space * const space) {
     free(space);
 }
 
+#pragma mark Capacity
+
+static inline unsigned mass_capacity(const sm_space *space) { return (unsigned)(space->masses_end - space->masses); }
+static inline unsigned spring_capacity(const sm_space *space) { return (unsigned)(space->springs_end - space->springs); }
+static inline unsigned plane_capacity(const sm_space *space) { return (unsigned)(space->planes_end - space->planes); }
+
+static void reserve_masses(sm_space *space, const unsigned capacity) {
+
+    if (capacity <= mass_capacity(space)) return;
+
+    space->masses = resize_array(space->masses, capacity, sizeof(sm_mass *));
+    space->masses_end = &space->masses[capacity];
+
+    space->mass_positions = resize_array(space->mass_positions, capacity, sizeof(vec2));
+    space->mass_velocities = resize_array(space->mass_velocities, capacity, sizeof(vec2));
+    space->mass_forces = resize_array(space->mass_forces, capacity, sizeof(vec2));
+    space->wide_mass_forces = resize_array(space->wide_mass_forces, capacity * 2, sizeof(double));
+    space->mass_external_forces = resize_array(space->mass_external_forces, capacity, sizeof(vec2));
+    space->integration_scratch = resize_array(space->integration_scratch, capacity * 5, sizeof(vec2));
+    space->mass_weights = resize_array(space->mass_weights, capacity, sizeof(float));
+    space->rest_steps = resize_array(space->rest_steps, capacity, sizeof(unsigned));
+    space->island_parents = resize_array(space->island_parents, capacity, sizeof(unsigned));
+    space->island_rest = resize_array(space->island_rest, capacity, sizeof(unsigned));
+    space->island_asleep = resize_array(space->island_asleep, capacity, sizeof(unsigned char));
+    space->spring_incidence_offsets = resize_array(space->spring_incidence_offsets, capacity + 1, sizeof(unsigned));
+    space->mass_scratch = resize_array(space->mass_scratch, capacity, sizeof(sm_mass *));
+    space->mass_remap = resize_array(space->mass_remap, capacity, sizeof(unsigned));
+    space->island_scratch = resize_array(space->island_scratch, capacity * 2, sizeof(unsigned));
+    space->vector_scratch = resize_array(space->vector_scratch, capacity, sizeof(vec2));
+    space->collision_order = resize_array(space->collision_order, capacity, sizeof(unsigned));
+    space->collision_scratch = resize_array(space->collision_scratch, capacity, sizeof(unsigned));
+    space->collision_keys = resize_array(space->collision_keys, capacity, sizeof(float));
+
+    // New chunks start with no pairs
+    const unsigned number_of_chunks = sweep_chunks(capacity);
+
+    space->collision_chunks = resize_array_zeroed(space->collision_chunks, space->number_of_collision_chunks, number_of_chunks, sizeof(sm_pair_list));
+    space->number_of_collision_chunks = number_of_chunks;
+
+    reserve_slots(space->mass_slots, capacity);
+}
+
+static void reserve_springs(sm_space *space, const unsigned capacity) {
+
+    if (capacity <= spring_capacity(space)) return;
+
+    space->springs = resize_array(space->springs, capacity, sizeof(sm_spring));
+    space->springs_end = &space->springs[capacity];
+
+    space->spring_forces = resize_array(space->spring_forces, capacity, sizeof(vec2));
+    space->wide_spring_forces = resize_array(space->wide_spring_forces, capacity * 2, sizeof(double));
+    space->spring_incidence = resize_array(space->spring_incidence, capacity * 2, sizeof(unsigned));
+    space->spring_lambdas = resize_array(space->spring_lambdas, capacity, sizeof(float));
+    space->spring_color_order = resize_array(space->spring_color_order, capacity, sizeof(unsigned));
+    space->spring_colors = resize_array(space->spring_colors, capacity, sizeof(unsigned char));
+    space->spring_remap = resize_array(space->spring_remap, capacity, sizeof(unsigned));
+    space->spring_scratch = resize_array(space->spring_scratch, capacity, sizeof(sm_spring));
+
+    reserve_slots(space->spring_slots, capacity);
+}
+
+static void reserve_planes(sm_space *space, const unsigned capacity) {
+
+    if (capacity <= plane_capacity(space)) return;
+
+    space->planes = resize_array(space->planes, capacity, sizeof(sm_plane *));
+    space->planes_end = &space->planes[capacity];
+
+    reserve_slots(space->plane_slots, capacity);
+}
+
+void reserve_space(sm_space * const space, const unsigned masses, const unsigned springs, const unsigned planes) {
+
+    reserve_masses(space, masses);
+    reserve_springs(space, springs);
+    reserve_planes(space, planes);
+}
+
+static inline size_t slots_bytes(const sm_slots *slots) { return slots->capacity * 3 * sizeof(unsigned); }
+
+void report_space_memory(const sm_space * const space, sm_memory_report *report) {
+
+    const unsigned masses = mass_capacity(space), springs = spring_capacity(space), planes = plane_capacity(space);
+
+    report->masses.count = space->number_of_masses;
+    report->masses.capacity = masses;
+    report->masses.bytes = masses * (sizeof(sm_mass *) * 2 + sizeof(vec2) * 10 + sizeof(double) * 2 + sizeof(unsigned) * 9 + sizeof(float) * 2 + 1) + slots_bytes(space->mass_slots) + pool_bytes(space->mass_pool);
+
+    report->springs.count = space->number_of_springs;
+    report->springs.capacity = springs;
+    report->springs.bytes = springs * (sizeof(sm_spring) * 2 + sizeof(vec2) + sizeof(double) * 2 + sizeof(unsigned) * 4 + sizeof(float) + 1) + slots_bytes(space->spring_slots);
+
+    report->planes.count = space->number_of_planes;
+    report->planes.capacity = planes;
+    report->planes.bytes = planes * sizeof(sm_plane *) + slots_bytes(space->plane_slots) + pool_bytes(space->plane_pool);
+
+    report->broad_phase.count = report->broad_phase.capacity = 0;
+    report->broad_phase.bytes = space->number_of_collision_chunks * sizeof(sm_pair_list) + space->contact_capacity * sizeof(sm_contact);
+
+    for (unsigned c = 0; c < space->number_of_collision_chunks; c++) {
+
+        report->broad_phase.count += space->collision_chunks[c].number_of_pairs;
+        report->broad_phase.capacity += space->collision_chunks[c].capacity;
+        report->broad_phase.bytes += space->collision_chunks[c].capacity * sizeof(sm_pair);
+    }
+
+    report->total = sizeof(sm_space) + report->masses.bytes + report->springs.bytes + report->planes.bytes + report->broad_phase.bytes;
+}
+
+void reset_space(sm_space * const space) {
+
+    // Drop every object at once, keeping all the memory for the next scene
+    space->number_of_masses = space->number_of_springs = space->number_of_planes = 0;
+    space->number_of_awake_masses = space->number_of_awake_springs = 0;
+
+    // Masses from elsewhere are free again
+    for (unsigned m = 0; m < space->number_of_body_members; m++) space->body_members[m].mass->body = 0;
+
+    space->number_of_bodies = space->number_of_body_members = 0;
+    space->number_of_contact_constraints = space->number_of_contact_impulses = 0;
+    
+    reset_slots(space->mass_slots);
+    reset_slots(space->spring_slots);
+    reset_slots(space->plane_slots);
+
+    reset_pool(space->mass_pool);
+    reset_pool(space->plane_pool);
+
+    for (unsigned c = 0; c < space->number_of_collision_chunks; c++)
+        space->collision_chunks[c].number_of_pairs = 0;
+
+    space->masses_dirty = space->springs_dirty = 1;
+}
+
+void set_space_threads(sm_space * const space, const unsigned number_of_threads) {
+
+    if (space->workers) {
+
+        if (space->workers->number_of_threads == number_of_threads) return;
+
+        free_workers(space->workers);
+        space->workers = 0;
+    }
+
+    if (number_of_threads > 1) space->workers = new_workers(number_of_threads);
+}
+
 #pragma mark Simulation step
 
-void step_space(sm_space * const space) {
+// Adds the velocity change this step's forces will make, over kick seconds, to the awake free masses
+static void kick_free_masses(sm_space * const space, const float kick) {
+    
+    for (unsigned m = 0; m < space->number_of_awake_masses; m++) {
+        
+        sm_mass *mass = space->masses[m];
+        
+        if (!mass->body) mass->vel = vec2Add(mass->vel, vec2Multiply(mass->frc, kick / mass->mass));
+    }
+}
+
+static void solve_mass_contacts(sm_space * const space, const float h, const float kick) {
     
-    calculate_spring_forces(space);
+    // Planes hold the piles up, so they are constraints too
+    if (space->number_of_planes) add_plane_constraints(space, 0);
     
-    resolve_object_to_object_collisions(space);
+    // The integrator adds this step's forces after the solve, so solve against the velocities
+    // the masses will end with, then take the forces back off for the integrator to add
+    kick_free_masses(space, kick);
+    solve_contact_constraints(space, h, 0);
+    kick_free_masses(space, -kick);
     
-    // Calculate mass effect
-    for (sm_mass **p = space->masses; p < space->masses_end; p++) {
+    if (!space->record_contacts) return;
+    
+    for (const sm_contact_constraint *contact = space->contact_constraints; contact < space->contact_constraints + space->number_of_contact_constraints; contact++) {
         
-        sm_mass *mass = *p;
+        if (contact->body1 != SM_NO_INDEX || !contact->mass2) continue;
         
-        if (mass) {
-            
-            assert(mass->mass > 0.0);
-            
-            float massTimesFriction = mass->mass * space->friction;
-            
-            // a' = f / m
-            mass->acc = vec2Multiply(vec2Subtract(mass->frc, vec2Multiply(mass->vel, massTimesFriction)), 1.0 / mass->mass);
-            // s' = ut + 0.5at^2
-            mass->pos = vec2Add(mass->pos, vec2Add(vec2Multiply(mass->vel, space->v_factor), vec2Multiply(mass->acc, space->a_factor)));
-            // v' = v + a
-            mass->vel = vec2Add(mass->vel, mass->acc);
-            
-        } else break;
+        const float distance = contact->mass1->radius + contact->mass2->radius - contact->depth;
+        
+        record_contact(space, contact->mass1, contact->mass2, contact->normal, distance, -contact->normal_impulse);
     }
-    
-    resolve_object_to_plane_collisions(space);
 }
 
-#pragma mark Mass management
+// The integrator that follows adds kick seconds of the forces to the velocities
+static void resolve_collisions(sm_space * const space, const float h, const float kick) {
+    
+    // Sleeping masses only collide with awake ones
+    if (!space->number_of_awake_masses) return;
+    
+    resolve_object_to_object_collisions(space);
+    
+    // Contacts between free masses are solved together once they have all been found
+    if (space->contact_solver == SM_SEQUENTIAL_IMPULSES) solve_mass_contacts(space, h, kick);
+}
 
-void add_mass_to_space(sm_space *space, sm_mass *mass) {
+static void run_step(sm_space * const space, integration * const factors) {
     
-    for (sm_mass **p = space->masses; p < space->masses_end; p++) {
+    const unsigned n = space->number_of_awake_masses;
+    double clock = phase_clock(space->profile);
+    
+    space->number_of_contact_constraints = 0;
+    
+    if (space->number_of_bodies) {
         
-        assert(*p != mass);
+        // Bodies have no per frame factors to move with, and XPBD springs never reach the
+        // forces bodies gather
+        assert(space->integrator != SM_EXPLICIT_EULER && space->integrator != SM_XPBD);
         
-        if (!*p) {
+        begin_bodies(space);
+    }
+    
+    switch (space->integrator) {
             
-            *p = mass;
-            space->number_of_masses++;
+        case SM_EXPLICIT_EULER:
+            calculate_spring_forces(space);
+            clock = end_phase(space->phase_times, space->profile, SM_PHASE_SPRINGS, clock);
+            resolve_collisions(space, factors->h, factors->dv_factor);
+            clock = end_phase(space->phase_times, space->profile, SM_PHASE_COLLISIONS, clock);
+            run_workers(space->workers, integrate_masses, factors, n);
+            clock = end_phase(space->phase_times, space->profile, SM_PHASE_INTEGRATION, clock);
+            break;
             
-            // Initialise the mass' contents
-            mass->pos = (vec2) { 0, 0 };
-            mass->vel = (vec2) { 0, 0 };
-            mass->acc = (vec2) { 0, 0 };
-            mass->frc = (vec2) { 0, 0 };
+        case SM_SEMI_IMPLICIT_EULER:
+            calculate_spring_forces(space);
+            clock = end_phase(space->phase_times, space->profile, SM_PHASE_SPRINGS, clock);
+            resolve_collisions(space, factors->h, factors->h);
+            clock = end_phase(space->phase_times, space->profile, SM_PHASE_COLLISIONS, clock);
+            run_workers(space->workers, space->mixed_precision ? integrate_semi_implicit_wide : integrate_semi_implicit, factors, n);
+            clock = end_phase(space->phase_times, space->profile, SM_PHASE_INTEGRATION, clock);
+            break;
             
-            mass->e = 1.0;
-            mass->mass = 1.0;
-            mass->radius = 0.5;
+        case SM_VELOCITY_VERLET:
+            // Drift on the last acceleration, then kick with the new one
+            run_workers(space->workers, space->mixed_precision ? verlet_drift_wide : verlet_drift, factors, n);
+            clock = end_phase(space->phase_times, space->profile, SM_PHASE_INTEGRATION, clock);
+            calculate_spring_forces(space);
+            clock = end_phase(space->phase_times, space->profile, SM_PHASE_SPRINGS, clock);
+            resolve_collisions(space, factors->h, 0.5 * factors->h);
+            clock = end_phase(space->phase_times, space->profile, SM_PHASE_COLLISIONS, clock);
+            run_workers(space->workers, space->mixed_precision ? verlet_kick_wide : verlet_kick, factors, n);
+            clock = end_phase(space->phase_times, space->profile, SM_PHASE_INTEGRATION, clock);
+            break;
             
-            mass->collision_mask = 0;
-            mass->collision_type = 0;
+        case SM_RK4:
+            // Collisions happen once at the start, their forces held through the stages
+            resolve_collisions(space, factors->h, factors->h);
+            clock = end_phase(space->phase_times, space->profile, SM_PHASE_COLLISIONS, clock);
+            run_workers(space->workers, rk4_begin, factors, n);
+            clock = end_phase(space->phase_times, space->profile, SM_PHASE_INTEGRATION, clock);
+        
+            for (factors->stage = 0; factors->stage < 4; factors->stage++) {
             
-            mass->user_data = 0;
+                calculate_spring_forces(space);
+                clock = end_phase(space->phase_times, space->profile, SM_PHASE_SPRINGS, clock);
+                run_workers(space->workers, rk4_stage, factors, n);
+                clock = end_phase(space->phase_times, space->profile, SM_PHASE_INTEGRATION, clock);
+            }
+            break;
             
+        case SM_XPBD:
+            resolve_collisions(space, factors->h, factors->h);
+            clock = end_phase(space->phase_times, space->profile, SM_PHASE_COLLISIONS, clock);
+            solve_spring_constraints(space, factors->h);
+            clock = end_phase(space->phase_times, space->profile, SM_PHASE_SPRINGS, clock);
             break;
-        }
     }
-}
-
-void remove_mass_from_space(sm_space *space, sm_mass *mass) {
     
-    int mass_found = 0;
-    
-    for (sm_mass **p = space->masses; p < space->masses_end; p++) {
+    // Bodies follow the masses, with the contacts their masses found
+    if (space->number_of_bodies && factors->h > 0) {
         
-        if (*p == mass) {
-            
-            // Remove the mass if we find it
-            assert(!mass_found && space->number_of_masses > 0);
-            
-            *p = 0;
-            space->number_of_masses--;
-            mass_found = 1;
-            
-        } else if (mass_found) {
-            
-            // Compact the array
-            *(p - 1) = *p;
-            *p = 0;
-        }
+        step_bodies(space, factors->h);
+        clock = end_phase(space->phase_times, space->profile, SM_PHASE_INTEGRATION, clock);
     }
     
-    assert(mass_found);
-}
-
-#pragma mark Spring management
-
-void add_spring_to_space(sm_space *space, sm_spring *spring) {
+    // Pairs that stopped touching drop out of the warm start
+    if (space->number_of_contact_constraints || space->number_of_contact_impulses) keep_contact_impulses(space);
     
-    for (sm_spring **p = space->springs; p < space->springs_end; p++) {
+    // Planes are tested a block of the broad phase order at a time, unless the contact solver
+    // has already held the masses off them
+    if (n && space->number_of_planes && space->contact_solver == SM_SINGLE_PASS_IMPULSES) {
         
-        assert(*p != spring);
-        
-        if (!*p) {
-            
-            *p = spring;
-            space->number_of_springs++;
-            
-            spring->k = 1.0;
-            spring->l = 1.0;
-            spring->f = 0.0;
-            spring->mass1 = 0;
-            spring->mass2 = 0;
-            
-            break;
-        }
+        run_workers(space->workers, resolve_object_to_plane_collisions, space, (space->number_of_masses + PLANE_BLOCK_SIZE - 1) / PLANE_BLOCK_SIZE);
+        end_phase(space->phase_times, space->profile, SM_PHASE_PLANES, clock);
     }
 }
 
-void remove_spring_from_space(sm_space *space, sm_spring *spring) {
+static void hold_external_forces(void *context, const unsigned begin, const unsigned end) {
     
-    int spring_found = 0;
+    sm_space *space = context;
     
-    for (sm_spring **s = space->springs; s < space->springs_end; s++) {
-        
-        if (*s == spring) {
-            
-            // Remove the spring if we find it
-            assert(!spring_found && space->number_of_springs > 0);
-            
-            *s = 0;
-            space->number_of_springs--;
-            spring_found = 1;
-            
-        } else if (spring_found) {
-            
-            // Compact the array
-            *(s - 1) = *s;
-            *s = 0;
-        }
-    }
+    for (unsigned m = begin; m < end; m++) space->mass_external_forces[m] = space->masses[m]->frc;
+}
+
+static void restore_external_forces(void *context, const unsigned begin, const unsigned end) {
+    
+    sm_space *space = context;
     
-    assert(spring_found);
+    for (unsigned m = begin; m < end; m++) space->masses[m]->frc = space->mass_external_forces[m];
 }
 
-#pragma mark Plane management
+static void save_previous_positions(void *context, const unsigned begin, const unsigned end) {
+    
+    sm_space *space = context;
+    
+    for (unsigned m = begin; m < end; m++) space->masses[m]->prev = space->masses[m]->pos;
+}
 
-void add_plane_to_space(sm_space *space, sm_plane *plane) {
+static void clear_forces(void *context, const unsigned begin, const unsigned end) {
     
-    for (sm_plane **p = space->planes; p < space->planes_end; p++) {
+    sm_space *space = context;
+    
+    for (unsigned m = begin; m < end; m++) space->masses[m]->frc = (vec2) { 0, 0 };
+}
+
+void step_space(sm_space * const space) {
+    
+    space->number_of_contacts = 0;
+    
+    if (space->integrator == SM_EXPLICIT_EULER) {
         
-        assert(*p != plane);
+        // One frame with the space's own factors
+        integration factors = { space, space->v_factor, space->a_factor, 1.0 };
         
-        if (!*p) {
-            
-            *p = plane;
-            space->number_of_planes++;
-            break;
-        }
+        begin_islands(space);
+        run_step(space, &factors);
+        update_islands(space);
+        
+    } else {
+        
+        const float h = space->timestep;
+        integration factors = { space, h, 0.5 * h * h, h, h };
+        
+        run_workers(space->workers, hold_external_forces, space, space->number_of_awake_masses);
+        begin_islands(space);
+        run_step(space, &factors);
+        update_islands(space);
+        
+        // Masses that fell asleep in the step are past the awake ones now
+        run_workers(space->workers, clear_forces, space, space->number_of_masses);
     }
+    
+    if (space->recorder) record_space(space->recorder, space);
+    
+    space->interpolation = 1.0;
 }
 
-void remove_plane_from_space(sm_space *space, sm_plane *plane) {
+void step_space_dt(sm_space * const space, const float dt, const unsigned substeps) {
     
-    int plane_found = 0;
+    assert(space->timestep > 0.0 && substeps > 0);
     
-    for (sm_plane **p = space->planes; p < space->planes_end; p++) {
+    space->number_of_contacts = 0;
+    
+    const float h = space->timestep / substeps;
+    integration factors = { space, h, 0.5 * h * h, h, h };
+    
+    space->accumulator += dt;
+    
+    if (space->accumulator >= space->timestep) {
+        
+        run_workers(space->workers, hold_external_forces, space, space->number_of_awake_masses);
         
-        if (*p == plane) {
+        for (unsigned steps = 0; space->accumulator >= space->timestep; steps++) {
+            
+            // Drop the time we cannot catch up on rather than falling further behind
+            if (steps == space->max_steps) {
+                
+                space->accumulator = 0.0;
+                break;
+            }
+            
+            space->accumulator -= space->timestep;
             
-            // Remove the plane if we find it
-            assert(!plane_found);
+            // The start of each fixed step is what rendering interpolates from
+            run_workers(space->workers, save_previous_positions, space, space->number_of_awake_masses);
+            begin_islands(space);
             
-            *p = 0;
-            space->number_of_planes--;
-            plane_found = 1;
+            for (unsigned s = 0; s < substeps; s++) {
+                
+                run_workers(space->workers, restore_external_forces, space, space->number_of_awake_masses);
+                run_step(space, &factors);
+            }
             
-        } else if (plane_found) {
+            update_islands(space);
             
-            // Compact the array
-            *(p - 1) = *p;
-            *p = 0;
+            if (space->recorder) record_space(space->recorder, space);
         }
+        
+        run_workers(space->workers, clear_forces, space, space->number_of_masses);
     }
     
-    assert(plane_found);
+    space->interpolation = space->accumulator / space->timestep;
 }
 
-#pragma mark Calculations
+vec2 interpolated_mass_position(const sm_space * const space, const sm_mass * const mass) {
+    
+    return vec2Add(mass->prev, vec2Multiply(vec2Subtract(mass->pos, mass->prev), space->interpolation));
+}
 
-static void calculate_spring_forces(sm_space *space) {
+void interpolate_space_positions(const sm_space * const space, vec2 *positions) {
+    
+    for (unsigned m = 0; m < space->number_of_masses; m++)
+        positions[m] = interpolated_mass_position(space, space->masses[m]);
+}
 
-    // Calculate spring forces
-    for (unsigned i = 0; i < space->number_of_springs; i++) {
+double space_energy(const sm_space * const space) {
+    
+    double energy = 0;
+    
+    for (unsigned m = 0; m < space->number_of_masses; m++) {
         
-        sm_spring *spring = space->springs[i];
-        assert(spring);
+        const sm_mass *mass = space->masses[m];
         
-        sm_mass *mass1 = spring->mass1, *mass2 = spring->mass2;
-        assert(mass1 && mass2);
+        energy += 0.5 * mass->mass * ((double)mass->vel.x * mass->vel.x + (double)mass->vel.y * mass->vel.y);
+    }
+    
+    for (const sm_spring *spring = space->springs; spring < space->springs + space->number_of_springs; spring++) {
         
-        if (mass1 && mass2) {
-            
-            vec2    d = vec2Subtract(mass1->pos, mass2->pos);
-            float   l = vec2Length(d);
-            
-            if (l) {
-                
-                // Calculate spring force
-                vec2 forceVector = vec2Multiply(vec2Multiply(d, -1.0 / l), (l - spring->l) * spring->k);
-                
-                // Subtract spring friction
-                forceVector = vec2Add(forceVector, vec2Multiply(vec2Subtract(mass1->vel, mass2->vel), -spring->f));
-                
-                mass1->frc = vec2Add(mass1->frc, forceVector);
-                mass2->frc = vec2Subtract(mass2->frc, forceVector);
-            }
-        }
+        const vec2      d = vec2Subtract(space->masses[spring->mass1]->pos, space->masses[spring->mass2]->pos);
+        const double    extension = sqrt((double)d.x * d.x + (double)d.y * d.y) - spring->l;
+        
+        energy += 0.5 * spring->k * extension * extension;
     }
+    
+    return energy;
 }
 
-static int collision_sort_x_space_compare(const void *e1, const void *e2) {
+#pragma mark Mass management
 
-    const sm_mass *mass1 = *(const sm_mass * const *)e1;
-    const sm_mass *mass2 = *(const sm_mass * const *)e2;
-    const float m1min = mass1->pos.x - mass1->radius;
-    const float m2min = mass2->pos.x - mass2->radius;
+static inline int mass_in_space(const sm_space *space, const sm_mass *mass) {
+    
+    return mass->index < space->number_of_masses && space->masses[mass->index] == mass;
+}
 
-    if (m1min == m2min) return 0;
+sm_handle add_mass_to_space(sm_space *space, sm_mass *mass) {
+    
+    assert(!mass_in_space(space, mass));
+    
+    if (space->masses + space->number_of_masses == space->masses_end)
+        reserve_masses(space, grown_capacity(mass_capacity(space), space->number_of_masses + 1));
+    
+    const unsigned index = space->number_of_masses++;
+    
+    space->masses[index] = mass;
+    space->masses_dirty = space->springs_dirty = 1;
+    
+    // Initialise the mass' contents
+    mass->pos = (vec2) { 0, 0 };
+    mass->vel = (vec2) { 0, 0 };
+    mass->acc = (vec2) { 0, 0 };
+    mass->frc = (vec2) { 0, 0 };
+    mass->prev = (vec2) { 0, 0 };
+    mass->pos_error = (vec2) { 0, 0 };
+    mass->vel_error = (vec2) { 0, 0 };
+    
+    mass->e = 1.0;
+    mass->mass = 1.0;
+    mass->radius = 0.5;
+    
+    mass->collision_mask = 0;
+    mass->collision_type = 0;
+    mass->index = index;
+    mass->number_of_springs = 0;
+    mass->body = 0;
+    
+    mass->user_data = 0;
+    wake_space(space);
+    
+    return take_slot(space->mass_slots, index);
+}
 
-    return (m1min > m2min) ? 1 : -1;
+void add_masses_to_space(sm_space *space, sm_mass * const *masses, const unsigned count, sm_handle *handles) {
+    
+    if (space->number_of_masses + count > mass_capacity(space))
+        reserve_masses(space, grown_capacity(mass_capacity(space), space->number_of_masses + count));
+    
+    for (unsigned i = 0; i < count; i++) {
+        
+        const sm_handle handle = add_mass_to_space(space, masses[i]);
+        
+        if (handles) handles[i] = handle;
+    }
 }
 
-static inline float vec2LengthSquared(const vec2 v) { return vec2DotProduct(v, v); }
+void remove_mass_from_space(sm_space *space, sm_mass *mass) {
+    
+    remove_masses_from_space(space, &mass, 1);
+}
 
-static void resolve_object_to_object_collisions(sm_space *space) {
+static void remove_spring_at(sm_space *space, const unsigned index);
 
-    // Partition in x space
-    qsort(space->masses, space->number_of_masses, sizeof(sm_mass *), collision_sort_x_space_compare);
+void remove_masses_from_space(sm_space *space, sm_mass * const *masses, const unsigned count) {
     
-    // Detect and resolve object - object collisions
-    for (unsigned i = 0; i < space->number_of_masses; i++) {
+    const unsigned  number_of_masses = space->number_of_masses;
+    int             renumber = 0;
+    
+    // Springs only need renumbering when a removed mass, or one that could be moved into a gap, has any
+    for (unsigned i = 0; i < count; i++) {
         
-        sm_mass *mass_i = space->masses[i];
+        assert(mass_in_space(space, masses[i]));
         
-        for (unsigned j = i + 1; j < space->number_of_masses; j++) {
-            
-            sm_mass *mass_j = space->masses[j];
+        // Bodies keep their masses until reset_space
+        assert(!masses[i]->body);
+        
+        if (masses[i]->number_of_springs) renumber = 1;
+    }
+    
+    for (unsigned i = count < number_of_masses ? number_of_masses - count : 0; i < number_of_masses; i++)
+        if (space->masses[i]->number_of_springs) renumber = 1;
+    
+    // Remember where everything was
+    sm_mass **old_masses = space->mass_scratch;
+    
+    if (renumber) memcpy(old_masses, space->masses, number_of_masses * sizeof(sm_mass *));
+    
+    for (unsigned i = 0; i < count; i++) {
+        
+        sm_mass *mass = masses[i];
+        
+        // A mass given twice is already gone the second time
+        assert(mass->index != SM_NO_INDEX);
+        
+        const unsigned index = mass->index, last = --space->number_of_masses;
+        
+        release_slot(space->mass_slots, index);
+        
+        // Fill the gap from the end
+        if (index != last) {
             
-            // Collision mask reject
-            if (!(mass_i->collision_mask & mass_j->collision_type)) break;
+            space->masses[index] = space->masses[last];
+            space->masses[index]->index = index;
+            move_slot(space->mass_slots, last, index);
+        }
+        
+        mass->index = SM_NO_INDEX;
+    }
+    
+    if (renumber) {
+        
+        for (unsigned s = 0; s < space->number_of_springs;) {
             
-            // Partition reject
-            if (mass_i->pos.x + mass_i->radius < mass_j->pos.x - mass_j->radius) break;
+            sm_spring       *spring = &space->springs[s];
+            sm_mass         *mass1 = old_masses[spring->mass1], *mass2 = old_masses[spring->mass2];
             
-            vec2    collide_normal = vec2Subtract(mass_j->pos, mass_i->pos);
-            float   d_squared = vec2LengthSquared(collide_normal);
-            float   radius_sum = mass_i->radius + mass_j->radius;
+            spring->mass1 = mass1->index;
+            spring->mass2 = mass2->index;
             
-            // Compare distances squared
-            if (d_squared < radius_sum * radius_sum) {
-                
-                // Mass - mass collision callback
-                if (!space->mass_collision_callback || space->mass_collision_callback(mass_i, mass_j)) {
-                    
-                    float     l = vec2LengthSquared(collide_normal);
-                    
-                    if (l) {
-                        
-                        float   e = mass_i->e + mass_j->e;
-                        float   inverse_mass_sum = 1.0 / mass_i->mass + 1.0 / mass_j->mass;
-                        vec2    relative_velocity = vec2Multiply(vec2Subtract(mass_j->vel, mass_i->vel), e);
-                        
-                        // Calculate impulse
-                        collide_normal = vec2Normalize(collide_normal);
-                        float impulse = vec2DotProduct(relative_velocity, collide_normal) / inverse_mass_sum;
-                        
-                        if (impulse < 0) {
-                            
-                            // Calculate exit velocities
-                            mass_i->vel = vec2Add(mass_i->vel, vec2Multiply(collide_normal, impulse / mass_i->mass));
-                            mass_j->vel = vec2Add(mass_j->vel, vec2Multiply(collide_normal, -impulse / mass_j->mass));
-                            
-                        } else {
-                            
-                            // Calculate separation forces
-                            mass_i->frc = vec2Add(mass_i->frc, vec2Multiply(collide_normal, -space->separation_force));
-                            mass_j->frc = vec2Add(mass_j->frc, vec2Multiply(collide_normal, space->separation_force));
-                            
-                        }
-                    }
-                }
-            }
+            // The spring went with its mass, and the last spring moves into this one's place
+            if (mass1->index == SM_NO_INDEX || mass2->index == SM_NO_INDEX)
+                remove_spring_at(space, s);
+            else
+                s++;
         }
+        
+        for (unsigned i = 0; i < count; i++) masses[i]->number_of_springs = 0;
     }
+    
+    space->masses_dirty = space->springs_dirty = 1;
+    
+    wake_space(space);
+}
+
+sm_mass *space_mass(const sm_space *space, const sm_handle mass) {
+    
+    const unsigned index = slot_index(space->mass_slots, mass);
+    
+    return index == SM_NO_INDEX ? 0 : space->masses[index];
 }
 
-static void resolve_object_to_plane_collisions(sm_space *space) {
+#pragma mark Spring management
 
-    // Detect and resolve object - plane collisions
-    for (unsigned i = 0; i < space->number_of_masses; i++) {
-        
-        sm_mass *mass = space->masses[i];
+sm_handle add_spring_to_space(sm_space *space, const sm_spring spring) {
+    
+    assert(spring.mass1 < space->number_of_masses && spring.mass2 < space->number_of_masses);
+    
+    if (space->springs + space->number_of_springs == space->springs_end)
+        reserve_springs(space, grown_capacity(spring_capacity(space), space->number_of_springs + 1));
+    
+    const unsigned index = space->number_of_springs++;
+    
+    space->springs[index] = spring;
+    space->masses[spring.mass1]->number_of_springs++;
+    space->masses[spring.mass2]->number_of_springs++;
+    space->springs_dirty = 1;
+    wake_space(space);
+    
+    return take_slot(space->spring_slots, index);
+}
+
+void add_springs_to_space(sm_space *space, const sm_spring *springs, const unsigned count, sm_handle *handles) {
+    
+    if (space->number_of_springs + count > spring_capacity(space))
+        reserve_springs(space, grown_capacity(spring_capacity(space), space->number_of_springs + count));
+    
+    for (unsigned i = 0; i < count; i++) {
         
-        if (!mass) continue;
+        const sm_handle handle = add_spring_to_space(space, springs[i]);
         
-        for (unsigned j = 0; j < space->number_of_planes; j++) {
-            
-            sm_plane *plane = space->planes[j];
-            float      d = plane->d + vec2DotProduct(mass->pos, plane->normal);
-            
-            if (d < mass->radius) {
-                
-                float e = 1.0 + mass->e;
-                float impulse = vec2DotProduct(mass->vel, plane->normal) * e;
-                
-                if (impulse < 0)
-                    mass->vel = vec2Add(mass->vel, vec2Multiply(plane->normal, -impulse));
-            }
-        }
+        if (handles) handles[i] = handle;
     }
 }
 
+static void remove_spring_at(sm_space *space, const unsigned index) {
+    
+    const sm_spring *spring = &space->springs[index];
+    const unsigned  last = --space->number_of_springs;
+    
+    // Ends may already be gone when a mass takes its springs with it
+    if (spring->mass1 != SM_NO_INDEX) space->masses[spring->mass1]->number_of_springs--;
+    if (spring->mass2 != SM_NO_INDEX) space->masses[spring->mass2]->number_of_springs--;
+    
+    release_slot(space->spring_slots, index);
+    
+    // Fill the gap from the end
+    if (index != last) {
+        
+        space->springs[index] = space->springs[last];
+        move_slot(space->spring_slots, last, index);
+    }
+    
+    space->springs_dirty = 1;
+    
+    wake_space(space);
+}
+
+void remove_spring_from_space(sm_space *space, const sm_handle spring) {
+    
+    const unsigned index = slot_index(space->spring_slots, spring);
+    
+    assert(index != SM_NO_INDEX);
+    
+    if (index != SM_NO_INDEX) remove_spring_at(space, index);
+}
+
+void remove_springs_from_space(sm_space *space, const sm_handle *springs, const unsigned count) {
+    
+    for (unsigned i = 0; i < count; i++) remove_spring_from_space(space, springs[i]);
+}
+
+sm_spring *space_spring(const sm_space *space, const sm_handle spring) {
+    
+    const unsigned index = slot_index(space->spring_slots, spring);
+    
+    return index == SM_NO_INDEX ? 0 : &space->springs[index];
+}
+
+typedef struct {
+    
+    unsigned    key1, key2;
+    unsigned    index;
+    
+} sort_key;
+
+static int sort_key_compare(const void *e1, const void *e2) {
+    
+    const sort_key *key1 = e1, *key2 = e2;
+    
+    if (key1->key1 != key2->key1) return key1->key1 > key2->key1 ? 1 : -1;
+    if (key1->key2 != key2->key2) return key1->key2 > key2->key2 ? 1 : -1;
+    
+    return key1->index > key2->index ? 1 : -1;
+}
+
+void sort_space_springs(sm_space *space) {
+    
+    const unsigned n = space->number_of_springs;
+    
+    if (n < 2) return;
+    
+    sort_key    *keys = malloc(n * sizeof(sort_key));
+    unsigned    *remap = malloc(n * sizeof(unsigned));
+    sm_spring   *sorted = malloc(n * sizeof(sm_spring));
+    assert(keys && remap && sorted);
+    
+    for (unsigned i = 0; i < n; i++) {
+        
+        sm_spring *s = &space->springs[i];
+        
+        // A spring pulls the same both ways, so put the lower mass first
+        if (s->mass1 > s->mass2) {
+            
+            const unsigned m = s->mass1;
+            
+            s->mass1 = s->mass2;
+            s->mass2 = m;
+        }
+        
+        keys[i] = (sort_key) { s->mass1, s->mass2, i };
+    }
+    
+    qsort(keys, n, sizeof(sort_key), sort_key_compare);
+    
+    for (unsigned i = 0; i < n; i++) {
+        
+        sorted[i] = space->springs[keys[i].index];
+        remap[keys[i].index] = i;
+    }
+    
+    memcpy(space->springs, sorted, n * sizeof(sm_spring));
+    remap_slots(space->spring_slots, remap, n);
+    
+    free(sorted);
+    free(remap);
+    free(keys);
+    
+    space->springs_dirty = 1;
+    
+    wake_space(space);
+}
+
+static inline unsigned morton_spread(const float v) {
+    
+    // Quantise to 16 bits, then move bit n to bit 2n
+    unsigned m = v > 0 ? (v < 65535 ? (unsigned)v : 65535) : 0;
+    
+    m = (m | (m << 8)) & 0x00ff00ff;
+    m = (m | (m << 4)) & 0x0f0f0f0f;
+    m = (m | (m << 2)) & 0x33333333;
+    m = (m | (m << 1)) & 0x55555555;
+    
+    return m;
+}
+
+void sort_space_masses(sm_space *space) {
+    
+    const unsigned n = space->number_of_masses;
+    
+    if (n < 2) return;
+    
+    vec2 min = space->masses[0]->pos, max = min;
+    
+    for (unsigned i = 1; i < n; i++) {
+        
+        const vec2 p = space->masses[i]->pos;
+        
+        if (p.x < min.x) min.x = p.x;
+        if (p.y < min.y) min.y = p.y;
+        if (p.x > max.x) max.x = p.x;
+        if (p.y > max.y) max.y = p.y;
+    }
+    
+    const float scale_x = max.x > min.x ? 65535 / (max.x - min.x) : 0;
+    const float scale_y = max.y > min.y ? 65535 / (max.y - min.y) : 0;
+    
+    sort_key    *keys = malloc(n * sizeof(sort_key));
+    unsigned    *remap = malloc(n * sizeof(unsigned));
+    assert(keys && remap);
+    
+    for (unsigned i = 0; i < n; i++) {
+        
+        const vec2 p = space->masses[i]->pos;
+        
+        keys[i] = (sort_key) { morton_spread((p.x - min.x) * scale_x) | morton_spread((p.y - min.y) * scale_y) << 1, 0, i };
+    }
+    
+    qsort(keys, n, sizeof(sort_key), sort_key_compare);
+    
+    // Reorder the masses through the scratch array, then follow with the springs
+    for (unsigned i = 0; i < n; i++) {
+        
+        space->mass_scratch[i] = space->masses[keys[i].index];
+        space->mass_scratch[i]->index = i;
+        remap[keys[i].index] = i;
+    }
+    
+    memcpy(space->masses, space->mass_scratch, n * sizeof(sm_mass *));
+    remap_slots(space->mass_slots, remap, n);
+    
+    for (sm_spring *s = space->springs; s < space->springs + space->number_of_springs; s++) {
+        
+        s->mass1 = remap[s->mass1];
+        s->mass2 = remap[s->mass2];
+    }
+    
+    free(remap);
+    free(keys);
+    
+    space->masses_dirty = 1;
+    
+    sort_space_springs(space);
+    
+    wake_space(space);
+}
+
+#pragma mark Plane management
+
+sm_handle add_plane_to_space(sm_space *space, sm_plane *plane) {
+    
+    assert(!(plane->index < space->number_of_planes && space->planes[plane->index] == plane));
+    
+    if (space->planes + space->number_of_planes == space->planes_end)
+        reserve_planes(space, grown_capacity(plane_capacity(space), space->number_of_planes + 1));
+    
+    const unsigned index = space->number_of_planes++;
+    
+    space->planes[index] = plane;
+    plane->index = index;
+    wake_space(space);
+    
+    return take_slot(space->plane_slots, index);
+}
+
+void remove_plane_from_space(sm_space *space, sm_plane *plane) {
+    
+    const unsigned index = plane->index, last = --space->number_of_planes;
+    
+    assert(index <= last && space->planes[index] == plane);
+    
+    release_slot(space->plane_slots, index);
+    
+    // Fill the gap from the end
+    if (index != last) {
+        
+        space->planes[index] = space->planes[last];
+        space->planes[index]->index = index;
+        move_slot(space->plane_slots, last, index);
+    }
+    
+    plane->index = SM_NO_INDEX;
+    
+    wake_space(space);
+}
+
+sm_plane *space_plane(const sm_space *space, const sm_handle plane) {
+    
+    const unsigned index = slot_index(space->plane_slots, plane);
+    
+    return index == SM_NO_INDEX ? 0 : space->planes[index];
+}
+
+#pragma mark Sleeping
+
+void wake_space(sm_space *space) {
+    
+    const unsigned awake = space->number_of_awake_masses;
+    
+    // Only the masses past the awake ones were asleep or are new
+    if (awake < space->number_of_masses)
+        memset(&space->rest_steps[awake], 0, (space->number_of_masses - awake) * sizeof(unsigned));
+    
+    space->number_of_awake_masses = space->number_of_masses;
+    space->number_of_awake_springs = space->number_of_springs;
+}
+
+static unsigned find_island(sm_space *space, unsigned m) {
+    
+    unsigned *parents = space->island_parents;
+    
+    while (parents[m] != m) {
+        
+        // Halve the path on the way up
+        parents[m] = parents[parents[m]];
+        m = parents[m];
+    }
+    
+    return m;
+}
+
+static void join_islands(sm_space *space, const unsigned m1, const unsigned m2) {
+    
+    const unsigned root1 = find_island(space, m1), root2 = find_island(space, m2);
+    
+    // The lower index wins, so islands come out the same whatever order joins happen in
+    if (root1 < root2)
+        space->island_parents[root2] = root1;
+    else
+        space->island_parents[root1] = root2;
+}
+
+static void request_wake(sm_space *space, const unsigned m) {
+    
+    space->rest_steps[find_island(space, m)] = 0;
+    space->wake_requested = 1;
+}
+
+void wake_mass(sm_space *space, sm_mass *mass) {
+    
+    assert(mass_in_space(space, mass));
+    
+    if (mass->index < space->number_of_awake_masses) return;
+    
+    memset(space->island_asleep, 0, space->number_of_awake_masses);
+    
+    request_wake(space, mass->index);
+    settle_islands(space, 0);
+}
+
+static void begin_islands(sm_space *space) {
+    
+    if (space->sleep_velocity <= 0.0) return;
+    
+    // Awake masses start alone, sleeping islands keep what they had
+    for (unsigned m = 0; m < space->number_of_awake_masses; m++) space->island_parents[m] = m;
+}
+
+static void remap_vectors(vec2 *values, const unsigned *remap, const unsigned n, vec2 *scratch) {
+    
+    for (unsigned m = 0; m < n; m++) scratch[remap[m]] = values[m];
+    
+    memcpy(values, scratch, n * sizeof(vec2));
+}
+
+static void partition_islands(sm_space *space, const unsigned char *asleep) {
+    
+    const unsigned  n = space->number_of_masses, number_of_springs = space->number_of_springs;
+    unsigned        *remap = space->mass_remap, *moved = space->island_scratch, *spring_remap = space->spring_remap;
+    sm_spring       *springs = space->spring_scratch;
+    vec2            *vectors = space->vector_scratch;
+    unsigned        awake = 0, awake_springs = 0;
+    
+    // Awake masses first, each group keeping its order
+    for (unsigned m = 0; m < n; m++) if (!asleep[m]) remap[m] = awake++;
+    for (unsigned m = 0, next = awake; m < n; m++) if (asleep[m]) remap[m] = next++;
+    
+    for (unsigned m = 0; m < n; m++) {
+        
+        space->mass_scratch[remap[m]] = space->masses[m];
+        space->masses[m]->index = remap[m];
+        moved[remap[m]] = space->rest_steps[m];
+        moved[n + remap[m]] = remap[space->island_parents[m]];
+    }
+    
+    memcpy(space->masses, space->mass_scratch, n * sizeof(sm_mass *));
+    memcpy(space->rest_steps, moved, n * sizeof(unsigned));
+    memcpy(space->island_parents, moved + n, n * sizeof(unsigned));
+    remap_slots(space->mass_slots, remap, n);
+    
+    // Forces held by step_space_dt last over several steps, and the integrators' scratch
+    // goes with it
+    remap_vectors(space->mass_external_forces, remap, n, vectors);
+    
+    for (unsigned a = RK4_POS; a <= RK4_SUM_VEL; a++) remap_vectors(rk4_array(space, a), remap, n, vectors);
+    
+    // Both ends of a spring are always on the same island, so it sleeps with them
+    for (unsigned s = 0; s < number_of_springs; s++) {
+        
+        sm_spring *spring = &space->springs[s];
+        
+        spring->mass1 = remap[spring->mass1];
+        spring->mass2 = remap[spring->mass2];
+        
+        if (spring->mass1 < awake) spring_remap[s] = awake_springs++;
+    }
+    
+    for (unsigned s = 0, next = awake_springs; s < number_of_springs; s++)
+        if (space->springs[s].mass1 >= awake) spring_remap[s] = next++;
+    
+    for (unsigned s = 0; s < number_of_springs; s++) springs[spring_remap[s]] = space->springs[s];
+    
+    memcpy(space->springs, springs, number_of_springs * sizeof(sm_spring));
+    remap_slots(space->spring_slots, spring_remap, number_of_springs);
+    
+    space->number_of_awake_masses = awake;
+    space->number_of_awake_springs = awake_springs;
+    space->masses_dirty = space->springs_dirty = 1;
+}
+
+static void update_islands(sm_space *space) {
+    
+    if (space->sleep_velocity <= 0.0) return;
+    
+    const unsigned  awake = space->number_of_awake_masses;
+    const float     v_squared = space->sleep_velocity * space->sleep_velocity;
+    const unsigned  sleep_steps = space->sleep_steps ? space->sleep_steps : 1;
+    unsigned        *rest = space->island_rest;
+    int             changed = 0;
+    
+    // Springs join islands, contacts were joined as they were resolved
+    for (unsigned s = 0; s < space->number_of_awake_springs; s++)
+        join_islands(space, space->springs[s].mass1, space->springs[s].mass2);
+    
+    // Bodies never rest, so nothing joined to them sleeps either
+    for (unsigned m = 0; m < awake; m++) {
+        
+        const sm_mass   *mass = space->masses[m];
+        const float     speed_squared = mass->vel.x * mass->vel.x + mass->vel.y * mass->vel.y;
+        const int       resting = !mass->body && speed_squared < v_squared && (space->sleep_energy <= 0.0 || 0.5 * mass->mass * speed_squared < space->sleep_energy);
+        
+        space->rest_steps[m] = resting ? space->rest_steps[m] + 1 : 0;
+        rest[m] = ~0u;
+    }
+    
+    // An island is only as rested as its least rested mass
+    for (unsigned m = 0; m < awake; m++) {
+        
+        const unsigned root = find_island(space, m);
+        
+        if (space->rest_steps[m] < rest[root]) rest[root] = space->rest_steps[m];
+    }
+    
+    unsigned char *asleep = space->island_asleep;
+    
+    for (unsigned m = 0; m < awake; m++) {
+        
+        asleep[m] = rest[find_island(space, m)] >= sleep_steps;
+        
+        if (asleep[m]) {
+            
+            sm_mass *mass = space->masses[m];
+            
+            mass->vel = mass->acc = (vec2) { 0, 0 };
+            mass->prev = mass->pos;
+            changed = 1;
+        }
+    }
+    
+    settle_islands(space, changed);
+}
+
+// Takes the sleep state of the awake masses, works out which sleeping ones wake and
+// repartitions if anything changed
+static void settle_islands(sm_space *space, int changed) {
+    
+    const unsigned  n = space->number_of_masses, awake = space->number_of_awake_masses;
+    unsigned char   *asleep = space->island_asleep;
+    
+    // Sleeping islands asked to wake have had their root's rest cleared
+    for (unsigned m = awake; m < n; m++) {
+        
+        asleep[m] = !space->wake_requested || space->rest_steps[find_island(space, m)] != 0;
+        
+        if (!asleep[m]) changed = 1;
+    }
+    
+    for (unsigned m = awake; m < n; m++) if (!asleep[m]) space->rest_steps[m] = 0;
+    
+    space->wake_requested = 0;
+    
+    if (changed) partition_islands(space, asleep);
+}
+
+#pragma mark Calculations
+
+static void load_mass_state(void *context, const unsigned begin, const unsigned end) {
+    
+    sm_space *space = context;
+    
+    for (unsigned m = begin; m < end; m++) {
+        
+        const sm_mass *mass = space->masses[m];
+        
+        space->mass_positions[m] = mass->pos;
+        space->mass_velocities[m] = mass->vel;
+        space->mass_forces[m] = mass->frc;
+    }
+}
+
+static void calculate_spring_blocks(void *context, const unsigned begin, const unsigned end) {
+    
+    sm_space    *space = context;
+    const vec2  *pos = space->mass_positions, *vel = space->mass_velocities;
+    
+    // Every spring goes through the same lanes whatever the thread split, so
+    // the last block is padded rather than finished off in scalar code
+    for (unsigned b = begin; b < end; b++) {
+        
+        const unsigned  first = b * SM_LANES;
+        const unsigned  lanes = space->number_of_awake_springs - first < SM_LANES ? space->number_of_awake_springs - first : SM_LANES;
+        float           dx[SM_LANES] = { 0 }, dy[SM_LANES] = { 0 }, dvx[SM_LANES] = { 0 }, dvy[SM_LANES] = { 0 };
+        float           k[SM_LANES] = { 0 }, l[SM_LANES] = { 0 }, f[SM_LANES] = { 0 };
+        
+        for (unsigned n = 0; n < lanes; n++) {
+            
+            const sm_spring *spring = &space->springs[first + n];
+            
+            dx[n] = pos[spring->mass1].x - pos[spring->mass2].x;
+            dy[n] = pos[spring->mass1].y - pos[spring->mass2].y;
+            dvx[n] = vel[spring->mass1].x - vel[spring->mass2].x;
+            dvy[n] = vel[spring->mass1].y - vel[spring->mass2].y;
+            k[n] = spring->k;
+            l[n] = spring->l;
+            f[n] = -spring->f;
+        }
+        
+        const sm_f4 vdx = f4_load(dx), vdy = f4_load(dy);
+        const sm_f4 length = f4_sqrt(f4_add(f4_mul(vdx, vdx), f4_mul(vdy, vdy)));
+        
+        // Calculate spring force along the unit vector between the masses
+        const sm_f4 unit = f4_div(f4_set1(-1), length);
+        const sm_f4 extension = f4_mul(f4_sub(length, f4_load(l)), f4_load(k));
+        
+        // Subtract spring friction
+        const sm_f4 fx = f4_add(f4_mul(f4_mul(vdx, unit), extension), f4_mul(f4_load(dvx), f4_load(f)));
+        const sm_f4 fy = f4_add(f4_mul(f4_mul(vdy, unit), extension), f4_mul(f4_load(dvy), f4_load(f)));
+        
+        // Coincident masses have no direction to push in
+        float force_x[SM_LANES], force_y[SM_LANES];
+        
+        f4_store(force_x, f4_where_nonzero(length, fx));
+        f4_store(force_y, f4_where_nonzero(length, fy));
+        
+        for (unsigned n = 0; n < lanes; n++)
+            space->spring_forces[first + n] = (vec2) { force_x[n], force_y[n] };
+    }
+}
+
+static void accumulate_spring_forces(sm_space *space) {
+    
+    vec2 *frc = space->mass_forces;
+    
+    for (unsigned i = 0; i < space->number_of_awake_springs; i++) {
+        
+        const sm_spring *spring = &space->springs[i];
+        
+        frc[spring->mass1] = vec2Add(frc[spring->mass1], space->spring_forces[i]);
+        frc[spring->mass2] = vec2Subtract(frc[spring->mass2], space->spring_forces[i]);
+    }
+}
+
+static void store_mass_forces(void *context, const unsigned begin, const unsigned end) {
+    
+    sm_space *space = context;
+    
+    for (unsigned m = begin; m < end; m++) space->masses[m]->frc = space->mass_forces[m];
+}
+
+static void build_spring_incidence(sm_space *space) {
+    
+    unsigned *offsets = space->spring_incidence_offsets;
+    
+    // Count the springs attached to each mass
+    memset(offsets, 0, (space->number_of_masses + 1) * sizeof(unsigned));
+    
+    for (unsigned i = 0; i < space->number_of_springs; i++) {
+        
+        offsets[space->springs[i].mass1 + 1]++;
+        offsets[space->springs[i].mass2 + 1]++;
+    }
+    
+    for (unsigned m = 0; m < space->number_of_masses; m++) offsets[m + 1] += offsets[m];
+    
+    // Fill in spring order, so each mass sees its springs in the same order as the serial pass.
+    // The low bit records which end of the spring the mass is on.
+    for (unsigned i = 0; i < space->number_of_springs; i++) {
+        
+        space->spring_incidence[offsets[space->springs[i].mass1]++] = i << 1;
+        space->spring_incidence[offsets[space->springs[i].mass2]++] = i << 1 | 1;
+    }
+    
+    // Filling advanced every offset to the start of the next mass
+    memmove(offsets + 1, offsets, space->number_of_masses * sizeof(unsigned));
+    offsets[0] = 0;
+    
+    space->springs_dirty = 0;
+    space->spring_colors_dirty = 1;
+}
+
+static void gather_spring_range(void *context, const unsigned begin, const unsigned end) {
+    
+    sm_space *space = context;
+    
+    for (unsigned m = begin; m < end; m++) {
+        
+        vec2 frc = space->mass_forces[m];
+        
+        for (unsigned e = space->spring_incidence_offsets[m]; e < space->spring_incidence_offsets[m + 1]; e++) {
+            
+            const unsigned incidence = space->spring_incidence[e];
+            
+            if (incidence & 1)
+                frc = vec2Subtract(frc, space->spring_forces[incidence >> 1]);
+            else
+                frc = vec2Add(frc, space->spring_forces[incidence >> 1]);
+        }
+        
+        space->masses[m]->frc = frc;
+    }
+}
+
+// Springs one at a time in double. Forces stay double until each mass has its total.
+static void calculate_wide_springs(void *context, const unsigned begin, const unsigned end) {
+    
+    sm_space    *space = context;
+    const vec2  *pos = space->mass_positions, *vel = space->mass_velocities;
+    double      *forces = space->wide_spring_forces;
+    
+    for (unsigned i = begin; i < end; i++) {
+        
+        const sm_spring *spring = &space->springs[i];
+        const double    dx = (double)pos[spring->mass1].x - pos[spring->mass2].x;
+        const double    dy = (double)pos[spring->mass1].y - pos[spring->mass2].y;
+        const double    length = sqrt(dx * dx + dy * dy);
+        
+        // Coincident masses have no direction to push in
+        if (length == 0) {
+            
+            forces[i * 2] = forces[i * 2 + 1] = 0;
+            continue;
+        }
+        
+        const double extension = (length - spring->l) * spring->k / length;
+        
+        forces[i * 2] = -dx * extension - spring->f * ((double)vel[spring->mass1].x - vel[spring->mass2].x);
+        forces[i * 2 + 1] = -dy * extension - spring->f * ((double)vel[spring->mass1].y - vel[spring->mass2].y);
+    }
+}
+
+static void accumulate_wide_spring_forces(sm_space *space) {
+    
+    double *frc = space->wide_mass_forces;
+    
+    for (unsigned m = 0; m < space->number_of_awake_masses; m++) {
+        
+        frc[m * 2] = space->mass_forces[m].x;
+        frc[m * 2 + 1] = space->mass_forces[m].y;
+    }
+    
+    for (unsigned i = 0; i < space->number_of_awake_springs; i++) {
+        
+        const sm_spring *spring = &space->springs[i];
+        
+        frc[spring->mass1 * 2] += space->wide_spring_forces[i * 2];
+        frc[spring->mass1 * 2 + 1] += space->wide_spring_forces[i * 2 + 1];
+        frc[spring->mass2 * 2] -= space->wide_spring_forces[i * 2];
+        frc[spring->mass2 * 2 + 1] -= space->wide_spring_forces[i * 2 + 1];
+    }
+    
+    for (unsigned m = 0; m < space->number_of_awake_masses; m++)
+        space->masses[m]->frc = (vec2) { frc[m * 2], frc[m * 2 + 1] };
+}
+
+static void gather_wide_spring_range(void *context, const unsigned begin, const unsigned end) {
+    
+    sm_space *space = context;
+    
+    for (unsigned m = begin; m < end; m++) {
+        
+        double x = space->mass_forces[m].x, y = space->mass_forces[m].y;
+        
+        for (unsigned e = space->spring_incidence_offsets[m]; e < space->spring_incidence_offsets[m + 1]; e++) {
+            
+            const unsigned  incidence = space->spring_incidence[e];
+            const double    *force = &space->wide_spring_forces[(incidence >> 1) * 2];
+            
+            if (incidence & 1) {
+                
+                x -= force[0];
+                y -= force[1];
+                
+            } else {
+                
+                x += force[0];
+                y += force[1];
+            }
+        }
+        
+        space->masses[m]->frc = (vec2) { x, y };
+    }
+}
+
+static void calculate_spring_forces(sm_space *space) {
+    
+    if (!space->number_of_awake_springs) return;
+    
+    const int wide = space->mixed_precision;
+    
+    run_workers(space->workers, load_mass_state, space, space->number_of_awake_masses);
+    
+    if (wide)
+        run_workers(space->workers, calculate_wide_springs, space, space->number_of_awake_springs);
+    else
+        run_workers(space->workers, calculate_spring_blocks, space, (space->number_of_awake_springs + SM_LANES - 1) / SM_LANES);
+    
+    if (space->workers) {
+        
+        // Springs wrote only their own force, so each mass can now read its own springs
+        if (space->springs_dirty) build_spring_incidence(space);
+        
+        run_workers(space->workers, wide ? gather_wide_spring_range : gather_spring_range, space, space->number_of_awake_masses);
+        
+    } else if (wide) {
+        
+        accumulate_wide_spring_forces(space);
+        
+    } else {
+        
+        accumulate_spring_forces(space);
+        store_mass_forces(space, 0, space->number_of_awake_masses);
+    }
+}
+
+static inline float collision_sort_key(const sm_mass *mass) { return mass->pos.x - mass->radius; }
+
+static inline float vec2LengthSquared(const vec2 v) { return vec2DotProduct(v, v); }
+
+static void sort_collision_order(sm_space *space) {
+    
+    const unsigned n = space->number_of_masses;
+    
+    // Keep the previous order between steps unless masses came or went
+    if (space->masses_dirty) {
+        
+        for (unsigned m = 0; m < n; m++) space->collision_order[m] = m;
+        
+        space->masses_dirty = 0;
+    }
+    
+    for (unsigned m = 0; m < n; m++) space->collision_keys[m] = collision_sort_key(space->masses[m]);
+    
+    sort_sweep_order(space->collision_order, space->collision_scratch, space->collision_keys, n);
+}
+
+static inline int sweep_pair(const void *context, const unsigned i, const unsigned j) {
+    
+    const sm_space  *space = context;
+    const sm_mass   *mass_i = space->masses[i], *mass_j = space->masses[j];
+    
+    // Collision mask reject
+    if (!(mass_i->collision_mask & mass_j->collision_type)) return SM_SWEEP_END;
+    
+    // Partition reject
+    if (mass_i->pos.x + mass_i->radius < space->collision_keys[j]) return SM_SWEEP_END;
+    
+    vec2    collide_normal = vec2Subtract(mass_j->pos, mass_i->pos);
+    float   d_squared = vec2LengthSquared(collide_normal);
+    float   radius_sum = mass_i->radius + mass_j->radius;
+    
+    // Compare distances squared
+    return d_squared < radius_sum * radius_sum ? SM_SWEEP_OVERLAP : SM_SWEEP_SEPARATE;
+}
+
+static void record_contact(sm_space *space, const sm_mass *mass_i, const sm_mass *mass_j, const vec2 normal, const float distance, const float impulse) {
+    
+    space->contacts = grow_array(space->contacts, &space->contact_capacity, space->number_of_contacts + 1, sizeof(sm_contact));
+    
+    space->contacts[space->number_of_contacts++] = (sm_contact) {
+        
+        slot_handle(space->mass_slots, mass_i->index), slot_handle(space->mass_slots, mass_j->index),
+        normal, mass_i->radius + mass_j->radius - distance, impulse < 0 ? -impulse : 0
+    };
+}
+
+static void resolve_collision(sm_space *space, sm_mass *mass_i, sm_mass *mass_j) {
+    
+    // Mass - mass collision callback
+    if (!space->mass_collision_callback || space->mass_collision_callback(mass_i, mass_j)) {
+        
+        vec2      collide_normal = vec2Subtract(mass_j->pos, mass_i->pos);
+        float     l = vec2LengthSquared(collide_normal);
+        
+        if (l) {
+            
+            float   e = mass_i->e + mass_j->e;
+            float   inverse_mass_sum = 1.0 / mass_i->mass + 1.0 / mass_j->mass;
+            vec2    relative_velocity = vec2Multiply(vec2Subtract(mass_j->vel, mass_i->vel), e);
+            
+            // Calculate impulse
+            collide_normal = vec2Normalize(collide_normal);
+            float impulse = vec2DotProduct(relative_velocity, collide_normal) / inverse_mass_sum;
+            
+            if (impulse < 0) {
+                
+                // Calculate exit velocities
+                mass_i->vel = vec2Add(mass_i->vel, vec2Multiply(collide_normal, impulse / mass_i->mass));
+                mass_j->vel = vec2Add(mass_j->vel, vec2Multiply(collide_normal, -impulse / mass_j->mass));
+                
+            } else {
+                
+                // Calculate separation forces
+                mass_i->frc = vec2Add(mass_i->frc, vec2Multiply(collide_normal, -space->separation_force));
+                mass_j->frc = vec2Add(mass_j->frc, vec2Multiply(collide_normal, space->separation_force));
+                
+            }
+            
+            if (space->record_contacts) record_contact(space, mass_i, mass_j, collide_normal, sqrtf(l), impulse);
+        }
+    }
+}
+
+void set_space_collision_filter(sm_space *space, collision_filter_func filter, void *context) {
+    
+    space->collision_filter = filter;
+    space->collision_filter_context = context;
+    
+    memset(space->filter_cache, 0, sizeof(space->filter_cache));
+}
+
+static int filter_collision(sm_space *space, const unsigned short type1, const unsigned short type2) {
+    
+    sm_filter_entry *entry = &space->filter_cache[(type1 * 31u + type2) % SM_FILTER_CACHE_SIZE];
+    
+    // Ask the filter only when the pair of types is new to its cache entry
+    if (!entry->valid || entry->type1 != type1 || entry->type2 != type2)
+        *entry = (sm_filter_entry) { type1, type2, 1, space->collision_filter(space->collision_filter_context, type1, type2) != 0 };
+    
+    return entry->collide;
+}
+
+static void resolve_contact(sm_space *space, sm_mass *mass_i, sm_mass *mass_j) {
+    
+    if (space->collision_filter && !filter_collision(space, mass_i->collision_type, mass_j->collision_type)) return;
+    
+    if (space->sleep_velocity > 0.0) {
+        
+        const unsigned  awake = space->number_of_awake_masses;
+        const int       asleep_i = mass_i->index >= awake, asleep_j = mass_j->index >= awake;
+        
+        // Sleeping masses rest against each other, and only wake when hit by an awake one
+        if (asleep_i && asleep_j) return;
+        
+        if (asleep_i || asleep_j)
+            request_wake(space, asleep_i ? mass_i->index : mass_j->index);
+        else
+            join_islands(space, mass_i->index, mass_j->index);
+    }
+    
+    if (mass_i->body || mass_j->body || space->contact_solver == SM_SEQUENTIAL_IMPULSES) {
+        
+        if (!space->mass_collision_callback || space->mass_collision_callback(mass_i, mass_j)) add_contact_constraint(space, mass_i, mass_j);
+        
+    } else {
+        
+        resolve_collision(space, mass_i, mass_j);
+    }
+}
+
+static void find_collision_pairs(void *context, const unsigned begin, const unsigned end) {
+    
+    sm_space *space = context;
+    
+    find_sweep_pairs(space->collision_chunks, begin, end, space->collision_order, space->number_of_masses, sweep_pair, space);
+}
+
+static void resolve_object_to_object_collisions(sm_space *space) {
+    
+    const unsigned number_of_chunks = sweep_chunks(space->number_of_masses);
+    
+    sort_collision_order(space);
+    
+    // Detection only reads positions, so chunks of the sweep can run side by side
+    run_workers(space->workers, find_collision_pairs, space, number_of_chunks);
+    
+    // Resolve in sweep order whatever the thread split
+    for (unsigned c = 0; c < number_of_chunks; c++) {
+        
+        const sm_pair_list *list = &space->collision_chunks[c];
+        
+        for (unsigned p = 0; p < list->number_of_pairs; p++)
+            resolve_contact(space, space->masses[space->collision_order[list->pairs[p].i]], space->masses[space->collision_order[list->pairs[p].j]]);
+    }
+}
+
+static void integrate_masses(void *context, const unsigned begin, const unsigned end) {
+    
+    const integration *factors = context;
+    sm_space *space = factors->space;
+    
+    // Calculate mass effect
+    for (unsigned i = begin; i < end; i++) {
+        
+        sm_mass *mass = space->masses[i];
+        
+        assert(mass->mass > 0.0);
+        
+        float massTimesFriction = mass->mass * space->friction;
+        
+        // a' = f / m
+        mass->acc = vec2Multiply(vec2Subtract(mass->frc, vec2Multiply(mass->vel, massTimesFriction)), 1.0 / mass->mass);
+        // s' = ut + 0.5at^2
+        mass->pos = vec2Add(mass->pos, vec2Add(vec2Multiply(mass->vel, factors->v_factor), vec2Multiply(mass->acc, factors->a_factor)));
+        // v' = v + at
+        mass->vel = vec2Add(mass->vel, vec2Multiply(mass->acc, factors->dv_factor));
+    }
+}
+
+static void integrate_semi_implicit(void *context, const unsigned begin, const unsigned end) {
+    
+    const integration *step = context;
+    sm_space *space = step->space;
+    
+    for (unsigned i = begin; i < end; i++) {
+        
+        sm_mass *mass = space->masses[i];
+        
+        assert(mass->mass > 0.0);
+        
+        // a = f / m, v' = v + ah, s' = s + v'h
+        mass->acc = vec2Multiply(vec2Subtract(mass->frc, vec2Multiply(mass->vel, mass->mass * space->friction)), 1.0 / mass->mass);
+        mass->vel = vec2Add(mass->vel, vec2Multiply(mass->acc, step->h));
+        mass->pos = vec2Add(mass->pos, vec2Multiply(mass->vel, step->h));
+    }
+}
+
+static void verlet_drift(void *context, const unsigned begin, const unsigned end) {
+    
+    const integration *step = context;
+    sm_space *space = step->space;
+    
+    for (unsigned i = begin; i < end; i++) {
+        
+        sm_mass *mass = space->masses[i];
+        
+        // s' = s + vh + 0.5ah^2, with half the velocity change up front
+        mass->pos = vec2Add(mass->pos, vec2Add(vec2Multiply(mass->vel, step->h), vec2Multiply(mass->acc, 0.5 * step->h * step->h)));
+        mass->vel = vec2Add(mass->vel, vec2Multiply(mass->acc, 0.5 * step->h));
+    }
+}
+
+static void verlet_kick(void *context, const unsigned begin, const unsigned end) {
+    
+    const integration *step = context;
+    sm_space *space = step->space;
+    
+    for (unsigned i = begin; i < end; i++) {
+        
+        sm_mass *mass = space->masses[i];
+        
+        assert(mass->mass > 0.0);
+        
+        // The other half from the acceleration at the new position
+        mass->acc = vec2Multiply(vec2Subtract(mass->frc, vec2Multiply(mass->vel, mass->mass * space->friction)), 1.0 / mass->mass);
+        mass->vel = vec2Add(mass->vel, vec2Multiply(mass->acc, 0.5 * step->h));
+    }
+}
+
+// Adds a step to a float vector in double, keeping what rounding to float loses for the next step
+static inline void add_compensated(vec2 *value, vec2 *error, const double x, const double y) {
+    
+    const double sum_x = (double)value->x + error->x + x, sum_y = (double)value->y + error->y + y;
+    
+    value->x = sum_x;
+    value->y = sum_y;
+    error->x = sum_x - value->x;
+    error->y = sum_y - value->y;
+}
+
+// a = f / m less friction, with the velocity's carried rounding
+static inline void wide_acceleration(const sm_space *space, sm_mass *mass, double *ax, double *ay) {
+    
+    const double friction = (double)mass->mass * space->friction;
+    
+    *ax = (mass->frc.x - ((double)mass->vel.x + mass->vel_error.x) * friction) / mass->mass;
+    *ay = (mass->frc.y - ((double)mass->vel.y + mass->vel_error.y) * friction) / mass->mass;
+    
+    mass->acc = (vec2) { *ax, *ay };
+}
+
+static void integrate_semi_implicit_wide(void *context, const unsigned begin, const unsigned end) {
+    
+    const integration *step = context;
+    sm_space *space = step->space;
+    const double h = step->h;
+    
+    for (unsigned i = begin; i < end; i++) {
+        
+        sm_mass *mass = space->masses[i];
+        double  ax, ay;
+        
+        assert(mass->mass > 0.0);
+        
+        wide_acceleration(space, mass, &ax, &ay);
+        add_compensated(&mass->vel, &mass->vel_error, ax * h, ay * h);
+        add_compensated(&mass->pos, &mass->pos_error, ((double)mass->vel.x + mass->vel_error.x) * h, ((double)mass->vel.y + mass->vel_error.y) * h);
+    }
+}
+
+static void verlet_drift_wide(void *context, const unsigned begin, const unsigned end) {
+    
+    const integration *step = context;
+    sm_space *space = step->space;
+    const double h = step->h;
+    
+    for (unsigned i = begin; i < end; i++) {
+        
+        sm_mass *mass = space->masses[i];
+        
+        add_compensated(&mass->pos, &mass->pos_error, ((double)mass->vel.x + mass->vel_error.x) * h + 0.5 * mass->acc.x * h * h,
+                        ((double)mass->vel.y + mass->vel_error.y) * h + 0.5 * mass->acc.y * h * h);
+        add_compensated(&mass->vel, &mass->vel_error, 0.5 * mass->acc.x * h, 0.5 * mass->acc.y * h);
+    }
+}
+
+static void verlet_kick_wide(void *context, const unsigned begin, const unsigned end) {
+    
+    const integration *step = context;
+    sm_space *space = step->space;
+    const double h = step->h;
+    
+    for (unsigned i = begin; i < end; i++) {
+        
+        sm_mass *mass = space->masses[i];
+        double  ax, ay;
+        
+        assert(mass->mass > 0.0);
+        
+        wide_acceleration(space, mass, &ax, &ay);
+        add_compensated(&mass->vel, &mass->vel_error, 0.5 * ax * h, 0.5 * ay * h);
+    }
+}
+
+static void rk4_begin(void *context, const unsigned begin, const unsigned end) {
+    
+    const integration *step = context;
+    sm_space *space = step->space;
+    vec2 *pos = rk4_array(space, RK4_POS), *vel = rk4_array(space, RK4_VEL), *frc = rk4_array(space, RK4_FRC);
+    vec2 *sum_pos = rk4_array(space, RK4_SUM_POS), *sum_vel = rk4_array(space, RK4_SUM_VEL);
+    
+    for (unsigned i = begin; i < end; i++) {
+        
+        sm_mass *mass = space->masses[i];
+        
+        pos[i] = mass->pos;
+        vel[i] = mass->vel;
+        frc[i] = mass->frc;
+        sum_pos[i] = sum_vel[i] = (vec2) { 0, 0 };
+    }
+}
+
+static void rk4_stage(void *context, const unsigned begin, const unsigned end) {
+    
+    static const float weights[4] = { 1, 2, 2, 1 }, offsets[4] = { 0.5, 0.5, 1, 0 };
+    
+    const integration *step = context;
+    sm_space *space = step->space;
+    const unsigned stage = step->stage;
+    vec2 *pos = rk4_array(space, RK4_POS), *vel = rk4_array(space, RK4_VEL), *frc = rk4_array(space, RK4_FRC);
+    vec2 *sum_pos = rk4_array(space, RK4_SUM_POS), *sum_vel = rk4_array(space, RK4_SUM_VEL);
+    
+    for (unsigned i = begin; i < end; i++) {
+        
+        sm_mass *mass = space->masses[i];
+        
+        assert(mass->mass > 0.0);
+        
+        // Derivatives at this stage's state
+        const vec2 acc = vec2Multiply(vec2Subtract(mass->frc, vec2Multiply(mass->vel, mass->mass * space->friction)), 1.0 / mass->mass);
+        
+        if (!stage) mass->acc = acc;
+        
+        sum_pos[i] = vec2Add(sum_pos[i], vec2Multiply(mass->vel, weights[stage]));
+        sum_vel[i] = vec2Add(sum_vel[i], vec2Multiply(acc, weights[stage]));
+        
+        // Move on to the next stage's state, or to the final one
+        if (stage < 3) {
+            
+            const float offset = offsets[stage] * step->h;
+            
+            mass->pos = vec2Add(pos[i], vec2Multiply(mass->vel, offset));
+            mass->vel = vec2Add(vel[i], vec2Multiply(acc, offset));
+            mass->frc = frc[i];
+            
+        } else if (space->mixed_precision) {
+            
+            // Only the step as a whole carries rounding, the stages are float
+            const double weight = step->h / 6.0;
+            
+            mass->pos = pos[i];
+            mass->vel = vel[i];
+            add_compensated(&mass->pos, &mass->pos_error, sum_pos[i].x * weight, sum_pos[i].y * weight);
+            add_compensated(&mass->vel, &mass->vel_error, sum_vel[i].x * weight, sum_vel[i].y * weight);
+            
+        } else {
+            
+            mass->pos = vec2Add(pos[i], vec2Multiply(sum_pos[i], step->h / 6.0));
+            mass->vel = vec2Add(vel[i], vec2Multiply(sum_vel[i], step->h / 6.0));
+        }
+    }
+}
+
+#pragma mark Constraint solver
+
+typedef struct {
+    
+    sm_space        *space;
+    float           h;
+    float           alpha_scale;
+    const unsigned  *order;
+    
+} constraint_pass;
+
+static void build_spring_colors(sm_space *space) {
+    
+    const unsigned *offsets = space->spring_incidence_offsets;
+    unsigned counts[SM_SPRING_COLORS + 1] = { 0 };
+    
+    // Greedy coloring in spring order, each spring taking the lowest color
+    // none of the earlier springs on either of its masses has
+    for (unsigned i = 0; i < space->number_of_awake_springs; i++) {
+        
+        const unsigned ends[2] = { space->springs[i].mass1, space->springs[i].mass2 };
+        unsigned long long used = 0;
+        
+        for (unsigned e = 0; e < 2; e++) {
+            
+            for (unsigned j = offsets[ends[e]]; j < offsets[ends[e] + 1]; j++) {
+                
+                const unsigned other = space->spring_incidence[j] >> 1;
+                
+                if (other < i && space->spring_colors[other] < SM_SPRING_COLORS)
+                    used |= 1ull << space->spring_colors[other];
+            }
+        }
+        
+        unsigned color = 0;
+        
+        while (color < SM_SPRING_COLORS && (used >> color & 1)) color++;
+        
+        space->spring_colors[i] = color;
+        counts[color]++;
+    }
+    
+    // Group the springs by color, keeping spring order within each
+    space->spring_color_offsets[0] = 0;
+    
+    for (unsigned c = 0; c <= SM_SPRING_COLORS; c++)
+        space->spring_color_offsets[c + 1] = space->spring_color_offsets[c] + counts[c];
+    
+    memcpy(counts, space->spring_color_offsets, sizeof(counts));
+    
+    for (unsigned i = 0; i < space->number_of_awake_springs; i++)
+        space->spring_color_order[counts[space->spring_colors[i]]++] = i;
+    
+    space->spring_colors_dirty = 0;
+}
+
+static void predict_positions(void *context, const unsigned begin, const unsigned end) {
+    
+    const constraint_pass *pass = context;
+    sm_space *space = pass->space;
+    vec2 *start = rk4_array(space, RK4_POS);
+    
+    for (unsigned m = begin; m < end; m++) {
+        
+        sm_mass *mass = space->masses[m];
+        
+        assert(mass->mass > 0.0);
+        
+        // Move with the forces that are not springs
+        mass->acc = vec2Multiply(vec2Subtract(mass->frc, vec2Multiply(mass->vel, mass->mass * space->friction)), 1.0 / mass->mass);
+        mass->vel = vec2Add(mass->vel, vec2Multiply(mass->acc, pass->h));
+        
+        start[m] = mass->pos;
+        space->mass_positions[m] = vec2Add(mass->pos, vec2Multiply(mass->vel, pass->h));
+        space->mass_weights[m] = 1.0 / mass->mass;
+    }
+}
+
+static inline void solve_spring(const constraint_pass *pass, const unsigned i) {
+    
+    sm_space        *space = pass->space;
+    const sm_spring *spring = &space->springs[i];
+    vec2            *p1 = &space->mass_positions[spring->mass1], *p2 = &space->mass_positions[spring->mass2];
+    const float     w1 = space->mass_weights[spring->mass1], w2 = space->mass_weights[spring->mass2];
+    
+    const vec2  d = vec2Subtract(*p1, *p2);
+    const float length = sqrtf(d.x * d.x + d.y * d.y);
+    
+    if (length == 0.0 || spring->k <= 0.0) return;
+    
+    // XPBD: dl = (-C - alpha lambda) / (w1 + w2 + alpha), with alpha = 1 / (k h^2)
+    const float alpha = pass->alpha_scale / spring->k;
+    const float dl = (spring->l - length - alpha * space->spring_lambdas[i]) / (w1 + w2 + alpha);
+    const vec2  n = vec2Multiply(d, dl / length);
+    
+    space->spring_lambdas[i] += dl;
+    
+    *p1 = vec2Add(*p1, vec2Multiply(n, w1));
+    *p2 = vec2Subtract(*p2, vec2Multiply(n, w2));
+}
+
+static void solve_spring_range(void *context, const unsigned begin, const unsigned end) {
+    
+    const constraint_pass *pass = context;
+    
+    for (unsigned i = begin; i < end; i++) solve_spring(pass, pass->order ? pass->order[i] : i);
+}
+
+static inline void damp_spring(const constraint_pass *pass, const unsigned i) {
+    
+    sm_space        *space = pass->space;
+    const sm_spring *spring = &space->springs[i];
+    vec2            *v1 = &space->mass_velocities[spring->mass1], *v2 = &space->mass_velocities[spring->mass2];
+    const float     w1 = space->mass_weights[spring->mass1], w2 = space->mass_weights[spring->mass2];
+    
+    const vec2  d = vec2Subtract(space->mass_positions[spring->mass1], space->mass_positions[spring->mass2]);
+    const float length_squared = d.x * d.x + d.y * d.y;
+    
+    if (length_squared == 0.0 || spring->f == 0.0) return;
+    
+    // Spring friction removes part of the closing speed, never more than all of it
+    const float closing = ((v1->x - v2->x) * d.x + (v1->y - v2->y) * d.y) / length_squared;
+    const float share = fminf(spring->f * pass->h * (w1 + w2), 1.0);
+    const vec2  dv = vec2Multiply(d, closing * share / (w1 + w2));
+    
+    *v1 = vec2Subtract(*v1, vec2Multiply(dv, w1));
+    *v2 = vec2Add(*v2, vec2Multiply(dv, w2));
+}
+
+static void damp_spring_range(void *context, const unsigned begin, const unsigned end) {
+    
+    const constraint_pass *pass = context;
+    
+    for (unsigned i = begin; i < end; i++) damp_spring(pass, pass->order ? pass->order[i] : i);
+}
+
+static void update_velocities(void *context, const unsigned begin, const unsigned end) {
+    
+    const constraint_pass *pass = context;
+    sm_space *space = pass->space;
+    const vec2 *start = rk4_array(space, RK4_POS);
+    
+    for (unsigned m = begin; m < end; m++)
+        space->mass_velocities[m] = vec2Multiply(vec2Subtract(space->mass_positions[m], start[m]), 1.0 / pass->h);
+}
+
+static void store_positions(void *context, const unsigned begin, const unsigned end) {
+    
+    const constraint_pass *pass = context;
+    sm_space *space = pass->space;
+    
+    for (unsigned m = begin; m < end; m++) {
+        
+        space->masses[m]->pos = space->mass_positions[m];
+        space->masses[m]->vel = space->mass_velocities[m];
+    }
+}
+
+// Runs a spring pass in the order the solver asks for, each color a parallel batch
+static void run_spring_pass(sm_space *space, constraint_pass *pass, work_func func) {
+    
+    if (space->constraint_solver == SM_GAUSS_SEIDEL) {
+        
+        pass->order = 0;
+        func(pass, 0, space->number_of_awake_springs);
+        return;
+    }
+    
+    for (unsigned c = 0; c <= SM_SPRING_COLORS; c++) {
+        
+        const unsigned first = space->spring_color_offsets[c], count = space->spring_color_offsets[c + 1] - first;
+        
+        pass->order = &space->spring_color_order[first];
+        
+        if (c < SM_SPRING_COLORS)
+            run_workers(space->workers, func, pass, count);
+        else
+            func(pass, 0, count);
+    }
+}
+
+static void solve_spring_constraints(sm_space *space, const float h) {
+    
+    constraint_pass pass = { space, h, 1.0 / (h * h), 0 };
+    
+    // Sleeping masses stay put, and awake springs only reach awake masses
+    const unsigned n = space->number_of_awake_masses;
+    
+    if (space->constraint_solver == SM_COLORED_GAUSS_SEIDEL) {
+        
+        if (space->springs_dirty) build_spring_incidence(space);
+        if (space->spring_colors_dirty) build_spring_colors(space);
+    }
+    
+    memset(space->spring_lambdas, 0, space->number_of_awake_springs * sizeof(float));
+    
+    run_workers(space->workers, predict_positions, &pass, n);
+    
+    for (unsigned i = 0; i < space->constraint_iterations; i++)
+        run_spring_pass(space, &pass, solve_spring_range);
+    
+    run_workers(space->workers, update_velocities, &pass, n);
+    run_spring_pass(space, &pass, damp_spring_range);
+    run_workers(space->workers, store_positions, &pass, n);
+}
+
+static inline void resolve_plane_collision(sm_mass *mass, const sm_plane *plane) {
+    
+    float e = 1.0 + mass->e;
+    float impulse = vec2DotProduct(mass->vel, plane->normal) * e;
+    
+    if (impulse < 0)
+        mass->vel = vec2Add(mass->vel, vec2Multiply(plane->normal, -impulse));
+}
+
+static void resolve_object_to_plane_collisions(void *context, const unsigned begin, const unsigned end) {
+
+    sm_space *space = context;
+    
+    // Blocks of the broad phase order are narrow in x, and tight in y once masses are sorted
+    for (unsigned b = begin; b < end; b++) {
+        
+        sm_mass     *block[PLANE_BLOCK_SIZE];
+        float       x[PLANE_BLOCK_SIZE + SM_LANES], y[PLANE_BLOCK_SIZE + SM_LANES], r[PLANE_BLOCK_SIZE + SM_LANES];
+        unsigned    count = 0;
+        vec2        min = { INFINITY, INFINITY }, max = { -INFINITY, -INFINITY };
+        
+        // Gather the awake masses of the block into lanes, with their bounds
+        for (unsigned i = b * PLANE_BLOCK_SIZE; i < (b + 1) * PLANE_BLOCK_SIZE && i < space->number_of_masses; i++) {
+            
+            // The order is only rebuilt by the broad phase, and is stale until then
+            sm_mass *mass = space->masses[space->masses_dirty ? i : space->collision_order[i]];
+            
+            // Bodies meet planes in their own contacts
+            if (mass->index >= space->number_of_awake_masses || mass->body) continue;
+            
+            block[count] = mass;
+            x[count] = mass->pos.x;
+            y[count] = mass->pos.y;
+            r[count] = mass->radius;
+            count++;
+            
+            min.x = fminf(min.x, mass->pos.x - mass->radius);
+            min.y = fminf(min.y, mass->pos.y - mass->radius);
+            max.x = fmaxf(max.x, mass->pos.x + mass->radius);
+            max.y = fmaxf(max.y, mass->pos.y + mass->radius);
+        }
+        
+        // Padding lanes sit infinitely far in front of every plane
+        for (unsigned i = count; i < count + SM_LANES; i++) {
+            
+            x[i] = y[i] = 0;
+            r[i] = -INFINITY;
+        }
+        
+        for (unsigned j = 0; j < space->number_of_planes; j++) {
+            
+            const sm_plane *plane = space->planes[j];
+            
+            // Skip planes the block's bounds are entirely in front of
+            const float nearest = plane->d + (plane->normal.x > 0 ? min.x : max.x) * plane->normal.x + (plane->normal.y > 0 ? min.y : max.y) * plane->normal.y;
+            
+            if (!(nearest < 0)) continue;
+            
+            const sm_f4 nx = f4_set1(plane->normal.x), ny = f4_set1(plane->normal.y), d = f4_set1(plane->d);
+            
+            for (unsigned i = 0; i < count; i += SM_LANES) {
+                
+                // d + s.n < r, exactly as the scalar test
+                const sm_f4 distance = f4_add(d, f4_add(f4_mul(f4_load(&x[i]), nx), f4_mul(f4_load(&y[i]), ny)));
+                int         touching = f4_less_mask(distance, f4_load(&r[i]));
+                
+                for (unsigned lane = 0; touching; lane++, touching >>= 1)
+                    if (touching & 1) resolve_plane_collision(block[i + lane], plane);
+            }
+        }
+    }
+}
@@ -12,40 +12,337 @@
 #include "mass.h"
 #include "spring.h"
 #include "plane.h"
+#include "workers.h"
+#include "slots.h"
+#include <stddef.h>
 
 typedef int(*collide_func)(sm_mass *, sm_mass *);
 
+// Defined in recorder.h
+typedef struct sm_recorder sm_recorder;
+
+// Defined in body.h
+typedef struct sm_body sm_body;
+typedef struct sm_body_member sm_body_member;
+
+// Defined in contact.h
+typedef struct sm_contact_constraint sm_contact_constraint;
+typedef struct sm_contact_impulse sm_contact_impulse;
+
+// Decides from collision types alone whether two masses collide. Answers are cached per type
+// pair, so it must give the same answer for the same types.
+typedef int(*collision_filter_func)(void *context, const unsigned short type1, const unsigned short type2);
+
+#define SM_FILTER_CACHE_SIZE 256
+
+typedef struct {
+    
+    unsigned short      type1, type2;
+    unsigned char       valid, collide;
+    
+} sm_filter_entry;
+
+// A resolved mass - mass collision. The normal points from mass1 to mass2, and the impulse
+// is zero when the masses were pushed apart by the separation force instead.
+typedef struct {
+    
+    sm_handle           mass1, mass2;
+    vec2                normal;
+    float               depth;
+    float               impulse;
+    
+} sm_contact;
+
+// Overlapping pair found by the broad phase, as indices into collision_order
+typedef struct {
+
+    unsigned            i, j;
+
+} sm_pair;
+
+typedef struct {
+
+    sm_pair             *pairs;
+    unsigned            number_of_pairs;
+    unsigned            capacity;
+
+} sm_pair_list;
+
+typedef struct {
+
+    unsigned            count;
+    unsigned            capacity;
+    size_t              bytes;
+
+} sm_memory_use;
+
+// Memory held by the space and its pools, not counting masses and planes from elsewhere
+typedef struct {
+
+    sm_memory_use       masses;
+    sm_memory_use       springs;
+    sm_memory_use       planes;
+    sm_memory_use       broad_phase;
+    size_t              total;
+
+} sm_memory_report;
+
+// How masses move each step. Explicit Euler is the original scheme, the one step_space
+// uses with its per-frame factors. The others clear forces after each step like step_space_dt,
+// so step_space runs them for one timestep.
+typedef enum {
+    
+    SM_EXPLICIT_EULER,
+    SM_SEMI_IMPLICIT_EULER,
+    SM_VELOCITY_VERLET,
+    SM_RK4,
+    SM_XPBD
+    
+} sm_integrator;
+
+// How SM_XPBD visits its spring constraints. Gauss-Seidel goes in spring order, so sort the
+// springs for locality. Coloring solves springs that share no mass in parallel.
+typedef enum {
+    
+    SM_GAUSS_SEIDEL,
+    SM_COLORED_GAUSS_SEIDEL
+    
+} sm_constraint_solver;
+
+#define SM_SPRING_COLORS 64
+
+// How contacts between free masses are resolved. A single pass gives each overlapping pair one
+// impulse in sweep order, or the separation force if it is not closing. Sequential impulses
+// solve the step's contacts together as constraints, against velocities that already include
+// the step's forces, warm started from the impulses each pair ended the last step with, so
+// stacks come to rest without the separation force.
+typedef enum {
+    
+    SM_SINGLE_PASS_IMPULSES,
+    SM_SEQUENTIAL_IMPULSES
+    
+} sm_contact_solver;
+
+// Parts of a step timed when profiling. XPBD counts its whole constraint solve as springs.
+typedef enum {
+    
+    SM_PHASE_SPRINGS,
+    SM_PHASE_COLLISIONS,
+    SM_PHASE_INTEGRATION,
+    SM_PHASE_PLANES,
+    SM_NUMBER_OF_PHASES
+    
+} sm_phase;
+
 typedef struct {
     
     float               friction;
     float               v_factor, a_factor;
     float               separation_force;
     
+    // Fixed timestep for step_space_dt, in seconds. Time not yet simulated is kept in the
+    // accumulator, and interpolation is how far it reaches into the next step.
+    float               timestep;
+    float               accumulator;
+    float               interpolation;
+    unsigned            max_steps;
+    
+    sm_integrator       integrator;
+    
+    // With mixed_precision set, springs are evaluated and summed in double, and the semi implicit,
+    // Verlet and RK4 integrators update positions and velocities in double, carrying what float
+    // storage rounds off in each mass's pos_error and vel_error. Explicit Euler and XPBD stay float.
+    int                 mixed_precision;
+    
+    // SM_XPBD treats springs as distance constraints with compliance 1 / k
+    sm_constraint_solver constraint_solver;
+    unsigned            constraint_iterations;
+    
+    // Islands of masses joined by springs and contacts sleep once every mass has been slower
+    // than sleep_velocity, and under sleep_energy if that is set, for sleep_steps steps.
+    // Sleeping is off while sleep_velocity is zero.
+    float               sleep_velocity;
+    float               sleep_energy;
+    unsigned            sleep_steps;
+    
     unsigned            number_of_masses;
     unsigned            number_of_springs;
     unsigned            number_of_planes;
     
+    // Masses and springs that are asleep are kept after the awake ones
+    unsigned            number_of_awake_masses;
+    unsigned            number_of_awake_springs;
+    
     sm_mass             **masses, **masses_end;
-    sm_spring           **springs, **springs_end;
+    sm_spring           *springs, *springs_end;
     sm_plane            **planes, **planes_end;
     
+    // Handles for each of the dense arrays above
+    sm_slots            *mass_slots;
+    sm_slots            *spring_slots;
+    sm_slots            *plane_slots;
+    
+    // Storage for new_pooled_mass and new_pooled_plane, emptied by reset_space
+    sm_pool             *mass_pool;
+    sm_pool             *plane_pool;
+    
     collide_func        mass_collision_callback;
     
+    // Pairs are filtered by type before they are resolved
+    collision_filter_func collision_filter;
+    void                *collision_filter_context;
+    sm_filter_entry     filter_cache[SM_FILTER_CACHE_SIZE];
+    
+    // With record_contacts set, each step_space or step_space_dt call leaves its contacts here
+    int                 record_contacts;
+    sm_contact          *contacts;
+    unsigned            number_of_contacts;
+    unsigned            contact_capacity;
+    
+    // Rigid bodies, and the masses they are made of in the order they were added
+    sm_body             *bodies;
+    unsigned            number_of_bodies;
+    unsigned            body_capacity;
+    sm_body_member      *body_members;
+    unsigned            number_of_body_members;
+    unsigned            body_member_capacity;
+    int                 bodies_dirty;
+    
+    // Contacts of bodies, and of free masses with SM_SEQUENTIAL_IMPULSES, are gathered into
+    // contact_constraints and given contact_iterations passes each step. Impulses are kept by
+    // mass pair to warm start the next step.
+    sm_contact_solver   contact_solver;
+    unsigned            contact_iterations;
+    sm_contact_constraint *contact_constraints;
+    unsigned            number_of_contact_constraints;
+    unsigned            contact_constraint_capacity;
+    sm_contact_impulse  *contact_impulses;
+    unsigned            number_of_contact_impulses;
+    unsigned            contact_impulse_capacity;
+    sm_contact_impulse  *contact_impulse_scratch;
+    unsigned            contact_impulse_scratch_capacity;
+    
+    // With profile set, seconds spent in each phase add up here until cleared
+    int                 profile;
+    double              phase_times[SM_NUMBER_OF_PHASES];
+    
+    // Trajectory recording, null when not recording
+    sm_recorder         *recorder;
+    
+    // Parallel stepping, null when stepping on the calling thread only
+    sm_workers          *workers;
+    
+    // Contiguous copies of the mass state read by the spring kernel
+    vec2                *mass_positions;
+    vec2                *mass_velocities;
+    vec2                *mass_forces;
+    vec2                *mass_external_forces;
+    vec2                *integration_scratch;
+    
+    // Per spring forces, gathered into each mass in spring order
+    vec2                *spring_forces;
+    double              *wide_spring_forces;
+    double              *wide_mass_forces;
+    unsigned            *spring_incidence;
+    unsigned            *spring_incidence_offsets;
+    int                 springs_dirty;
+    
+    // Constraint solver state. The last color holds springs that did not fit the others,
+    // solved on one thread.
+    float               *mass_weights;
+    float               *spring_lambdas;
+    unsigned            *spring_color_order;
+    unsigned char       *spring_colors;
+    unsigned            spring_color_offsets[SM_SPRING_COLORS + 2];
+    int                 spring_colors_dirty;
+    
+    // Room for putting the masses and springs in a new order, so islands can sleep and wake
+    // without allocating
+    sm_mass             **mass_scratch;
+    unsigned            *mass_remap;
+    unsigned            *island_scratch;
+    vec2                *vector_scratch;
+    unsigned            *spring_remap;
+    sm_spring           *spring_scratch;
+    
+    // Island state by mass index
+    unsigned            *rest_steps;
+    unsigned            *island_parents;
+    unsigned            *island_rest;
+    unsigned char       *island_asleep;
+    int                 wake_requested;
+    
+    // Broad phase, mass indices sorted in x and split into fixed size chunks
+    unsigned            *collision_order;
+    unsigned            *collision_scratch;
+    float               *collision_keys;
+    sm_pair_list        *collision_chunks;
+    unsigned            number_of_collision_chunks;
+    int                 masses_dirty;
+    
 } sm_space;
 
 
+// The maximums are initial capacities, the space grows when they are exceeded
 sm_space *new_space(const unsigned max_masses, const unsigned max_springs, const unsigned max_planes);
 void free_space(sm_space * const space);
 
+// Make room for at least this many of each up front. Handles survive growth, pointers from space_spring do not.
+void reserve_space(sm_space * const space, const unsigned masses, const unsigned springs, const unsigned planes);
+void report_space_memory(const sm_space * const space, sm_memory_report *report);
+
+// Remove everything between scenes. Pooled masses and planes are returned to their pools,
+// others still belong to whoever made them.
+void reset_space(sm_space * const space);
+
 void step_space(sm_space * const space);
 
-void add_mass_to_space(sm_space *space, sm_mass *mass);
+// Advances by dt seconds in whole fixed timesteps, each split into substeps, running at most
+// max_steps of them. Forces are per second here. Forces set on the masses before the call are
+// held for all of its steps and then cleared.
+void step_space_dt(sm_space * const space, const float dt, const unsigned substeps);
+
+// Position between the last two fixed timesteps for rendering. A mass moved by hand should
+// have its prev set to match, or it will appear to slide there.
+vec2 interpolated_mass_position(const sm_space * const space, const sm_mass * const mass);
+void interpolate_space_positions(const sm_space * const space, vec2 *positions);
+
+void set_space_collision_filter(sm_space *space, collision_filter_func filter, void *context);
+
+// Sleeping islands wake when an awake mass touches them or when asked. Adding or removing
+// anything wakes the whole space.
+void wake_space(sm_space *space);
+void wake_mass(sm_space *space, sm_mass *mass);
+
+// Kinetic energy plus the energy stored in springs, for watching integrators drift
+double space_energy(const sm_space * const space);
+
+// Threads used by step_space, results are the same for any thread count
+void set_space_threads(sm_space * const space, const unsigned number_of_threads);
+
+// Adding and removing are O(1), removal moves the last object into the gap.
+// Removing a mass also removes its springs, which costs a pass over the springs
+// if it or the mass moved into its place has any. A batch may not name the same mass twice.
+sm_handle add_mass_to_space(sm_space *space, sm_mass *mass);
 void remove_mass_from_space(sm_space *space, sm_mass *mass);
+void add_masses_to_space(sm_space *space, sm_mass * const *masses, const unsigned count, sm_handle *handles);
+void remove_masses_from_space(sm_space *space, sm_mass * const *masses, const unsigned count);
+sm_mass *space_mass(const sm_space *space, const sm_handle mass);
+
+// Spring pointers are only good until the next spring is added or removed
+sm_handle add_spring_to_space(sm_space *space, const sm_spring spring);
+void remove_spring_from_space(sm_space *space, const sm_handle spring);
+void add_springs_to_space(sm_space *space, const sm_spring *springs, const unsigned count, sm_handle *handles);
+void remove_springs_from_space(sm_space *space, const sm_handle *springs, const unsigned count);
+sm_spring *space_spring(const sm_space *space, const sm_handle spring);
 
-void add_spring_to_space(sm_space *space, sm_spring *spring);
-void remove_spring_from_space(sm_space *space, sm_spring *spring);
+// Reorder springs by first mass, and masses along a Morton curve, for locality.
+// Handles are unaffected, but sort_space_masses renumbers masses.
+void sort_space_springs(sm_space *space);
+void sort_space_masses(sm_space *space);
 
-void add_plane_to_space(sm_space *space, sm_plane *plane);
+sm_handle add_plane_to_space(sm_space *space, sm_plane *plane);
 void remove_plane_from_space(sm_space *space, sm_plane *plane);
+sm_plane *space_plane(const sm_space *space, const sm_handle plane);
 
 #endif
@@ -0,0 +1,647 @@
+//
+//  space3.c
+//  spring_mass
+//
+//  Created by Richard Henry on 19/10/2026.
+//  Copyright 2026 Dogstar Diversions. http://www.dogstar.mobi
+//
+
+#include "space3.h"
+#include "simd.h"
+#include "sweep.h"
+
+typedef struct {
+    
+    sm_space3   *space;
+    float       h;
+    
+} integration3;
+
+#pragma mark Space management
+
+static void reserve_masses3(sm_space3 *space, const unsigned capacity);
+static void reserve_springs3(sm_space3 *space, const unsigned capacity);
+static void reserve_planes3(sm_space3 *space, const unsigned capacity);
+
+sm_space3 *new_space3(const unsigned max_masses, const unsigned max_springs, const unsigned max_planes) {
+    
+    sm_space3 *space = calloc(1, sizeof(sm_space3));
+    assert(space);
+    
+    space->friction = 0.04;
+    space->separation_force = 1.0;
+    space->timestep = 1.0 / 60.0;
+    space->integrator = SM_SEMI_IMPLICIT_EULER;
+    
+    space->springs_dirty = 1;
+    space->masses_dirty = 1;
+    
+    reserve_masses3(space, max_masses);
+    reserve_springs3(space, max_springs);
+    reserve_planes3(space, max_planes);
+    
+    return space;
+}
+
+void free_space3(sm_space3 * const space) {
+    
+    if (space->workers) free_workers(space->workers);
+    
+    for (unsigned c = 0; c < space->number_of_collision_chunks; c++)
+        free(space->collision_chunks[c].pairs);
+    
+    float *components[] = {
+        
+        space->pos_x, space->pos_y, space->pos_z, space->vel_x, space->vel_y, space->vel_z,
+        space->acc_x, space->acc_y, space->acc_z, space->frc_x, space->frc_y, space->frc_z,
+        space->inverse_mass, space->radius, space->e, space->spring_x, space->spring_y, space->spring_z
+    };
+    
+    for (unsigned i = 0; i < sizeof(components) / sizeof(components[0]); i++) free(components[i]);
+    
+    free(space->collision_chunks);
+    free(space->collision_keys);
+    free(space->collision_scratch);
+    free(space->collision_order);
+    free(space->spring_incidence_offsets);
+    free(space->spring_incidence);
+    free(space->collision_mask);
+    free(space->collision_type);
+    free(space->planes);
+    free(space->springs);
+    free(space);
+}
+
+void reset_space3(sm_space3 * const space) {
+    
+    // Padding lanes must be inert again before masses reuse them
+    const size_t bytes = space->mass_capacity * sizeof(float);
+    
+    float *components[] = {
+        
+        space->pos_x, space->pos_y, space->pos_z, space->vel_x, space->vel_y, space->vel_z,
+        space->acc_x, space->acc_y, space->acc_z, space->frc_x, space->frc_y, space->frc_z,
+        space->inverse_mass, space->radius, space->e
+    };
+    
+    for (unsigned i = 0; i < sizeof(components) / sizeof(components[0]); i++) memset(components[i], 0, bytes);
+    
+    space->number_of_masses = space->number_of_springs = space->number_of_planes = 0;
+    
+    for (unsigned c = 0; c < space->number_of_collision_chunks; c++)
+        space->collision_chunks[c].number_of_pairs = 0;
+    
+    space->masses_dirty = space->springs_dirty = 1;
+}
+
+void set_space3_threads(sm_space3 * const space, const unsigned number_of_threads) {
+    
+    if (space->workers) {
+        
+        if (space->workers->number_of_threads == number_of_threads) return;
+        
+        free_workers(space->workers);
+        space->workers = 0;
+    }
+    
+    if (number_of_threads > 1) space->workers = new_workers(number_of_threads);
+}
+
+#pragma mark Capacity
+
+static void reserve_masses3(sm_space3 *space, unsigned capacity) {
+    
+    // Whole blocks of lanes, so kernels never need a scalar tail
+    capacity = (capacity + SM_LANES - 1) / SM_LANES * SM_LANES;
+    
+    if (capacity <= space->mass_capacity) return;
+    
+    const unsigned old = space->mass_capacity;
+    
+    float **components[] = {
+        
+        &space->pos_x, &space->pos_y, &space->pos_z, &space->vel_x, &space->vel_y, &space->vel_z,
+        &space->acc_x, &space->acc_y, &space->acc_z, &space->frc_x, &space->frc_y, &space->frc_z,
+        &space->inverse_mass, &space->radius, &space->e
+    };
+    
+    for (unsigned i = 0; i < sizeof(components) / sizeof(components[0]); i++)
+        *components[i] = resize_array_zeroed(*components[i], old, capacity, sizeof(float));
+    
+    space->collision_type = resize_array_zeroed(space->collision_type, old, capacity, sizeof(unsigned short));
+    space->collision_mask = resize_array_zeroed(space->collision_mask, old, capacity, sizeof(unsigned short));
+    space->spring_incidence_offsets = resize_array(space->spring_incidence_offsets, capacity + 1, sizeof(unsigned));
+    space->collision_order = resize_array(space->collision_order, capacity, sizeof(unsigned));
+    space->collision_scratch = resize_array(space->collision_scratch, capacity, sizeof(unsigned));
+    space->collision_keys = resize_array(space->collision_keys, capacity, sizeof(float));
+    
+    // New chunks start with no pairs
+    const unsigned number_of_chunks = sweep_chunks(capacity);
+    
+    space->collision_chunks = resize_array_zeroed(space->collision_chunks, space->number_of_collision_chunks, number_of_chunks, sizeof(sm_pair_list));
+    space->number_of_collision_chunks = number_of_chunks;
+    space->mass_capacity = capacity;
+}
+
+static void reserve_springs3(sm_space3 *space, const unsigned capacity) {
+    
+    if (capacity <= space->spring_capacity) return;
+    
+    space->springs = resize_array(space->springs, capacity, sizeof(sm_spring));
+    space->spring_x = resize_array(space->spring_x, capacity, sizeof(float));
+    space->spring_y = resize_array(space->spring_y, capacity, sizeof(float));
+    space->spring_z = resize_array(space->spring_z, capacity, sizeof(float));
+    space->spring_incidence = resize_array(space->spring_incidence, capacity * 2, sizeof(unsigned));
+    space->spring_capacity = capacity;
+}
+
+static void reserve_planes3(sm_space3 *space, const unsigned capacity) {
+    
+    if (capacity <= space->plane_capacity) return;
+    
+    space->planes = resize_array(space->planes, capacity, sizeof(sm_plane3));
+    space->plane_capacity = capacity;
+}
+
+#pragma mark Objects
+
+unsigned add_mass_to_space3(sm_space3 *space, const vec3 pos, const float mass, const float radius) {
+    
+    assert(mass > 0.0);
+    
+    if (space->number_of_masses == space->mass_capacity) reserve_masses3(space, grown_capacity(space->mass_capacity, space->number_of_masses + 1));
+    
+    const unsigned m = space->number_of_masses++;
+    
+    space->pos_x[m] = pos.x;
+    space->pos_y[m] = pos.y;
+    space->pos_z[m] = pos.z;
+    space->inverse_mass[m] = 1.0 / mass;
+    space->radius[m] = radius;
+    
+    space->masses_dirty = space->springs_dirty = 1;
+    
+    return m;
+}
+
+unsigned add_spring_to_space3(sm_space3 *space, const sm_spring spring) {
+    
+    assert(spring.mass1 < space->number_of_masses && spring.mass2 < space->number_of_masses);
+    
+    if (space->number_of_springs == space->spring_capacity) reserve_springs3(space, grown_capacity(space->spring_capacity, space->number_of_springs + 1));
+    
+    space->springs[space->number_of_springs] = spring;
+    space->springs_dirty = 1;
+    
+    return space->number_of_springs++;
+}
+
+unsigned add_plane_to_space3(sm_space3 *space, const vec3 normal, const float d) {
+    
+    if (space->number_of_planes == space->plane_capacity) reserve_planes3(space, grown_capacity(space->plane_capacity, space->number_of_planes + 1));
+    
+    space->planes[space->number_of_planes] = (sm_plane3) { normal, d };
+    
+    return space->number_of_planes++;
+}
+
+sm_spring new_spring3(const sm_space3 *space, const unsigned mass1, const unsigned mass2, const float k, const float f) {
+    
+    return (sm_spring) { mass1, mass2, k, vec3Length(vec3Subtract(space3_position(space, mass1), space3_position(space, mass2))), f };
+}
+
+vec3 space3_position(const sm_space3 *space, const unsigned mass) {
+    
+    return (vec3) { space->pos_x[mass], space->pos_y[mass], space->pos_z[mass] };
+}
+
+vec3 space3_velocity(const sm_space3 *space, const unsigned mass) {
+    
+    return (vec3) { space->vel_x[mass], space->vel_y[mass], space->vel_z[mass] };
+}
+
+double space3_energy(const sm_space3 * const space) {
+    
+    double energy = 0;
+    
+    for (unsigned m = 0; m < space->number_of_masses; m++) {
+        
+        if (!space->inverse_mass[m]) continue;
+        
+        const double vx = space->vel_x[m], vy = space->vel_y[m], vz = space->vel_z[m];
+        
+        energy += 0.5 * (vx * vx + vy * vy + vz * vz) / space->inverse_mass[m];
+    }
+    
+    for (const sm_spring *spring = space->springs; spring < space->springs + space->number_of_springs; spring++) {
+        
+        const double dx = (double)space->pos_x[spring->mass1] - space->pos_x[spring->mass2];
+        const double dy = (double)space->pos_y[spring->mass1] - space->pos_y[spring->mass2];
+        const double dz = (double)space->pos_z[spring->mass1] - space->pos_z[spring->mass2];
+        const double extension = sqrt(dx * dx + dy * dy + dz * dz) - spring->l;
+        
+        energy += 0.5 * spring->k * extension * extension;
+    }
+    
+    return energy;
+}
+
+#pragma mark Springs
+
+static void calculate_spring_blocks(void *context, const unsigned begin, const unsigned end) {
+    
+    sm_space3 *space = context;
+    
+    // As in sm_space, the last block is padded so every spring goes through the same lanes
+    for (unsigned b = begin; b < end; b++) {
+        
+        const unsigned  first = b * SM_LANES;
+        const unsigned  lanes = space->number_of_springs - first < SM_LANES ? space->number_of_springs - first : SM_LANES;
+        float           dx[SM_LANES] = { 0 }, dy[SM_LANES] = { 0 }, dz[SM_LANES] = { 0 };
+        float           dvx[SM_LANES] = { 0 }, dvy[SM_LANES] = { 0 }, dvz[SM_LANES] = { 0 };
+        float           k[SM_LANES] = { 0 }, l[SM_LANES] = { 0 }, f[SM_LANES] = { 0 };
+        
+        for (unsigned n = 0; n < lanes; n++) {
+            
+            const sm_spring *spring = &space->springs[first + n];
+            const unsigned  m1 = spring->mass1, m2 = spring->mass2;
+            
+            dx[n] = space->pos_x[m1] - space->pos_x[m2];
+            dy[n] = space->pos_y[m1] - space->pos_y[m2];
+            dz[n] = space->pos_z[m1] - space->pos_z[m2];
+            dvx[n] = space->vel_x[m1] - space->vel_x[m2];
+            dvy[n] = space->vel_y[m1] - space->vel_y[m2];
+            dvz[n] = space->vel_z[m1] - space->vel_z[m2];
+            k[n] = spring->k;
+            l[n] = spring->l;
+            f[n] = -spring->f;
+        }
+        
+        const sm_f4 vdx = f4_load(dx), vdy = f4_load(dy), vdz = f4_load(dz), friction = f4_load(f);
+        const sm_f4 length = f4_sqrt(f4_add(f4_add(f4_mul(vdx, vdx), f4_mul(vdy, vdy)), f4_mul(vdz, vdz)));
+        
+        // Spring force along the unit vector between the masses, less spring friction
+        const sm_f4 unit = f4_div(f4_set1(-1), length);
+        const sm_f4 extension = f4_mul(f4_sub(length, f4_load(l)), f4_load(k));
+        const sm_f4 fx = f4_add(f4_mul(f4_mul(vdx, unit), extension), f4_mul(f4_load(dvx), friction));
+        const sm_f4 fy = f4_add(f4_mul(f4_mul(vdy, unit), extension), f4_mul(f4_load(dvy), friction));
+        const sm_f4 fz = f4_add(f4_mul(f4_mul(vdz, unit), extension), f4_mul(f4_load(dvz), friction));
+        
+        // Coincident masses have no direction to push in
+        float force_x[SM_LANES], force_y[SM_LANES], force_z[SM_LANES];
+        
+        f4_store(force_x, f4_where_nonzero(length, fx));
+        f4_store(force_y, f4_where_nonzero(length, fy));
+        f4_store(force_z, f4_where_nonzero(length, fz));
+        
+        for (unsigned n = 0; n < lanes; n++) {
+            
+            space->spring_x[first + n] = force_x[n];
+            space->spring_y[first + n] = force_y[n];
+            space->spring_z[first + n] = force_z[n];
+        }
+    }
+}
+
+static void accumulate_spring_forces(sm_space3 *space) {
+    
+    for (unsigned i = 0; i < space->number_of_springs; i++) {
+        
+        const unsigned m1 = space->springs[i].mass1, m2 = space->springs[i].mass2;
+        
+        space->frc_x[m1] += space->spring_x[i];
+        space->frc_y[m1] += space->spring_y[i];
+        space->frc_z[m1] += space->spring_z[i];
+        space->frc_x[m2] -= space->spring_x[i];
+        space->frc_y[m2] -= space->spring_y[i];
+        space->frc_z[m2] -= space->spring_z[i];
+    }
+}
+
+static void build_spring_incidence(sm_space3 *space) {
+    
+    unsigned *offsets = space->spring_incidence_offsets;
+    
+    memset(offsets, 0, (space->number_of_masses + 1) * sizeof(unsigned));
+    
+    for (unsigned i = 0; i < space->number_of_springs; i++) {
+        
+        offsets[space->springs[i].mass1 + 1]++;
+        offsets[space->springs[i].mass2 + 1]++;
+    }
+    
+    for (unsigned m = 0; m < space->number_of_masses; m++) offsets[m + 1] += offsets[m];
+    
+    // Spring order within each mass, with the low bit for the end of the spring it is on
+    for (unsigned i = 0; i < space->number_of_springs; i++) {
+        
+        space->spring_incidence[offsets[space->springs[i].mass1]++] = i << 1;
+        space->spring_incidence[offsets[space->springs[i].mass2]++] = i << 1 | 1;
+    }
+    
+    memmove(offsets + 1, offsets, space->number_of_masses * sizeof(unsigned));
+    offsets[0] = 0;
+    
+    space->springs_dirty = 0;
+}
+
+static void gather_spring_range(void *context, const unsigned begin, const unsigned end) {
+    
+    sm_space3 *space = context;
+    
+    for (unsigned m = begin; m < end; m++) {
+        
+        float x = space->frc_x[m], y = space->frc_y[m], z = space->frc_z[m];
+        
+        for (unsigned e = space->spring_incidence_offsets[m]; e < space->spring_incidence_offsets[m + 1]; e++) {
+            
+            const unsigned incidence = space->spring_incidence[e], i = incidence >> 1;
+            
+            if (incidence & 1) {
+                
+                x -= space->spring_x[i];
+                y -= space->spring_y[i];
+                z -= space->spring_z[i];
+                
+            } else {
+                
+                x += space->spring_x[i];
+                y += space->spring_y[i];
+                z += space->spring_z[i];
+            }
+        }
+        
+        space->frc_x[m] = x;
+        space->frc_y[m] = y;
+        space->frc_z[m] = z;
+    }
+}
+
+static void calculate_spring_forces(sm_space3 *space) {
+    
+    if (!space->number_of_springs) return;
+    
+    run_workers(space->workers, calculate_spring_blocks, space, (space->number_of_springs + SM_LANES - 1) / SM_LANES);
+    
+    if (space->workers) {
+        
+        if (space->springs_dirty) build_spring_incidence(space);
+        
+        run_workers(space->workers, gather_spring_range, space, space->number_of_masses);
+        
+    } else {
+        
+        accumulate_spring_forces(space);
+    }
+}
+
+#pragma mark Collisions
+
+static void sort_collision_order(sm_space3 *space) {
+    
+    const unsigned n = space->number_of_masses;
+    
+    if (space->masses_dirty) {
+        
+        for (unsigned m = 0; m < n; m++) space->collision_order[m] = m;
+        
+        space->masses_dirty = 0;
+    }
+    
+    // The same sweep as sm_space, keyed by the low edge in x
+    for (unsigned m = 0; m < n; m++) space->collision_keys[m] = space->pos_x[m] - space->radius[m];
+    
+    sort_sweep_order(space->collision_order, space->collision_scratch, space->collision_keys, n);
+}
+
+static inline int sweep_pair(const void *context, const unsigned a, const unsigned b) {
+    
+    const sm_space3 *space = context;
+    
+    // Partition reject, and masses that collide with nothing sweep no further
+    if (space->pos_x[a] + space->radius[a] < space->collision_keys[b] || !space->collision_mask[a]) return SM_SWEEP_END;
+    
+    if (!(space->collision_mask[a] & space->collision_type[b])) return SM_SWEEP_SEPARATE;
+    
+    const float dx = space->pos_x[b] - space->pos_x[a], dy = space->pos_y[b] - space->pos_y[a], dz = space->pos_z[b] - space->pos_z[a];
+    const float radius_sum = space->radius[a] + space->radius[b];
+    
+    return dx * dx + dy * dy + dz * dz < radius_sum * radius_sum ? SM_SWEEP_OVERLAP : SM_SWEEP_SEPARATE;
+}
+
+static void find_collision_pairs(void *context, const unsigned begin, const unsigned end) {
+    
+    sm_space3 *space = context;
+    
+    find_sweep_pairs(space->collision_chunks, begin, end, space->collision_order, space->number_of_masses, sweep_pair, space);
+}
+
+static void resolve_collision(sm_space3 *space, const unsigned a, const unsigned b) {
+    
+    vec3        normal = { space->pos_x[b] - space->pos_x[a], space->pos_y[b] - space->pos_y[a], space->pos_z[b] - space->pos_z[a] };
+    const float inverse_mass_sum = space->inverse_mass[a] + space->inverse_mass[b];
+    
+    if (!vec3DotProduct(normal, normal) || !inverse_mass_sum) return;
+    
+    const float e = space->e[a] + space->e[b];
+    const vec3  relative_velocity = { (space->vel_x[b] - space->vel_x[a]) * e, (space->vel_y[b] - space->vel_y[a]) * e, (space->vel_z[b] - space->vel_z[a]) * e };
+    
+    normal = vec3Normalize(normal);
+    
+    const float impulse = vec3DotProduct(relative_velocity, normal) / inverse_mass_sum;
+    
+    if (impulse < 0) {
+        
+        // Exit velocities
+        space->vel_x[a] += normal.x * impulse * space->inverse_mass[a];
+        space->vel_y[a] += normal.y * impulse * space->inverse_mass[a];
+        space->vel_z[a] += normal.z * impulse * space->inverse_mass[a];
+        space->vel_x[b] -= normal.x * impulse * space->inverse_mass[b];
+        space->vel_y[b] -= normal.y * impulse * space->inverse_mass[b];
+        space->vel_z[b] -= normal.z * impulse * space->inverse_mass[b];
+        
+    } else {
+        
+        // Separation forces
+        space->frc_x[a] -= normal.x * space->separation_force;
+        space->frc_y[a] -= normal.y * space->separation_force;
+        space->frc_z[a] -= normal.z * space->separation_force;
+        space->frc_x[b] += normal.x * space->separation_force;
+        space->frc_y[b] += normal.y * space->separation_force;
+        space->frc_z[b] += normal.z * space->separation_force;
+    }
+}
+
+static void resolve_mass_collisions(sm_space3 *space) {
+    
+    sort_collision_order(space);
+    
+    const unsigned number_of_chunks = sweep_chunks(space->number_of_masses);
+    
+    run_workers(space->workers, find_collision_pairs, space, number_of_chunks);
+    
+    // Resolve in sweep order whatever the thread split
+    for (unsigned c = 0; c < number_of_chunks; c++) {
+        
+        const sm_pair_list *list = &space->collision_chunks[c];
+        
+        for (unsigned p = 0; p < list->number_of_pairs; p++)
+            resolve_collision(space, space->collision_order[list->pairs[p].i], space->collision_order[list->pairs[p].j]);
+    }
+}
+
+static void resolve_plane_collisions(void *context, const unsigned begin, const unsigned end) {
+    
+    sm_space3 *space = context;
+    
+    for (unsigned b = begin; b < end; b++) {
+        
+        const unsigned  first = b * SM_LANES;
+        const sm_f4     x = f4_load(&space->pos_x[first]), y = f4_load(&space->pos_y[first]), z = f4_load(&space->pos_z[first]);
+        const sm_f4     r = f4_load(&space->radius[first]);
+        
+        for (unsigned j = 0; j < space->number_of_planes; j++) {
+            
+            const sm_plane3 *plane = &space->planes[j];
+            
+            // d + s.n < r, padding lanes are skipped if they touch
+            const sm_f4 distance = f4_add(f4_set1(plane->d), f4_add(f4_add(f4_mul(x, f4_set1(plane->normal.x)), f4_mul(y, f4_set1(plane->normal.y))), f4_mul(z, f4_set1(plane->normal.z))));
+            int         touching = f4_less_mask(distance, r);
+            
+            for (unsigned m = first; touching; m++, touching >>= 1) {
+                
+                if (!(touching & 1) || m >= space->number_of_masses) continue;
+                
+                const float impulse = (space->vel_x[m] * plane->normal.x + space->vel_y[m] * plane->normal.y + space->vel_z[m] * plane->normal.z) * (1.0 + space->e[m]);
+                
+                if (impulse < 0) {
+                    
+                    space->vel_x[m] -= plane->normal.x * impulse;
+                    space->vel_y[m] -= plane->normal.y * impulse;
+                    space->vel_z[m] -= plane->normal.z * impulse;
+                }
+            }
+        }
+    }
+}
+
+#pragma mark Integration
+
+// v' = v + ah for one component of a block, where a = f / m - v friction
+static inline sm_f4 kick_lanes(const sm_space3 *space, const float *vel, const float *frc, float *acc, const unsigned first, const sm_f4 h) {
+    
+    const sm_f4 v = f4_load(&vel[first]);
+    const sm_f4 a = f4_sub(f4_mul(f4_load(&frc[first]), f4_load(&space->inverse_mass[first])), f4_mul(v, f4_set1(space->friction)));
+    
+    f4_store(&acc[first], a);
+    
+    return f4_add(v, f4_mul(a, h));
+}
+
+static void integrate_semi_implicit(void *context, const unsigned begin, const unsigned end) {
+    
+    const integration3  *step = context;
+    sm_space3           *space = step->space;
+    const sm_f4         h = f4_set1(step->h);
+    
+    for (unsigned b = begin; b < end; b++) {
+        
+        const unsigned first = b * SM_LANES;
+        
+        // s' = s + v'h
+        const sm_f4 vx = kick_lanes(space, space->vel_x, space->frc_x, space->acc_x, first, h);
+        const sm_f4 vy = kick_lanes(space, space->vel_y, space->frc_y, space->acc_y, first, h);
+        const sm_f4 vz = kick_lanes(space, space->vel_z, space->frc_z, space->acc_z, first, h);
+        
+        f4_store(&space->vel_x[first], vx);
+        f4_store(&space->vel_y[first], vy);
+        f4_store(&space->vel_z[first], vz);
+        f4_store(&space->pos_x[first], f4_add(f4_load(&space->pos_x[first]), f4_mul(vx, h)));
+        f4_store(&space->pos_y[first], f4_add(f4_load(&space->pos_y[first]), f4_mul(vy, h)));
+        f4_store(&space->pos_z[first], f4_add(f4_load(&space->pos_z[first]), f4_mul(vz, h)));
+    }
+}
+
+static inline void drift_lanes(float *pos, float *vel, const float *acc, const unsigned first, const sm_f4 h, const sm_f4 half_h, const sm_f4 half_h2) {
+    
+    const sm_f4 v = f4_load(&vel[first]), a = f4_load(&acc[first]);
+    
+    f4_store(&pos[first], f4_add(f4_load(&pos[first]), f4_add(f4_mul(v, h), f4_mul(a, half_h2))));
+    f4_store(&vel[first], f4_add(v, f4_mul(a, half_h)));
+}
+
+static void verlet_drift(void *context, const unsigned begin, const unsigned end) {
+    
+    const integration3  *step = context;
+    sm_space3           *space = step->space;
+    const sm_f4         h = f4_set1(step->h), half_h = f4_set1(0.5 * step->h), half_h2 = f4_set1(0.5 * step->h * step->h);
+    
+    for (unsigned b = begin; b < end; b++) {
+        
+        const unsigned first = b * SM_LANES;
+        
+        drift_lanes(space->pos_x, space->vel_x, space->acc_x, first, h, half_h, half_h2);
+        drift_lanes(space->pos_y, space->vel_y, space->acc_y, first, h, half_h, half_h2);
+        drift_lanes(space->pos_z, space->vel_z, space->acc_z, first, h, half_h, half_h2);
+    }
+}
+
+static void verlet_kick(void *context, const unsigned begin, const unsigned end) {
+    
+    const integration3  *step = context;
+    sm_space3           *space = step->space;
+    const sm_f4         half_h = f4_set1(0.5 * step->h);
+    
+    for (unsigned b = begin; b < end; b++) {
+        
+        const unsigned first = b * SM_LANES;
+        
+        f4_store(&space->vel_x[first], kick_lanes(space, space->vel_x, space->frc_x, space->acc_x, first, half_h));
+        f4_store(&space->vel_y[first], kick_lanes(space, space->vel_y, space->frc_y, space->acc_y, first, half_h));
+        f4_store(&space->vel_z[first], kick_lanes(space, space->vel_z, space->frc_z, space->acc_z, first, half_h));
+    }
+}
+
+static void clear_forces(void *context, const unsigned begin, const unsigned end) {
+    
+    sm_space3 *space = context;
+    
+    for (unsigned b = begin; b < end; b++) {
+        
+        f4_store(&space->frc_x[b * SM_LANES], f4_set1(0));
+        f4_store(&space->frc_y[b * SM_LANES], f4_set1(0));
+        f4_store(&space->frc_z[b * SM_LANES], f4_set1(0));
+    }
+}
+
+#pragma mark Simulation step
+
+void step_space3(sm_space3 * const space) {
+    
+    assert(space->integrator == SM_SEMI_IMPLICIT_EULER || space->integrator == SM_VELOCITY_VERLET);
+    
+    const unsigned  blocks = (space->number_of_masses + SM_LANES - 1) / SM_LANES;
+    integration3    step = { space, space->timestep };
+    double          clock = phase_clock(space->profile);
+    
+    if (space->integrator == SM_VELOCITY_VERLET) {
+        
+        // Drift on the last acceleration, then kick with the new one
+        run_workers(space->workers, verlet_drift, &step, blocks);
+        clock = end_phase(space->phase_times, space->profile, SM_PHASE_INTEGRATION, clock);
+    }
+    
+    calculate_spring_forces(space);
+    clock = end_phase(space->phase_times, space->profile, SM_PHASE_SPRINGS, clock);
+    resolve_mass_collisions(space);
+    clock = end_phase(space->phase_times, space->profile, SM_PHASE_COLLISIONS, clock);
+    run_workers(space->workers, space->integrator == SM_VELOCITY_VERLET ? verlet_kick : integrate_semi_implicit, &step, blocks);
+    run_workers(space->workers, clear_forces, space, blocks);
+    clock = end_phase(space->phase_times, space->profile, SM_PHASE_INTEGRATION, clock);
+    
+    if (space->number_of_planes) {
+        
+        run_workers(space->workers, resolve_plane_collisions, space, blocks);
+        end_phase(space->phase_times, space->profile, SM_PHASE_PLANES, clock);
+    }
+}
@@ -0,0 +1,107 @@
+//
+//  space3.h
+//  spring_mass
+//
+//  Created by Richard Henry on 19/10/2026.
+//  Copyright 2026 Dogstar Diversions. http://www.dogstar.mobi
+//
+
+#ifndef SM_SPACE3_H
+#define SM_SPACE3_H
+
+#include "space.h"
+
+// A 3D space for cloth and rope. Mass state is kept a component to an array, each array
+// padded with inert masses to a whole number of SIMD lanes, so the integrators, springs and
+// planes run four masses at a time. Masses and springs are referred to by index and stay
+// until reset_space3. Springs are the 2D sm_spring, and the broad phase, integrators,
+// threading and profiling work as they do in sm_space.
+
+typedef struct {
+    
+    vec3                normal;
+    float               d;
+    
+} sm_plane3;
+
+typedef struct {
+    
+    float               friction;
+    float               separation_force;
+    float               timestep;
+    
+    // SM_SEMI_IMPLICIT_EULER or SM_VELOCITY_VERLET
+    sm_integrator       integrator;
+    
+    unsigned            number_of_masses;
+    unsigned            number_of_springs;
+    unsigned            number_of_planes;
+    unsigned            mass_capacity;
+    unsigned            spring_capacity;
+    unsigned            plane_capacity;
+    
+    // Mass state by index. Forces set before step_space3 are held for the step and then
+    // cleared. A pinned mass has an inverse mass of zero.
+    float               *pos_x, *pos_y, *pos_z;
+    float               *vel_x, *vel_y, *vel_z;
+    float               *acc_x, *acc_y, *acc_z;
+    float               *frc_x, *frc_y, *frc_z;
+    float               *inverse_mass;
+    float               *radius;
+    float               *e;
+    unsigned short      *collision_type;
+    unsigned short      *collision_mask;
+    
+    sm_spring           *springs;
+    sm_plane3           *planes;
+    
+    // Per spring forces, gathered into each mass in spring order
+    float               *spring_x, *spring_y, *spring_z;
+    unsigned            *spring_incidence;
+    unsigned            *spring_incidence_offsets;
+    int                 springs_dirty;
+    
+    // Broad phase, mass indices sorted in x and split into fixed size chunks
+    unsigned            *collision_order;
+    unsigned            *collision_scratch;
+    float               *collision_keys;
+    sm_pair_list        *collision_chunks;
+    unsigned            number_of_collision_chunks;
+    int                 masses_dirty;
+    
+    // With profile set, seconds spent in each phase add up here until cleared
+    int                 profile;
+    double              phase_times[SM_NUMBER_OF_PHASES];
+    
+    // Parallel stepping, null when stepping on the calling thread only
+    sm_workers          *workers;
+    
+} sm_space3;
+
+// The maximums are initial capacities, the space grows when they are exceeded
+sm_space3 *new_space3(const unsigned max_masses, const unsigned max_springs, const unsigned max_planes);
+void free_space3(sm_space3 * const space);
+void reset_space3(sm_space3 * const space);
+
+// Advances one timestep
+void step_space3(sm_space3 * const space);
+
+// Threads used by step_space3, results are the same for any thread count
+void set_space3_threads(sm_space3 * const space, const unsigned number_of_threads);
+
+// Kinetic energy of the free masses plus the energy stored in springs
+double space3_energy(const sm_space3 * const space);
+
+// A mass of INFINITY is pinned where it is put. New masses collide with nothing until
+// given a collision type and mask.
+unsigned add_mass_to_space3(sm_space3 *space, const vec3 pos, const float mass, const float radius);
+unsigned add_spring_to_space3(sm_space3 *space, const sm_spring spring);
+unsigned add_plane_to_space3(sm_space3 *space, const vec3 normal, const float d);
+
+// A spring at rest at the current distance between two masses
+sm_spring new_spring3(const sm_space3 *space, const unsigned mass1, const unsigned mass2, const float k, const float f);
+
+vec3 space3_position(const sm_space3 *space, const unsigned mass);
+vec3 space3_velocity(const sm_space3 *space, const unsigned mass);
+
+#endif
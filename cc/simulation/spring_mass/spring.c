@@ -7,20 +7,20 @@
 //
 
 #include "spring.h"
-#include <stdlib.h>
 #include <assert.h>
 
-sm_spring *new_spring(sm_mass * const m1, sm_mass * const m2, const float k, const float l, const float f) {
+sm_spring new_spring(const sm_mass * const m1, const sm_mass * const m2, const float k, const float l, const float f) {
 
-    sm_spring *spring = calloc(1, sizeof(sm_spring));
-    assert(spring);
+    assert(m1 && m2 && m1 != m2);
     
-    spring->mass1 = m1;
-    spring->mass2 = m2;
+    sm_spring spring;
     
-    spring->k = k;
-    spring->l = l;
-    spring->k = f;
+    spring.mass1 = m1->index;
+    spring.mass2 = m2->index;
+    
+    spring.k = k;
+    spring.l = l;
+    spring.f = f;
     
     return spring;
 }
@@ -11,15 +11,17 @@
 
 #include "mass.h"
 
+// Springs are stored by value in their space, referring to masses by index
 typedef struct {
     
-    sm_mass         *mass1, *mass2;
+    unsigned        mass1, mass2;
     float           k;
     float           l;
     float           f;
     
 } sm_spring;
 
-sm_spring *new_spring(sm_mass * const m1, sm_mass * const m2, const float k, const float l, const float f);
+// Both masses must already be in the space the spring is added to
+sm_spring new_spring(const sm_mass * const m1, const sm_mass * const m2, const float k, const float l, const float f);
 
 #endif
@@ -0,0 +1,50 @@
+//
+//  sweep.c
+//  spring_mass
+//
+//  Created by Richard Henry on 19/10/2026.
+//  Copyright 2026 Dogstar Diversions. http://www.dogstar.mobi
+//
+
+#include "sweep.h"
+
+#define SWEEP_SORT_RUN 32
+
+void sort_sweep_order(unsigned *order, unsigned *scratch, const float *keys, const unsigned n) {
+    
+    // Insertion sort short runs, then merge them in widening passes with no allocation
+    for (unsigned lo = 0; lo < n; lo += SWEEP_SORT_RUN) {
+        
+        const unsigned hi = lo + SWEEP_SORT_RUN < n ? lo + SWEEP_SORT_RUN : n;
+        
+        for (unsigned i = lo + 1; i < hi; i++) {
+            
+            const unsigned  m = order[i];
+            unsigned        j = i;
+            
+            for (; j > lo && keys[order[j - 1]] > keys[m]; j--) order[j] = order[j - 1];
+            
+            order[j] = m;
+        }
+    }
+    
+    for (unsigned width = SWEEP_SORT_RUN; width < n; width *= 2) {
+        
+        for (unsigned lo = 0; lo + width < n; lo += width * 2) {
+            
+            const unsigned mid = lo + width, hi = mid + width < n ? mid + width : n;
+            
+            if (!(keys[order[mid - 1]] > keys[order[mid]])) continue;
+            
+            // Merge the left run back in from the scratch copy
+            unsigned l = 0, r = mid, o = lo;
+            
+            memcpy(scratch, &order[lo], width * sizeof(unsigned));
+            
+            while (l < width && r < hi)
+                order[o++] = keys[order[r]] < keys[scratch[l]] ? order[r++] : scratch[l++];
+            
+            while (l < width) order[o++] = scratch[l++];
+        }
+    }
+}
@@ -0,0 +1,58 @@
+//
+//  sweep.h
+//  spring_mass
+//
+//  Created by Richard Henry on 19/10/2026.
+//  Copyright 2026 Dogstar Diversions. http://www.dogstar.mobi
+//
+
+#ifndef SM_SWEEP_H
+#define SM_SWEEP_H
+
+#include "internal.h"
+
+// The broad phase of sm_space and sm_space3. Masses are swept by index in order of the low
+// edge of their bounds in x, and the sweep is split into fixed size chunks that are searched
+// side by side. Pairs come out in the same order however the chunks are split between threads.
+#define SM_SWEEP_CHUNK_SIZE 256
+
+static inline unsigned sweep_chunks(const unsigned n) { return (n + SM_SWEEP_CHUNK_SIZE - 1) / SM_SWEEP_CHUNK_SIZE; }
+
+// Stably sorts n indices by their keys, scratch holding as many. The order carries over
+// between steps, so most runs are already in order and skip their merge.
+void sort_sweep_order(unsigned *order, unsigned *scratch, const float *keys, const unsigned n);
+
+enum { SM_SWEEP_SEPARATE, SM_SWEEP_OVERLAP, SM_SWEEP_END };
+
+// Tests the masses a and b, b later in the sweep, ending a's sweep when nothing further on can touch it
+typedef int (*sweep_test_func)(const void *context, const unsigned a, const unsigned b);
+
+// Lists the overlapping pairs that start in each chunk from begin to end, by position in the
+// order. Inline so that each space's test is inlined into its own copy of the loop.
+static inline void find_sweep_pairs(sm_pair_list *chunks, const unsigned begin, const unsigned end, const unsigned *order, const unsigned n, const sweep_test_func test, const void *context) {
+    
+    for (unsigned c = begin; c < end; c++) {
+        
+        sm_pair_list    *list = &chunks[c];
+        const unsigned  chunk_end = (c + 1) * SM_SWEEP_CHUNK_SIZE;
+        
+        list->number_of_pairs = 0;
+        
+        for (unsigned i = c * SM_SWEEP_CHUNK_SIZE; i < chunk_end && i < n; i++) {
+            
+            for (unsigned j = i + 1; j < n; j++) {
+                
+                const int pair = test(context, order[i], order[j]);
+                
+                if (pair == SM_SWEEP_END) break;
+                
+                if (pair == SM_SWEEP_SEPARATE) continue;
+                
+                list->pairs = grow_array(list->pairs, &list->capacity, list->number_of_pairs + 1, sizeof(sm_pair));
+                list->pairs[list->number_of_pairs++] = (sm_pair) { i, j };
+            }
+        }
+    }
+}
+
+#endif
@@ -6,6 +6,10 @@
 //  Copyright 2011 Dogstar Diversions. http://www.dogstar.mobi
 //
 
+// Always build the extern definitions, whichever way the units using them are configured
+#undef DVECTOR_INLINE
+#undef DVECTOR_STATIC
+
 #define DVECTOR_IMPLEMENTATION
 #include "vector.h"
 #undef DVECTOR_IMPLEMENTATION
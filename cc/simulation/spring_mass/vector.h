@@ -15,19 +15,37 @@ If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
 */
 
 /*
-dvector supports the following three configurations:
+dvector supports the following four configurations:
 #define DVECTOR_EXTERN
     Default, should be used when using dvector in multiple compilation units within the same project.
 #define DVECTOR_IMPLEMENTATION
     Must be defined in exactly one source file within a project for dvector to be found by the linker.
 #define DVECTOR_STATIC
     Defines all dvector functions as static, useful if dvector is only used in a single compilation unit.
+#define DVECTOR_INLINE
+    Defines all dvector functions as static inline in every compilation unit that includes dvector, so hot
+    loops inline them without link time optimisation. The extern definitions are still built by the
+    DVECTOR_IMPLEMENTATION source, so units with and without DVECTOR_INLINE can be mixed. C only, C++
+    units fall back to DVECTOR_EXTERN as the implementation uses compound literals.
 
 dvector supports the following additional options:
 #define DVECTOR_DOUBLE
     Configures dvector to use double instead of the default float. Cannot use both float and double versions in the same compilation unit.
 #define DVECTOR_ISOC
     Changes the way dvector types are defined for compatibility with ISO C99. Only affects convenience without limiting functionality.
+#define DVECTOR_SIMD
+    Aligns vec4, quat and mat4 (and so frst) to 16 bytes and implements mat4 multiplication and inversion, mat4 vector
+    multiplication and quat multiplication and slerp with SSE. Float only, and ignored where SSE is not available. Changes
+    the layout of anything holding those types, so every compilation unit sharing them must agree on it. Pair it with
+    DVECTOR_INLINE, as calling conventions pass vec4 and quat arguments in halves that the extern versions must reassemble.
+#define DVECTOR_NO_SIMD
+    Keeps the batch functions to plain loops.
+#define DVECTOR_FAST_MATH
+    Makes the vec2, vec3 and vec4 (and so quat) length and normalize functions, and the batch normalizations, the Fast
+    versions below. Fast functions scale by a reciprocal square root estimate refined by one Newton step, so they work
+    on sums of squares like the batch functions, and lengths under 1e-19 read as smaller than they are. Relative error
+    is within 5e-7 with SSE or AVX, 3e-5 with NEON and 2e-3 elsewhere; double always uses sqrt. Batch lengths keep
+    sqrt, which pipelines as well as the estimate and its Newton step on current x86.
 
 dvector types:
     Supports vec2, vec3, vec4, quat, mat2, mat3, and mat4 types with various property aliases for flexible use and concise code.
@@ -37,6 +55,9 @@ dvector types:
 
 dvector functions:
     Provided functions should be reasonably self-explanatory, and use of macros was deliberately kept low for better readability.
+    Batch functions work on n vectors stored as one array per component (SoA), using AVX, SSE or NEON for float when the
+    compiler targets them and plain loops otherwise, or always with DVECTOR_NO_SIMD. Their lengths are square roots of sums
+    of squares rather than hypot, so they overflow for components beyond about 1e19 in float.
     All equality functions use direct comparison (no epsilon), therefore floating point errors may break equality for some values.
     All quat functions should return normalized quats, occasional normalization is recommended due to float error accumulation.
     All angles are in radians. Frustum culling of volumes returns 1 for volumes inside the frustum, 0 for volumes outside it.
@@ -48,7 +69,14 @@ dvector functions:
 #define DVECTOR_H
 
 //process configuration
-#ifdef DVECTOR_STATIC
+#if defined(DVECTOR_INLINE) && !defined(__cplusplus)
+    #define DVECTOR_IMPLEMENTATION
+    #if defined(__GNUC__) || defined(__clang__)
+        #define DVDEF static inline __attribute__((always_inline))
+    #else
+        #define DVDEF static inline
+    #endif
+#elif defined(DVECTOR_STATIC)
     #define DVECTOR_IMPLEMENTATION
     #define DVDEF static
 #else //DVECTOR_EXTERN
@@ -103,6 +131,7 @@ void foo(){
     #define DVTAN tan
     #define DVACOS acos
     #define DVHYPOT hypot
+    #define DVSQRT sqrt
 #else
     #define DVTYPE float
     #define DVCOS cosf
@@ -110,6 +139,19 @@ void foo(){
     #define DVTAN tanf
     #define DVACOS acosf
     #define DVHYPOT hypotf
+    #define DVSQRT sqrtf
+#endif
+
+//simd configuration
+#if defined(DVECTOR_SIMD) && !defined(DVECTOR_DOUBLE) && (defined(__SSE__) || defined(_M_X64))
+    #define DVSIMD
+    #if defined(_MSC_VER)
+        #define DVALIGN __declspec(align(16))
+    #else
+        #define DVALIGN __attribute__((aligned(16)))
+    #endif
+#else
+    #define DVALIGN
 #endif
 
 //types
@@ -120,7 +162,7 @@ void foo(){
     typedef struct vec3 {
         DVTYPE x, y, z;
     } vec3;
-    typedef struct vec4 {
+    typedef struct DVALIGN vec4 {
         DVTYPE x, y, z, w;
     } vec4, quat;
     typedef union mat2 {
@@ -131,7 +173,7 @@ void foo(){
         DVTYPE m[3][3];
         vec3 col[3];
     } mat3;
-    typedef union mat4 {
+    typedef union DVALIGN mat4 {
         DVTYPE m[4][4];
         vec4 col[4];
     } mat4;
@@ -150,7 +192,7 @@ void foo(){
         struct {vec2 xy; DVTYPE _z;};
         struct {DVTYPE _x; vec2 yz;};
     } vec3;
-    typedef union vec4 {
+    typedef union DVALIGN vec4 {
         DVTYPE v[4];
         struct {DVTYPE x, y, z, w;};
         struct {vec3 xyz; DVTYPE _w;};
@@ -170,7 +212,7 @@ void foo(){
         vec3 col[3];
         struct {vec3 col0, col1, col2;};
     } mat3;
-    typedef union mat4 {
+    typedef union DVALIGN mat4 {
         DVTYPE m[4][4];
         struct {DVTYPE m00, m01, m02, m03, m10, m11, m12, m13, m20, m21, m22, m23, m30, m31, m32, m33;};
         vec4 col[4];
@@ -304,15 +346,125 @@ DVDEF frst frstFromMatrix(mat4);
 DVDEF int frstCullSphere(frst, vec3, DVTYPE);
 DVDEF int frstCullAABB(frst, vec3, vec3);
 
+//batch function declarations
+#include <stddef.h>
+#include <stdint.h>
+#ifdef __cplusplus
+    #define DVRESTRICT __restrict
+#else
+    #define DVRESTRICT restrict
+#endif
+DVDEF void vec2LengthBatch(const DVTYPE *x, const DVTYPE *y, DVTYPE *DVRESTRICT length, size_t n);
+DVDEF void vec3LengthBatch(const DVTYPE *x, const DVTYPE *y, const DVTYPE *z, DVTYPE *DVRESTRICT length, size_t n);
+DVDEF void vec2DotProductBatch(const DVTYPE *x1, const DVTYPE *y1, const DVTYPE *x2, const DVTYPE *y2, DVTYPE *DVRESTRICT dot, size_t n);
+DVDEF void vec3DotProductBatch(const DVTYPE *x1, const DVTYPE *y1, const DVTYPE *z1, const DVTYPE *x2, const DVTYPE *y2, const DVTYPE *z2, DVTYPE *DVRESTRICT dot, size_t n);
+DVDEF void vec2NormalizeBatch(DVTYPE *DVRESTRICT x, DVTYPE *DVRESTRICT y, size_t n);
+DVDEF void vec3NormalizeBatch(DVTYPE *DVRESTRICT x, DVTYPE *DVRESTRICT y, DVTYPE *DVRESTRICT z, size_t n);
+//y += a * x, for any one component array
+DVDEF void axpyBatch(DVTYPE a, const DVTYPE *DVRESTRICT x, DVTYPE *DVRESTRICT y, size_t n);
+//points with w = 1, keeping xyz of the result; outputs may be the inputs
+DVDEF void mat4MultiplyPointBatch(mat4 m, const DVTYPE *x, const DVTYPE *y, const DVTYPE *z, DVTYPE *ox, DVTYPE *oy, DVTYPE *oz, size_t n);
+//the same tests as frstCullSphere and frstCullAABB, returning how many are visible; either output may be null, indices
+//receives the visible indices in ascending order and bits one bit per volume, bit i%32 of word i/32
+DVDEF size_t frstCullSphereBatch(frst f, const DVTYPE *x, const DVTYPE *y, const DVTYPE *z, const DVTYPE *radius, unsigned *indices, uint32_t *bits, size_t n);
+DVDEF size_t frstCullAABBBatch(frst f, const DVTYPE *minx, const DVTYPE *miny, const DVTYPE *minz, const DVTYPE *maxx, const DVTYPE *maxy, const DVTYPE *maxz, unsigned *indices, uint32_t *bits, size_t n);
+//an implicit bounding volume hierarchy over runs of 32 spheres, only worth it when the order of the spheres keeps neighbours
+//close (along a Morton curve, for example); the tree takes frstTreeSize(n) vec3 and must be rebuilt when the spheres move
+DVDEF size_t frstTreeSize(size_t n);
+DVDEF void frstBuildSphereTree(const DVTYPE *x, const DVTYPE *y, const DVTYPE *z, const DVTYPE *radius, vec3 *tree, size_t n);
+DVDEF size_t frstCullSphereTree(frst f, const DVTYPE *x, const DVTYPE *y, const DVTYPE *z, const DVTYPE *radius, const vec3 *tree, unsigned *indices, uint32_t *bits, size_t n);
+
+//fast function declarations
+DVDEF DVTYPE vec2LengthFast(vec2);
+DVDEF DVTYPE vec3LengthFast(vec3);
+DVDEF DVTYPE vec4LengthFast(vec4);
+DVDEF vec2 vec2NormalizeFast(vec2);
+DVDEF vec3 vec3NormalizeFast(vec3);
+DVDEF vec4 vec4NormalizeFast(vec4);
+DVDEF void vec2LengthFastBatch(const DVTYPE *x, const DVTYPE *y, DVTYPE *DVRESTRICT length, size_t n);
+DVDEF void vec3LengthFastBatch(const DVTYPE *x, const DVTYPE *y, const DVTYPE *z, DVTYPE *DVRESTRICT length, size_t n);
+DVDEF void vec2NormalizeFastBatch(DVTYPE *DVRESTRICT x, DVTYPE *DVRESTRICT y, size_t n);
+DVDEF void vec3NormalizeFastBatch(DVTYPE *DVRESTRICT x, DVTYPE *DVRESTRICT y, DVTYPE *DVRESTRICT z, size_t n);
+
 #endif //DVECTOR_H
 
 //implementation section
 #ifdef DVECTOR_IMPLEMENTATION
 #undef DVECTOR_IMPLEMENTATION
 
+#ifdef DVSIMD
+    #include <xmmintrin.h>
+    #define DVSHUFFLE(V, X, Y, Z, W) _mm_shuffle_ps(V, V, _MM_SHUFFLE(W, Z, Y, X))
+    #define DVSHUFFLE2(A, B, X, Y, Z, W) _mm_shuffle_ps(A, B, _MM_SHUFFLE(W, Z, Y, X))
+
+//every lane holds the sum of the four
+static inline __m128 dvSum4 (__m128 v) {
+    v = _mm_add_ps(v, DVSHUFFLE(v, 1, 0, 3, 2));
+    return _mm_add_ps(v, DVSHUFFLE(v, 2, 3, 0, 1));
+}
+#endif
+
+//fast functions
+#include <float.h>
+#if !defined(DVECTOR_DOUBLE) && (defined(__SSE__) || defined(_M_X64))
+    #include <xmmintrin.h>
+    #define DVRSQRTESTIMATE(X) _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(X)))
+#elif !defined(DVECTOR_DOUBLE) && defined(__ARM_NEON) && defined(__aarch64__)
+    #include <arm_neon.h>
+    #define DVRSQRTESTIMATE(X) vrsqrtes_f32(X)
+#endif
+static inline DVTYPE dvRsqrt (DVTYPE x) {
+#ifdef DVECTOR_DOUBLE
+    return 1/DVSQRT(x);
+#else
+    #ifdef DVRSQRTESTIMATE
+    DVTYPE y = DVRSQRTESTIMATE(x);
+    #else
+    union {float f; uint32_t i;} u = {x};
+    u.i = 0x5f375a86 - (u.i >> 1);
+    DVTYPE y = u.f;
+    #endif
+    return y*(1.5f - 0.5f*x*y*y);
+#endif
+}
+//the square root of a sum of squares, kept from 0*inf at zero
+#ifdef DVECTOR_DOUBLE
+    #define DVTINY DBL_MIN
+#else
+    #define DVTINY FLT_MIN
+#endif
+static inline DVTYPE dvSqrtFast (DVTYPE x) {
+    return x*dvRsqrt(x > DVTINY ? x : DVTINY);
+}
+DVDEF DVTYPE vec2LengthFast (vec2 v) {
+    return dvSqrtFast(v.x*v.x + v.y*v.y);
+}
+DVDEF DVTYPE vec3LengthFast (vec3 v) {
+    return dvSqrtFast(v.x*v.x + v.y*v.y + v.z*v.z);
+}
+DVDEF DVTYPE vec4LengthFast (vec4 v) {
+    return dvSqrtFast(v.x*v.x + v.y*v.y + v.z*v.z + v.w*v.w);
+}
+DVDEF vec2 vec2NormalizeFast (vec2 v) {
+    DVTYPE r = dvRsqrt(v.x*v.x + v.y*v.y);
+    return VEC2(v.x*r, v.y*r);
+}
+DVDEF vec3 vec3NormalizeFast (vec3 v) {
+    DVTYPE r = dvRsqrt(v.x*v.x + v.y*v.y + v.z*v.z);
+    return VEC3(v.x*r, v.y*r, v.z*r);
+}
+DVDEF vec4 vec4NormalizeFast (vec4 v) {
+    DVTYPE r = dvRsqrt(v.x*v.x + v.y*v.y + v.z*v.z + v.w*v.w);
+    return VEC4(v.x*r, v.y*r, v.z*r, v.w*r);
+}
+
 //vec2 functions
 DVDEF DVTYPE vec2Length (vec2 v) {
+#ifdef DVECTOR_FAST_MATH
+    return vec2LengthFast(v);
+#else
     return DVHYPOT(v.x, v.y);
+#endif
 }
 DVDEF DVTYPE vec2DotProduct (vec2 v1, vec2 v2) {
     return v1.x*v2.x + v1.y*v2.y;
@@ -321,7 +473,11 @@ DVDEF vec2 vec2Negate (vec2 v) {
     return VEC2(-v.x, -v.y);
 }
 DVDEF vec2 vec2Normalize (vec2 v) {
+#ifdef DVECTOR_FAST_MATH
+    return vec2NormalizeFast(v);
+#else
     return vec2Divide(v, vec2Length(v));
+#endif
 }
 DVDEF vec2 vec2Multiply (vec2 v, DVTYPE s) {
     return VEC2(v.x*s, v.y*s);
@@ -355,7 +511,11 @@ DVDEF int vec2Equal (vec2 v1, vec2 v2) {
 
 //vec3 functions
 DVDEF DVTYPE vec3Length (vec3 v) {
+#ifdef DVECTOR_FAST_MATH
+    return vec3LengthFast(v);
+#else
     return DVHYPOT(DVHYPOT(v.x, v.y), v.z);
+#endif
 }
 DVDEF DVTYPE vec3DotProduct (vec3 v1, vec3 v2) {
     return v1.x*v2.x + v1.y*v2.y + v1.z*v2.z;
@@ -367,7 +527,11 @@ DVDEF vec3 vec3Negate (vec3 v) {
     return VEC3(-v.x, -v.y, -v.z);
 }
 DVDEF vec3 vec3Normalize (vec3 v) {
+#ifdef DVECTOR_FAST_MATH
+    return vec3NormalizeFast(v);
+#else
     return vec3Divide(v, vec3Length(v));
+#endif
 }
 DVDEF vec3 vec3Multiply (vec3 v, DVTYPE s) {
     return VEC3(v.x*s, v.y*s, v.z*s);
@@ -400,7 +564,11 @@ DVDEF vec3 vec4GetXYZ (vec4 v) {
     return VEC3(v.x, v.y, v.z);
 }
 DVDEF DVTYPE vec4Length (vec4 v) {
+#ifdef DVECTOR_FAST_MATH
+    return vec4LengthFast(v);
+#else
     return DVHYPOT(DVHYPOT(v.x, v.y), DVHYPOT(v.z, v.w));
+#endif
 }
 DVDEF DVTYPE vec4DotProduct (vec4 v1, vec4 v2) {
     return v1.x*v2.x + v1.y*v2.y + v1.z*v2.z + v1.w*v2.w;
@@ -409,7 +577,11 @@ DVDEF vec4 vec4Negate (vec4 v) {
     return VEC4(-v.x, -v.y, -v.z, -v.w);
 }
 DVDEF vec4 vec4Normalize (vec4 v) {
+#ifdef DVECTOR_FAST_MATH
+    return vec4NormalizeFast(v);
+#else
     return vec4Divide(v, vec4Length(v));
+#endif
 }
 DVDEF vec4 vec4Multiply (vec4 v, DVTYPE s) {
     return VEC4(v.x*s, v.y*s, v.z*s, v.w*s);
@@ -474,12 +646,31 @@ DVDEF quat quatLerp (quat q1, quat q2, DVTYPE s) {
     return quatNormalize(QUAT((1-s)*q1.x + s*q2.x, (1-s)*q1.y + s*q2.y, (1-s)*q1.z + s*q2.z, (1-s)*q1.w + s*q2.w));
 }
 DVDEF quat quatSlerp (quat q1, quat q2, DVTYPE s) {
+#ifdef DVSIMD
+    __m128 a = _mm_load_ps(&q1.x), b = _mm_load_ps(&q2.x);
+    DVTYPE th = DVACOS(_mm_cvtss_f32(dvSum4(_mm_mul_ps(a, b)))), sn = DVSIN(th);
+    __m128 r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(DVSIN((1-s)*th)/sn), a), _mm_mul_ps(_mm_set1_ps(DVSIN(s*th)/sn), b));
+    quat q;
+    _mm_store_ps(&q.x, _mm_div_ps(r, _mm_sqrt_ps(dvSum4(_mm_mul_ps(r, r)))));
+    return q;
+#else
     DVTYPE th = DVACOS(q1.x*q2.x + q1.y*q2.y + q1.z*q2.z + q1.w*q2.w), sn = DVSIN(th), wa = DVSIN((1-s)*th)/sn, wb = DVSIN(s*th)/sn;
     return quatNormalize(QUAT(wa*q1.x + wb*q2.x, wa*q1.y + wb*q2.y, wa*q1.z + wb*q2.z, wa*q1.w + wb*q2.w));
+#endif
 }
 DVDEF quat quatMultiply (quat q1, quat q2) {
+#ifdef DVSIMD
+    __m128 a = _mm_load_ps(&q1.x), b = _mm_load_ps(&q2.x), r = _mm_mul_ps(DVSHUFFLE(a, 3, 3, 3, 3), b);
+    r = _mm_add_ps(r, _mm_mul_ps(DVSHUFFLE(a, 0, 0, 0, 0), _mm_xor_ps(DVSHUFFLE(b, 3, 2, 1, 0), _mm_setr_ps(0.f, -0.f, 0.f, -0.f))));
+    r = _mm_add_ps(r, _mm_mul_ps(DVSHUFFLE(a, 1, 1, 1, 1), _mm_xor_ps(DVSHUFFLE(b, 2, 3, 0, 1), _mm_setr_ps(0.f, 0.f, -0.f, -0.f))));
+    r = _mm_add_ps(r, _mm_mul_ps(DVSHUFFLE(a, 2, 2, 2, 2), _mm_xor_ps(DVSHUFFLE(b, 1, 0, 3, 2), _mm_setr_ps(-0.f, 0.f, 0.f, -0.f))));
+    quat q;
+    _mm_store_ps(&q.x, r);
+    return q;
+#else
     return QUAT(q1.x*q2.w + q1.y*q2.z - q1.z*q2.y + q1.w*q2.x, -q1.x*q2.z + q1.y*q2.w + q1.z*q2.x + q1.w*q2.y,
         q1.x*q2.y - q1.y*q2.x + q1.z*q2.w + q1.w*q2.z, -q1.x*q2.x - q1.y*q2.y - q1.z*q2.z + q1.w*q2.w);
+#endif
 }
 DVDEF int quatEqual (quat q1, quat q2) {
     return (q1.x == q2.x)&&(q1.y == q2.y)&&(q1.z == q2.z)&&(q1.w == q2.w);
@@ -592,11 +783,33 @@ DVDEF int mat3Equal (mat3 m1, mat3 m2) {
 }
 
 //mat4 function declarations
+#ifdef DVSIMD
+//2x2 matrices held as (m00, m01, m10, m11): a*b, adjugate(a)*b and a*adjugate(b)
+static inline __m128 dvMat2Multiply (__m128 a, __m128 b) {
+    return _mm_add_ps(_mm_mul_ps(a, DVSHUFFLE(b, 0, 3, 0, 3)), _mm_mul_ps(DVSHUFFLE(a, 1, 0, 3, 2), DVSHUFFLE(b, 2, 1, 2, 1)));
+}
+static inline __m128 dvMat2AdjugateMultiply (__m128 a, __m128 b) {
+    return _mm_sub_ps(_mm_mul_ps(DVSHUFFLE(a, 3, 3, 0, 0), b), _mm_mul_ps(DVSHUFFLE(a, 1, 1, 2, 2), DVSHUFFLE(b, 2, 3, 0, 1)));
+}
+static inline __m128 dvMat2MultiplyAdjugate (__m128 a, __m128 b) {
+    return _mm_sub_ps(_mm_mul_ps(a, DVSHUFFLE(b, 3, 0, 3, 0)), _mm_mul_ps(DVSHUFFLE(a, 1, 0, 3, 2), DVSHUFFLE(b, 2, 1, 2, 1)));
+}
+#endif
 DVDEF vec4 mat4MultiplyVector (mat4 m, vec4 v) {
+#ifdef DVSIMD
+    __m128 r = _mm_mul_ps(_mm_load_ps(m.m[0]), _mm_set1_ps(v.x));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(m.m[1]), _mm_set1_ps(v.y)));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(m.m[2]), _mm_set1_ps(v.z)));
+    r = _mm_add_ps(r, _mm_mul_ps(_mm_load_ps(m.m[3]), _mm_set1_ps(v.w)));
+    vec4 o;
+    _mm_store_ps(&o.x, r);
+    return o;
+#else
     DVTYPE r[4];
     for (int i = 0; i < 4; i++)
         r[i] = m.m[0][i]*v.x + m.m[1][i]*v.y + m.m[2][i]*v.z + m.m[3][i]*v.w;
     return VEC4(r[0], r[1], r[2], r[3]);
+#endif
 }
 DVDEF mat4 mat4SetRotationX (DVTYPE r) {
     DVTYPE c = DVCOS(r), s = DVSIN(r);
@@ -643,6 +856,26 @@ DVDEF mat4 mat4Transpose (mat4 m) {
         m.m[0][2], m.m[1][2], m.m[2][2], m.m[3][2], m.m[0][3], m.m[1][3], m.m[2][3], m.m[3][3]);
 }
 DVDEF mat4 mat4Inverse (mat4 m) {
+#ifdef DVSIMD
+    //block inverse over the four 2x2 corners, the same for rows or columns as the inverse of a transpose is the transpose of the inverse
+    __m128 c0 = _mm_load_ps(m.m[0]), c1 = _mm_load_ps(m.m[1]), c2 = _mm_load_ps(m.m[2]), c3 = _mm_load_ps(m.m[3]);
+    __m128 a = _mm_movelh_ps(c0, c1), b = _mm_movehl_ps(c1, c0), c = _mm_movelh_ps(c2, c3), d = _mm_movehl_ps(c3, c2);
+    __m128 det = _mm_sub_ps(_mm_mul_ps(DVSHUFFLE2(c0, c2, 0, 2, 0, 2), DVSHUFFLE2(c1, c3, 1, 3, 1, 3)),
+        _mm_mul_ps(DVSHUFFLE2(c0, c2, 1, 3, 1, 3), DVSHUFFLE2(c1, c3, 0, 2, 0, 2)));
+    __m128 deta = DVSHUFFLE(det, 0, 0, 0, 0), detb = DVSHUFFLE(det, 1, 1, 1, 1), detc = DVSHUFFLE(det, 2, 2, 2, 2), detd = DVSHUFFLE(det, 3, 3, 3, 3);
+    __m128 dc = dvMat2AdjugateMultiply(d, c), ab = dvMat2AdjugateMultiply(a, b);
+    __m128 x = _mm_sub_ps(_mm_mul_ps(detd, a), dvMat2Multiply(b, dc)), w = _mm_sub_ps(_mm_mul_ps(deta, d), dvMat2Multiply(c, ab));
+    __m128 y = _mm_sub_ps(_mm_mul_ps(detb, c), dvMat2MultiplyAdjugate(d, ab)), z = _mm_sub_ps(_mm_mul_ps(detc, b), dvMat2MultiplyAdjugate(a, dc));
+    __m128 detm = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(deta, detd), _mm_mul_ps(detb, detc)), dvSum4(_mm_mul_ps(ab, DVSHUFFLE(dc, 0, 2, 1, 3))));
+    __m128 r = _mm_div_ps(_mm_setr_ps(1, -1, -1, 1), detm);
+    x = _mm_mul_ps(x, r), y = _mm_mul_ps(y, r), z = _mm_mul_ps(z, r), w = _mm_mul_ps(w, r);
+    mat4 o;
+    _mm_store_ps(o.m[0], DVSHUFFLE2(x, y, 3, 1, 3, 1));
+    _mm_store_ps(o.m[1], DVSHUFFLE2(x, y, 2, 0, 2, 0));
+    _mm_store_ps(o.m[2], DVSHUFFLE2(z, w, 3, 1, 3, 1));
+    _mm_store_ps(o.m[3], DVSHUFFLE2(z, w, 2, 0, 2, 0));
+    return o;
+#else
     DVTYPE s[6] = {m.m[0][0]*m.m[1][1] - m.m[1][0]*m.m[0][1], m.m[0][0]*m.m[1][2] - m.m[1][0]*m.m[0][2], m.m[0][0]*m.m[1][3] - m.m[1][0]*m.m[0][3],
         m.m[0][1]*m.m[1][2] - m.m[1][1]*m.m[0][2], m.m[0][1]*m.m[1][3] - m.m[1][1]*m.m[0][3], m.m[0][2]*m.m[1][3] - m.m[1][2]*m.m[0][3]};
     DVTYPE c[6] = {m.m[2][0]*m.m[3][1] - m.m[3][0]*m.m[2][1], m.m[2][0]*m.m[3][2] - m.m[3][0]*m.m[2][2], m.m[2][0]*m.m[3][3] - m.m[3][0]*m.m[2][3],
@@ -654,6 +887,7 @@ DVDEF mat4 mat4Inverse (mat4 m) {
         m.m[2][1]*s[2] - m.m[2][0]*s[4] - m.m[2][3]*s[0], m.m[1][1]*c[1] - m.m[1][0]*c[3] - m.m[1][2]*c[0], m.m[0][0]*c[3] - m.m[0][1]*c[1] + m.m[0][2]*c[0],
         m.m[3][1]*s[1] - m.m[3][0]*s[3] - m.m[3][2]*s[0], m.m[2][0]*s[3] - m.m[2][1]*s[1] + m.m[2][2]*s[0]),
         1/(s[0]*c[5] - s[1]*c[4] + s[2]*c[3] + s[3]*c[2] - s[4]*c[1] + s[5]*c[0]));
+#endif
 }
 DVDEF mat4 mat4MultiplyScalar (mat4 m, DVTYPE s) {
     for (int i = 0; i < 4; i++)
@@ -684,9 +918,19 @@ DVDEF mat4 mat4Translate (mat4 m, vec3 v) {
 }
 DVDEF mat4 mat4MultiplyMatrix (mat4 m1, mat4 m2) {
     mat4 m = MAT4_IDEN;
+#ifdef DVSIMD
+    __m128 c0 = _mm_load_ps(m1.m[0]), c1 = _mm_load_ps(m1.m[1]), c2 = _mm_load_ps(m1.m[2]), c3 = _mm_load_ps(m1.m[3]);
+    for (int i = 0; i < 4; i++) {
+        __m128 r = _mm_mul_ps(c0, _mm_set1_ps(m2.m[i][0]));
+        r = _mm_add_ps(r, _mm_mul_ps(c1, _mm_set1_ps(m2.m[i][1])));
+        r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_set1_ps(m2.m[i][2])));
+        _mm_store_ps(m.m[i], _mm_add_ps(r, _mm_mul_ps(c3, _mm_set1_ps(m2.m[i][3]))));
+    }
+#else
     for (int i = 0; i < 4; i++)
         for (int j = 0; j < 4; j++)
             m.m[i][j] = m1.m[0][j]*m2.m[i][0] + m1.m[1][j]*m2.m[i][1] + m1.m[2][j]*m2.m[i][2] + m1.m[3][j]*m2.m[i][3];
+#endif
     return m;
 }
 DVDEF mat4 mat4Add (mat4 m1, mat4 m2) {
@@ -739,4 +983,319 @@ DVDEF int frstCullAABB (frst f, vec3 min, vec3 max) {
     return 1;
 }
 
+//batch configuration
+#if !defined(DVECTOR_DOUBLE) && !defined(DVECTOR_NO_SIMD)
+    #if defined(__AVX__)
+        #include <immintrin.h>
+        #define DVLANES 8
+        typedef __m256 dvlanes;
+        #define DVLOAD _mm256_loadu_ps
+        #define DVSTORE _mm256_storeu_ps
+        #define DVSET1 _mm256_set1_ps
+        #define DVADD _mm256_add_ps
+        #define DVMUL _mm256_mul_ps
+        #define DVDIV _mm256_div_ps
+        #define DVSQRTLANES _mm256_sqrt_ps
+        #define DVSUB _mm256_sub_ps
+        #define DVMAX _mm256_max_ps
+        #define DVRSQRTLANES _mm256_rsqrt_ps
+        #define DVNOTNEGATIVE(V) _mm256_movemask_ps(_mm256_cmp_ps(V, _mm256_setzero_ps(), _CMP_NLT_UQ))
+    #elif defined(__SSE__) || defined(_M_X64)
+        #include <xmmintrin.h>
+        #define DVLANES 4
+        typedef __m128 dvlanes;
+        #define DVLOAD _mm_loadu_ps
+        #define DVSTORE _mm_storeu_ps
+        #define DVSET1 _mm_set1_ps
+        #define DVADD _mm_add_ps
+        #define DVMUL _mm_mul_ps
+        #define DVDIV _mm_div_ps
+        #define DVSQRTLANES _mm_sqrt_ps
+        #define DVSUB _mm_sub_ps
+        #define DVMAX _mm_max_ps
+        #define DVRSQRTLANES _mm_rsqrt_ps
+        #define DVNOTNEGATIVE(V) _mm_movemask_ps(_mm_cmpnlt_ps(V, _mm_setzero_ps()))
+    #elif defined(__ARM_NEON) && defined(__aarch64__)
+        #include <arm_neon.h>
+        #define DVLANES 4
+        typedef float32x4_t dvlanes;
+        #define DVLOAD vld1q_f32
+        #define DVSTORE vst1q_f32
+        #define DVSET1 vdupq_n_f32
+        #define DVADD vaddq_f32
+        #define DVMUL vmulq_f32
+        #define DVDIV vdivq_f32
+        #define DVSQRTLANES vsqrtq_f32
+        #define DVSUB vsubq_f32
+        #define DVMAX vmaxq_f32
+        #define DVRSQRTLANES vrsqrteq_f32
+        #define DVNOTNEGATIVE(V) dvNotNegative(V)
+        static inline int dvNotNegative (float32x4_t v) {
+            const uint32x4_t lane = {1, 2, 4, 8};
+            return (int)vaddvq_u32(vandq_u32(vmvnq_u32(vcltq_f32(v, vdupq_n_f32(0))), lane));
+        }
+    #endif
+#endif
+
+//batch functions, lanes first and the remainder one at a time in the same order of operations
+#ifdef DVLANES
+static inline dvlanes dvRsqrtLanes (dvlanes x) {
+    const dvlanes y = DVRSQRTLANES(x);
+    return DVMUL(y, DVSUB(DVSET1(1.5f), DVMUL(DVMUL(DVMUL(DVSET1(0.5f), x), y), y)));
+}
+#endif
+enum {DVDOT, DVROOT, DVROOTFAST};
+static inline void dvDotBatch (const DVTYPE *const *a, const DVTYPE *const *b, int k, DVTYPE *DVRESTRICT out, size_t n, int root) {
+    size_t i = 0;
+#ifdef DVLANES
+    for (; i < n - n%DVLANES; i += DVLANES) {
+        dvlanes sum = DVMUL(DVLOAD(a[0] + i), DVLOAD(b[0] + i));
+        for (int c = 1; c < k; c++)
+            sum = DVADD(sum, DVMUL(DVLOAD(a[c] + i), DVLOAD(b[c] + i)));
+        if (root == DVROOTFAST)
+            sum = DVMUL(sum, dvRsqrtLanes(DVMAX(sum, DVSET1(FLT_MIN))));
+        DVSTORE(out + i, root == DVROOT ? DVSQRTLANES(sum) : sum);
+    }
+#endif
+    for (; i < n; i++) {
+        DVTYPE sum = a[0][i]*b[0][i];
+        for (int c = 1; c < k; c++)
+            sum += a[c][i]*b[c][i];
+        out[i] = root == DVROOT ? DVSQRT(sum) : root == DVROOTFAST ? dvSqrtFast(sum) : sum;
+    }
+}
+static inline void dvNormalizeBatch (DVTYPE *const *v, int k, size_t n, int fast) {
+    size_t i = 0;
+#ifdef DVLANES
+    for (; i < n - n%DVLANES; i += DVLANES) {
+        dvlanes sum = DVMUL(DVLOAD(v[0] + i), DVLOAD(v[0] + i));
+        for (int c = 1; c < k; c++)
+            sum = DVADD(sum, DVMUL(DVLOAD(v[c] + i), DVLOAD(v[c] + i)));
+        if (fast) {
+            const dvlanes r = dvRsqrtLanes(sum);
+            for (int c = 0; c < k; c++)
+                DVSTORE(v[c] + i, DVMUL(DVLOAD(v[c] + i), r));
+            continue;
+        }
+        const dvlanes length = DVSQRTLANES(sum);
+        for (int c = 0; c < k; c++)
+            DVSTORE(v[c] + i, DVDIV(DVLOAD(v[c] + i), length));
+    }
+#endif
+    for (; i < n; i++) {
+        DVTYPE sum = v[0][i]*v[0][i];
+        for (int c = 1; c < k; c++)
+            sum += v[c][i]*v[c][i];
+        if (fast) {
+            const DVTYPE r = dvRsqrt(sum);
+            for (int c = 0; c < k; c++)
+                v[c][i] *= r;
+            continue;
+        }
+        const DVTYPE length = DVSQRT(sum);
+        for (int c = 0; c < k; c++)
+            v[c][i] /= length;
+    }
+}
+#ifdef DVECTOR_FAST_MATH
+    #define DVNORMALIZEFAST 1
+#else
+    #define DVNORMALIZEFAST 0
+#endif
+DVDEF void vec2LengthBatch (const DVTYPE *x, const DVTYPE *y, DVTYPE *DVRESTRICT length, size_t n) {
+    const DVTYPE *v[2] = {x, y};
+    dvDotBatch(v, v, 2, length, n, DVROOT);
+}
+DVDEF void vec3LengthBatch (const DVTYPE *x, const DVTYPE *y, const DVTYPE *z, DVTYPE *DVRESTRICT length, size_t n) {
+    const DVTYPE *v[3] = {x, y, z};
+    dvDotBatch(v, v, 3, length, n, DVROOT);
+}
+DVDEF void vec2DotProductBatch (const DVTYPE *x1, const DVTYPE *y1, const DVTYPE *x2, const DVTYPE *y2, DVTYPE *DVRESTRICT dot, size_t n) {
+    const DVTYPE *v1[2] = {x1, y1}, *v2[2] = {x2, y2};
+    dvDotBatch(v1, v2, 2, dot, n, DVDOT);
+}
+DVDEF void vec3DotProductBatch (const DVTYPE *x1, const DVTYPE *y1, const DVTYPE *z1, const DVTYPE *x2, const DVTYPE *y2, const DVTYPE *z2, DVTYPE *DVRESTRICT dot, size_t n) {
+    const DVTYPE *v1[3] = {x1, y1, z1}, *v2[3] = {x2, y2, z2};
+    dvDotBatch(v1, v2, 3, dot, n, DVDOT);
+}
+DVDEF void vec2NormalizeBatch (DVTYPE *DVRESTRICT x, DVTYPE *DVRESTRICT y, size_t n) {
+    DVTYPE *v[2] = {x, y};
+    dvNormalizeBatch(v, 2, n, DVNORMALIZEFAST);
+}
+DVDEF void vec3NormalizeBatch (DVTYPE *DVRESTRICT x, DVTYPE *DVRESTRICT y, DVTYPE *DVRESTRICT z, size_t n) {
+    DVTYPE *v[3] = {x, y, z};
+    dvNormalizeBatch(v, 3, n, DVNORMALIZEFAST);
+}
+DVDEF void vec2LengthFastBatch (const DVTYPE *x, const DVTYPE *y, DVTYPE *DVRESTRICT length, size_t n) {
+    const DVTYPE *v[2] = {x, y};
+    dvDotBatch(v, v, 2, length, n, DVROOTFAST);
+}
+DVDEF void vec3LengthFastBatch (const DVTYPE *x, const DVTYPE *y, const DVTYPE *z, DVTYPE *DVRESTRICT length, size_t n) {
+    const DVTYPE *v[3] = {x, y, z};
+    dvDotBatch(v, v, 3, length, n, DVROOTFAST);
+}
+DVDEF void vec2NormalizeFastBatch (DVTYPE *DVRESTRICT x, DVTYPE *DVRESTRICT y, size_t n) {
+    DVTYPE *v[2] = {x, y};
+    dvNormalizeBatch(v, 2, n, 1);
+}
+DVDEF void vec3NormalizeFastBatch (DVTYPE *DVRESTRICT x, DVTYPE *DVRESTRICT y, DVTYPE *DVRESTRICT z, size_t n) {
+    DVTYPE *v[3] = {x, y, z};
+    dvNormalizeBatch(v, 3, n, 1);
+}
+DVDEF void axpyBatch (DVTYPE a, const DVTYPE *DVRESTRICT x, DVTYPE *DVRESTRICT y, size_t n) {
+    size_t i = 0;
+#ifdef DVLANES
+    const dvlanes va = DVSET1(a);
+    for (; i < n - n%DVLANES; i += DVLANES)
+        DVSTORE(y + i, DVADD(DVLOAD(y + i), DVMUL(va, DVLOAD(x + i))));
+#endif
+    for (; i < n; i++)
+        y[i] = y[i] + a*x[i];
+}
+DVDEF void mat4MultiplyPointBatch (mat4 m, const DVTYPE *x, const DVTYPE *y, const DVTYPE *z, DVTYPE *ox, DVTYPE *oy, DVTYPE *oz, size_t n) {
+    size_t i = 0;
+#ifdef DVLANES
+    dvlanes c[4][3];
+    for (int j = 0; j < 4; j++)
+        for (int r = 0; r < 3; r++)
+            c[j][r] = DVSET1(m.m[j][r]);
+    for (; i < n - n%DVLANES; i += DVLANES) {
+        const dvlanes vx = DVLOAD(x + i), vy = DVLOAD(y + i), vz = DVLOAD(z + i);
+        DVTYPE *out[3] = {ox, oy, oz};
+        for (int r = 0; r < 3; r++)
+            DVSTORE(out[r] + i, DVADD(DVADD(DVADD(DVMUL(c[0][r], vx), DVMUL(c[1][r], vy)), DVMUL(c[2][r], vz)), c[3][r]));
+    }
+#endif
+    for (; i < n; i++) {
+        const DVTYPE px = x[i], py = y[i], pz = z[i];
+        ox[i] = m.m[0][0]*px + m.m[1][0]*py + m.m[2][0]*pz + m.m[3][0];
+        oy[i] = m.m[0][1]*px + m.m[1][1]*py + m.m[2][1]*pz + m.m[3][1];
+        oz[i] = m.m[0][2]*px + m.m[1][2]*py + m.m[2][2]*pz + m.m[3][2];
+    }
+}
+
+//frustum batches, with one bit per volume of the range from start to end that is on the inner side of all six planes
+static inline void dvStoreVisible (size_t i, unsigned visible, int count, unsigned *indices, uint32_t *bits, size_t *number) {
+    if (bits) {
+        if (!(i & 31))
+            bits[i >> 5] = 0;
+        bits[i >> 5] |= (uint32_t)visible << (i & 31);
+    }
+    if (!visible)
+        return;
+    for (int l = 0; l < count; l++) {
+        if (indices)
+            indices[*number] = (unsigned)(i + l);
+        *number += (visible >> l) & 1;
+    }
+}
+static inline size_t dvCullRange (const frst *f, const DVTYPE *const *p, int boxes, size_t start, size_t end, unsigned *indices, uint32_t *bits) {
+    //boxes test the corner furthest along each normal, so each plane reads min or max by the sign of its normal
+    const DVTYPE *c[6][3];
+    for (int j = 0; j < 6; j++)
+        for (int k = 0; k < 3; k++)
+            c[j][k] = p[k + (boxes && f->f[j*4 + k] > 0 ? 3 : 0)];
+    size_t number = 0, i = start;
+#ifdef DVLANES
+    dvlanes pl[6][4];
+    for (int j = 0; j < 6; j++)
+        for (int k = 0; k < 4; k++)
+            pl[j][k] = DVSET1(f->f[j*4 + k]);
+    for (; i + DVLANES <= end; i += DVLANES) {
+        const dvlanes r = boxes ? DVSET1(0) : DVLOAD(p[3] + i);
+        int visible = (1 << DVLANES) - 1;
+        for (int j = 0; j < 6 && visible; j++) {
+            const dvlanes d = DVADD(DVMUL(pl[j][0], DVLOAD(c[j][0] + i)), DVMUL(pl[j][1], DVLOAD(c[j][1] + i)));
+            visible &= DVNOTNEGATIVE(DVADD(DVADD(DVADD(d, DVMUL(pl[j][2], DVLOAD(c[j][2] + i))), pl[j][3]), r));
+        }
+        dvStoreVisible(i, (unsigned)visible, DVLANES, indices, bits, &number);
+    }
+#endif
+    for (; i < end; i++) {
+        const DVTYPE r = boxes ? 0 : p[3][i];
+        unsigned visible = 1;
+        for (int j = 0; j < 6; j++)
+            if (f->pln[j].x*c[j][0][i] + f->pln[j].y*c[j][1][i] + f->pln[j].z*c[j][2][i] + f->pln[j].w + r < 0)
+                visible = 0;
+        dvStoreVisible(i, visible, 1, indices, bits, &number);
+    }
+    return number;
+}
+DVDEF size_t frstCullSphereBatch (frst f, const DVTYPE *x, const DVTYPE *y, const DVTYPE *z, const DVTYPE *radius, unsigned *indices, uint32_t *bits, size_t n) {
+    const DVTYPE *p[4] = {x, y, z, radius};
+    return dvCullRange(&f, p, 0, 0, n, indices, bits);
+}
+DVDEF size_t frstCullAABBBatch (frst f, const DVTYPE *minx, const DVTYPE *miny, const DVTYPE *minz, const DVTYPE *maxx, const DVTYPE *maxy, const DVTYPE *maxz, unsigned *indices, uint32_t *bits, size_t n) {
+    const DVTYPE *p[6] = {minx, miny, minz, maxx, maxy, maxz};
+    return dvCullRange(&f, p, 1, 0, n, indices, bits);
+}
+
+//tree nodes are a min and max corner in heap order, with a leaf for every 32 spheres padded to a power of two
+static inline size_t dvTreeLeaves (size_t n) {
+    size_t leaves = 1;
+    while (leaves*32 < n)
+        leaves *= 2;
+    return leaves;
+}
+DVDEF size_t frstTreeSize (size_t n) {
+    return (2*dvTreeLeaves(n) - 1)*2;
+}
+static inline vec3 dvMin3 (vec3 a, vec3 b) {
+    return VEC3(a.x < b.x ? a.x : b.x, a.y < b.y ? a.y : b.y, a.z < b.z ? a.z : b.z);
+}
+static inline vec3 dvMax3 (vec3 a, vec3 b) {
+    return VEC3(a.x > b.x ? a.x : b.x, a.y > b.y ? a.y : b.y, a.z > b.z ? a.z : b.z);
+}
+DVDEF void frstBuildSphereTree (const DVTYPE *x, const DVTYPE *y, const DVTYPE *z, const DVTYPE *radius, vec3 *tree, size_t n) {
+    const size_t leaves = dvTreeLeaves(n);
+    for (size_t l = 0; l < leaves; l++) {
+        vec3 low = VEC3(INFINITY, INFINITY, INFINITY), high = VEC3(-INFINITY, -INFINITY, -INFINITY);
+        for (size_t i = l*32; i < l*32 + 32 && i < n; i++) {
+            low = dvMin3(low, VEC3(x[i] - radius[i], y[i] - radius[i], z[i] - radius[i]));
+            high = dvMax3(high, VEC3(x[i] + radius[i], y[i] + radius[i], z[i] + radius[i]));
+        }
+        tree[(leaves - 1 + l)*2] = low;
+        tree[(leaves - 1 + l)*2 + 1] = high;
+    }
+    for (size_t k = leaves - 1; k-- > 0;) {
+        tree[k*2] = dvMin3(tree[(2*k + 1)*2], tree[(2*k + 2)*2]);
+        tree[k*2 + 1] = dvMax3(tree[(2*k + 1)*2 + 1], tree[(2*k + 2)*2 + 1]);
+    }
+}
+//node k covers the spheres of leaves first to last
+static size_t dvCullNode (const frst *f, const DVTYPE *const *p, const vec3 *tree, size_t k, size_t first, size_t last, unsigned *indices, uint32_t *bits, size_t n) {
+    const size_t start = first*32, end = last*32 < n ? last*32 : n;
+    if (start >= end)
+        return 0;
+    const vec3 *node = tree + k*2;
+    int inside = 1;
+    for (int j = 0; j < 6; j++) {
+        const vec4 pl = f->pln[j];
+        if (pl.x*(pl.x > 0 ? node[1].x : node[0].x) + pl.y*(pl.y > 0 ? node[1].y : node[0].y) + pl.z*(pl.z > 0 ? node[1].z : node[0].z) + pl.w < 0)
+            return 0;
+        if (pl.x*(pl.x > 0 ? node[0].x : node[1].x) + pl.y*(pl.y > 0 ? node[0].y : node[1].y) + pl.z*(pl.z > 0 ? node[0].z : node[1].z) + pl.w < 0)
+            inside = 0;
+    }
+    if (inside) {
+        for (size_t i = start; i < end; i++) {
+            if (indices)
+                indices[i - start] = (unsigned)i;
+            if (bits)
+                bits[i >> 5] |= (uint32_t)1 << (i & 31);
+        }
+        return end - start;
+    }
+    if (last - first == 1)
+        return dvCullRange(f, p, 0, start, end, indices, bits);
+    const size_t middle = (first + last)/2, number = dvCullNode(f, p, tree, 2*k + 1, first, middle, indices, bits, n);
+    return number + dvCullNode(f, p, tree, 2*k + 2, middle, last, indices ? indices + number : 0, bits, n);
+}
+DVDEF size_t frstCullSphereTree (frst f, const DVTYPE *x, const DVTYPE *y, const DVTYPE *z, const DVTYPE *radius, const vec3 *tree, unsigned *indices, uint32_t *bits, size_t n) {
+    const DVTYPE *p[4] = {x, y, z, radius};
+    if (bits)
+        for (size_t w = 0; w < (n + 31)/32; w++)
+            bits[w] = 0;
+    return dvCullNode(&f, p, tree, 0, 0, dvTreeLeaves(n), indices, bits, n);
+}
+
 #endif //DVECTOR_IMPLEMENTATION
@@ -0,0 +1,337 @@
+//
+//  vector.hpp
+//  spring_mass
+//
+//  Created by Richard Henry on 19/10/2026.
+//  Copyright 2026 Dogstar Diversions. http://www.dogstar.mobi
+//
+
+/*
+C++20 wrapper over dvector. dv::vec2, vec3, vec4 and mat2, mat3, mat4 have the size, alignment and member offsets
+of the C types, convert to and from them implicitly, and are constexpr throughout, so they work as compile time
+constants and inline where the C functions are calls. Sums, differences and scalings of vectors are expression
+templates: a + b*s - c*t builds a tree of references that is evaluated one component at a time when it is assigned,
+without temporary vectors. Keep expressions in a vector rather than auto, as they refer to their operands.
+*/
+
+#ifndef DVECTOR_HPP
+#define DVECTOR_HPP
+
+extern "C" {
+#include "vector.h"
+}
+#include <bit>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+namespace dv {
+
+using scalar = DVTYPE;
+
+template <int N> struct vec;
+template <int N> struct mat;
+
+template <int N> struct c_types;
+template <> struct c_types<2> { using vec = ::vec2; using mat = ::mat2; };
+template <> struct c_types<3> { using vec = ::vec3; using mat = ::mat3; };
+template <> struct c_types<4> { using vec = ::vec4; using mat = ::mat4; };
+
+// Newton's method from above while constant evaluated, the C library otherwise
+constexpr scalar sqrt(scalar x) {
+    
+    if (!std::is_constant_evaluated()) return ::DVSQRT(x);
+    if (!(x > 0)) return x == 0 ? x : (x - x) / (x - x);
+    
+    scalar r = x > 1 ? x : 1;
+    
+    for (scalar next = (r + x / r) / 2; next < r; next = (r + x / r) / 2) r = next;
+    
+    return r;
+}
+
+#pragma mark Expressions
+
+struct expression_tag {};
+
+// Base of every vector expression, which evaluates to component i of an N vector
+template <class E, int N> struct expression : expression_tag {
+    
+    static constexpr int size = N;
+    
+    constexpr scalar operator[](int i) const { return static_cast<const E &>(*this)[i]; }
+    
+    operator typename c_types<N>::vec() const { return std::bit_cast<typename c_types<N>::vec>(vec<N>(*this)); }
+};
+
+template <class T> using bare = std::remove_cvref_t<T>;
+
+template <class T> concept vector_expression = std::is_base_of_v<expression_tag, bare<T>>;
+
+template <class L, class R> concept same_size = vector_expression<L> && vector_expression<R> && bare<L>::size == bare<R>::size;
+
+// Named operands are held by reference, temporaries by value so a nested expression outlives its statement
+template <class T> using operand = std::conditional_t<std::is_lvalue_reference_v<T>, const bare<T> &, bare<T>>;
+
+struct add { static constexpr scalar apply(scalar a, scalar b) { return a + b; } };
+struct subtract { static constexpr scalar apply(scalar a, scalar b) { return a - b; } };
+
+template <class L, class R, class Op> struct binary : expression<binary<L, R, Op>, bare<L>::size> {
+    
+    operand<L>  l;
+    operand<R>  r;
+    
+    constexpr binary(L &&l, R &&r) : l(std::forward<L>(l)), r(std::forward<R>(r)) {}
+    constexpr scalar operator[](int i) const { return Op::apply(l[i], r[i]); }
+};
+
+template <class E> struct scaled : expression<scaled<E>, bare<E>::size> {
+    
+    operand<E>  e;
+    scalar      s;
+    
+    constexpr scaled(E &&e, scalar s) : e(std::forward<E>(e)), s(s) {}
+    constexpr scalar operator[](int i) const { return e[i] * s; }
+};
+
+template <class E> struct divided : expression<divided<E>, bare<E>::size> {
+    
+    operand<E>  e;
+    scalar      s;
+    
+    constexpr divided(E &&e, scalar s) : e(std::forward<E>(e)), s(s) {}
+    constexpr scalar operator[](int i) const { return e[i] / s; }
+};
+
+template <class E> struct negated : expression<negated<E>, bare<E>::size> {
+    
+    operand<E>  e;
+    
+    constexpr explicit negated(E &&e) : e(std::forward<E>(e)) {}
+    constexpr scalar operator[](int i) const { return -e[i]; }
+};
+
+template <class L, class R> requires same_size<L, R>
+constexpr auto operator+(L &&l, R &&r) { return binary<L, R, add>(std::forward<L>(l), std::forward<R>(r)); }
+
+template <class L, class R> requires same_size<L, R>
+constexpr auto operator-(L &&l, R &&r) { return binary<L, R, subtract>(std::forward<L>(l), std::forward<R>(r)); }
+
+template <class E> requires vector_expression<E>
+constexpr auto operator*(E &&e, scalar s) { return scaled<E>(std::forward<E>(e), s); }
+
+template <class E> requires vector_expression<E>
+constexpr auto operator*(scalar s, E &&e) { return scaled<E>(std::forward<E>(e), s); }
+
+template <class E> requires vector_expression<E>
+constexpr auto operator/(E &&e, scalar s) { return divided<E>(std::forward<E>(e), s); }
+
+template <class E> requires vector_expression<E>
+constexpr auto operator-(E &&e) { return negated<E>(std::forward<E>(e)); }
+
+#pragma mark Vectors
+
+template <> struct vec<2> : expression<vec<2>, 2> {
+    
+    scalar x, y;
+    
+    constexpr vec() : x(0), y(0) {}
+    constexpr vec(scalar x, scalar y) : x(x), y(y) {}
+    template <class E> constexpr vec(const expression<E, 2> &e) : vec(e[0], e[1]) {}
+    vec(const ::vec2 &v) : vec(std::bit_cast<vec>(v)) {}
+    
+    constexpr scalar operator[](int i) const { return i ? y : x; }
+    constexpr scalar &operator[](int i) { return i ? y : x; }
+};
+
+template <> struct vec<3> : expression<vec<3>, 3> {
+    
+    scalar x, y, z;
+    
+    constexpr vec() : x(0), y(0), z(0) {}
+    constexpr vec(scalar x, scalar y, scalar z) : x(x), y(y), z(z) {}
+    template <class E> constexpr vec(const expression<E, 3> &e) : vec(e[0], e[1], e[2]) {}
+    vec(const ::vec3 &v) : vec(std::bit_cast<vec>(v)) {}
+    
+    constexpr scalar operator[](int i) const { return i == 0 ? x : i == 1 ? y : z; }
+    constexpr scalar &operator[](int i) { return i == 0 ? x : i == 1 ? y : z; }
+};
+
+template <> struct alignas(alignof(::vec4)) vec<4> : expression<vec<4>, 4> {
+    
+    scalar x, y, z, w;
+    
+    constexpr vec() : x(0), y(0), z(0), w(0) {}
+    constexpr vec(scalar x, scalar y, scalar z, scalar w) : x(x), y(y), z(z), w(w) {}
+    template <class E> constexpr vec(const expression<E, 4> &e) : vec(e[0], e[1], e[2], e[3]) {}
+    vec(const ::vec4 &v) : vec(std::bit_cast<vec>(v)) {}
+    
+    constexpr scalar operator[](int i) const { return i == 0 ? x : i == 1 ? y : i == 2 ? z : w; }
+    constexpr scalar &operator[](int i) { return i == 0 ? x : i == 1 ? y : i == 2 ? z : w; }
+};
+
+vec(const ::vec2 &) -> vec<2>;
+vec(const ::vec3 &) -> vec<3>;
+vec(const ::vec4 &) -> vec<4>;
+
+using vec2 = vec<2>;
+using vec3 = vec<3>;
+using vec4 = vec<4>;
+
+template <int N, class E> constexpr vec<N> &operator+=(vec<N> &v, const expression<E, N> &e) { return v = v + e; }
+template <int N, class E> constexpr vec<N> &operator-=(vec<N> &v, const expression<E, N> &e) { return v = v - e; }
+template <int N> constexpr vec<N> &operator*=(vec<N> &v, scalar s) { return v = v * s; }
+template <int N> constexpr vec<N> &operator/=(vec<N> &v, scalar s) { return v = v / s; }
+
+template <class L, class R> requires same_size<L, R>
+constexpr bool operator==(const L &l, const R &r) {
+    
+    for (int i = 0; i < bare<L>::size; i++)
+        if (l[i] != r[i]) return false;
+    
+    return true;
+}
+
+template <class L, class R> requires same_size<L, R>
+constexpr scalar dot(const L &l, const R &r) {
+    
+    scalar d = l[0] * r[0];
+    
+    for (int i = 1; i < bare<L>::size; i++) d += l[i] * r[i];
+    
+    return d;
+}
+
+template <class L, class R> requires same_size<L, R> && (bare<L>::size == 3)
+constexpr vec3 cross(const L &l, const R &r) {
+    
+    return vec3(l[1] * r[2] - l[2] * r[1], l[2] * r[0] - l[0] * r[2], l[0] * r[1] - l[1] * r[0]);
+}
+
+template <class E> requires vector_expression<E>
+constexpr scalar length_squared(const E &e) { return dot(e, e); }
+
+template <class E> requires vector_expression<E>
+constexpr scalar length(const E &e) { return sqrt(dot(e, e)); }
+
+template <class E> requires vector_expression<E>
+constexpr vec<bare<E>::size> normalize(const E &e) {
+    
+    const vec<bare<E>::size> v = e;
+    
+    return v / length(v);
+}
+
+template <class L, class R> requires same_size<L, R>
+constexpr auto mix(L &&l, R &&r, scalar s) { return std::forward<L>(l) * (1 - s) + std::forward<R>(r) * s; }
+
+#pragma mark Matrices
+
+// Column major like the C types, so col[c][r] is m[c][r]
+template <int N> struct alignas(alignof(typename c_types<N>::mat)) mat {
+    
+    vec<N>      col[N];
+    
+    constexpr mat() : col{} {}
+    mat(const typename c_types<N>::mat &m) : mat(std::bit_cast<mat>(m)) {}
+    operator typename c_types<N>::mat() const { return std::bit_cast<typename c_types<N>::mat>(*this); }
+    
+    static constexpr mat identity() {
+        
+        mat m;
+        
+        for (int i = 0; i < N; i++) m.col[i][i] = 1;
+        
+        return m;
+    }
+    
+    constexpr const vec<N> &operator[](int c) const { return col[c]; }
+    constexpr vec<N> &operator[](int c) { return col[c]; }
+    
+    constexpr bool operator==(const mat &m) const {
+        
+        for (int c = 0; c < N; c++)
+            if (!(col[c] == m.col[c])) return false;
+        
+        return true;
+    }
+};
+
+mat(const ::mat2 &) -> mat<2>;
+mat(const ::mat3 &) -> mat<3>;
+mat(const ::mat4 &) -> mat<4>;
+
+using mat2 = mat<2>;
+using mat3 = mat<3>;
+using mat4 = mat<4>;
+
+template <int N, class E> constexpr vec<N> operator*(const mat<N> &m, const expression<E, N> &e) {
+    
+    vec<N> v;
+    
+    for (int r = 0; r < N; r++)
+        for (int c = 0; c < N; c++) v[r] += m.col[c][r] * e[c];
+    
+    return v;
+}
+
+template <int N> constexpr mat<N> operator*(const mat<N> &a, const mat<N> &b) {
+    
+    mat<N> m;
+    
+    for (int c = 0; c < N; c++) m.col[c] = a * b.col[c];
+    
+    return m;
+}
+
+template <int N> constexpr mat<N> transpose(const mat<N> &m) {
+    
+    mat<N> t;
+    
+    for (int c = 0; c < N; c++)
+        for (int r = 0; r < N; r++) t.col[c][r] = m.col[r][c];
+    
+    return t;
+}
+
+constexpr mat4 translation(const vec3 &v) {
+    
+    mat4 m = mat4::identity();
+    
+    m.col[3] = vec4(v.x, v.y, v.z, 1);
+    
+    return m;
+}
+
+constexpr mat4 scale(const vec3 &v) {
+    
+    mat4 m = mat4::identity();
+    
+    m.col[0].x = v.x;
+    m.col[1].y = v.y;
+    m.col[2].z = v.z;
+    
+    return m;
+}
+
+#pragma mark Layout
+
+template <class T, class C> constexpr bool matches = sizeof(T) == sizeof(C) && alignof(T) == alignof(C) &&
+    std::is_standard_layout_v<T> && std::is_trivially_copyable_v<T>;
+
+static_assert(matches<vec2, ::vec2> && matches<vec3, ::vec3> && matches<vec4, ::vec4>);
+static_assert(matches<mat2, ::mat2> && matches<mat3, ::mat3> && matches<mat4, ::mat4>);
+static_assert(offsetof(vec2, x) == offsetof(::vec2, x) && offsetof(vec2, y) == offsetof(::vec2, y));
+static_assert(offsetof(vec3, x) == offsetof(::vec3, x) && offsetof(vec3, y) == offsetof(::vec3, y) &&
+    offsetof(vec3, z) == offsetof(::vec3, z));
+static_assert(offsetof(vec4, x) == offsetof(::vec4, x) && offsetof(vec4, y) == offsetof(::vec4, y) &&
+    offsetof(vec4, z) == offsetof(::vec4, z) && offsetof(vec4, w) == offsetof(::vec4, w));
+static_assert(offsetof(mat2, col[0]) == offsetof(::mat2, m[0]) && offsetof(mat2, col[1]) == offsetof(::mat2, m[1]));
+static_assert(offsetof(mat3, col[0]) == offsetof(::mat3, m[0]) && offsetof(mat3, col[1]) == offsetof(::mat3, m[1]) &&
+    offsetof(mat3, col[2]) == offsetof(::mat3, m[2]));
+static_assert(offsetof(mat4, col[0]) == offsetof(::mat4, m[0]) && offsetof(mat4, col[1]) == offsetof(::mat4, m[1]) &&
+    offsetof(mat4, col[2]) == offsetof(::mat4, m[2]) && offsetof(mat4, col[3]) == offsetof(::mat4, m[3]));
+
+}
+
+#endif
@@ -0,0 +1,144 @@
+//
+//  workers.c
+//  spring_mass
+//
+//  Created by Richard Henry on 19/10/2026.
+//  Copyright 2026 Dogstar Diversions. http://www.dogstar.mobi
+//
+
+#include "workers.h"
+#include <stdlib.h>
+#include <assert.h>
+
+typedef struct {
+    
+    sm_workers  *workers;
+    unsigned    thread_index;
+    
+} worker_start;
+
+static void *worker_main(void *arg);
+static void run_range(sm_workers *workers, const unsigned thread_index);
+
+#pragma mark Worker management
+
+sm_workers *new_workers(const unsigned number_of_threads) {
+    
+    assert(number_of_threads > 0);
+    
+    sm_workers *workers = calloc(1, sizeof(sm_workers));
+    assert(workers);
+    
+    workers->number_of_threads = number_of_threads;
+    workers->threads = calloc(number_of_threads, sizeof(pthread_t));
+    assert(workers->threads);
+    
+    pthread_mutex_init(&workers->lock, 0);
+    pthread_cond_init(&workers->work_ready, 0);
+    pthread_cond_init(&workers->work_done, 0);
+    
+    // The calling thread acts as worker 0, so only start the others
+    for (unsigned t = 1; t < number_of_threads; t++) {
+        
+        worker_start *start = malloc(sizeof(worker_start));
+        assert(start);
+        
+        start->workers = workers;
+        start->thread_index = t;
+        
+        int error = pthread_create(&workers->threads[t], 0, worker_main, start);
+        assert(!error);
+        (void)error;
+    }
+    
+    return workers;
+}
+
+void free_workers(sm_workers * const workers) {
+    
+    pthread_mutex_lock(&workers->lock);
+    workers->quit = 1;
+    pthread_cond_broadcast(&workers->work_ready);
+    pthread_mutex_unlock(&workers->lock);
+    
+    for (unsigned t = 1; t < workers->number_of_threads; t++)
+        pthread_join(workers->threads[t], 0);
+    
+    pthread_cond_destroy(&workers->work_done);
+    pthread_cond_destroy(&workers->work_ready);
+    pthread_mutex_destroy(&workers->lock);
+    
+    free(workers->threads);
+    free(workers);
+}
+
+#pragma mark Running work
+
+void run_workers(sm_workers *workers, work_func func, void *context, const unsigned count) {
+    
+    if (!count) return;
+    
+    if (!workers || workers->number_of_threads == 1 || count == 1) {
+        
+        func(context, 0, count);
+        return;
+    }
+    
+    // Publish the job
+    pthread_mutex_lock(&workers->lock);
+    workers->func = func;
+    workers->context = context;
+    workers->count = count;
+    workers->busy = workers->number_of_threads - 1;
+    workers->generation++;
+    pthread_cond_broadcast(&workers->work_ready);
+    pthread_mutex_unlock(&workers->lock);
+    
+    // Do our share
+    run_range(workers, 0);
+    
+    // Wait for the others
+    pthread_mutex_lock(&workers->lock);
+    while (workers->busy) pthread_cond_wait(&workers->work_done, &workers->lock);
+    pthread_mutex_unlock(&workers->lock);
+}
+
+static void run_range(sm_workers *workers, const unsigned thread_index) {
+    
+    const unsigned long long count = workers->count, n = workers->number_of_threads;
+    const unsigned begin = (unsigned)(count * thread_index / n);
+    const unsigned end = (unsigned)(count * (thread_index + 1) / n);
+    
+    if (begin < end) workers->func(workers->context, begin, end);
+}
+
+static void *worker_main(void *arg) {
+    
+    worker_start start = *(worker_start *)arg;
+    sm_workers *workers = start.workers;
+    unsigned generation = 0;
+    
+    free(arg);
+    
+    pthread_mutex_lock(&workers->lock);
+    
+    for (;;) {
+        
+        while (!workers->quit && workers->generation == generation)
+            pthread_cond_wait(&workers->work_ready, &workers->lock);
+        
+        if (workers->quit) break;
+        
+        generation = workers->generation;
+        pthread_mutex_unlock(&workers->lock);
+        
+        run_range(workers, start.thread_index);
+        
+        pthread_mutex_lock(&workers->lock);
+        if (!--workers->busy) pthread_cond_signal(&workers->work_done);
+    }
+    
+    pthread_mutex_unlock(&workers->lock);
+    
+    return 0;
+}
@@ -0,0 +1,43 @@
+//
+//  workers.h
+//  spring_mass
+//
+//  Created by Richard Henry on 19/10/2026.
+//  Copyright 2026 Dogstar Diversions. http://www.dogstar.mobi
+//
+
+#ifndef SM_WORKERS_H
+#define SM_WORKERS_H
+
+#include <pthread.h>
+
+// Work is handed out as a half open range [begin, end) of some item count
+typedef void(*work_func)(void *context, const unsigned begin, const unsigned end);
+
+typedef struct {
+    
+    unsigned            number_of_threads;
+    pthread_t           *threads;
+    
+    pthread_mutex_t     lock;
+    pthread_cond_t      work_ready;
+    pthread_cond_t      work_done;
+    
+    // Current job, read by the workers under the lock
+    work_func           func;
+    void                *context;
+    unsigned            count;
+    unsigned            generation;
+    unsigned            busy;
+    int                 quit;
+    
+} sm_workers;
+
+sm_workers *new_workers(const unsigned number_of_threads);
+void free_workers(sm_workers * const workers);
+
+// Splits count items into one contiguous range per thread and waits for them all.
+// A null workers pointer runs the whole range on the calling thread.
+void run_workers(sm_workers *workers, work_func func, void *context, const unsigned count);
+
+#endif